@@ -0,0 +1,641 @@
+#define _POSIX_C_SOURCE 200809L
+#include "processor.h"
+#include "hostprof.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <sys/resource.h>
+
+// Simulator throughput harness: runs every workload on every engine with
+// warmup and repetitions, and reports simulated instructions and cycles per
+// host second. Built with -Wl,--wrap=malloc,... so heap use can be counted.
+// Every run is checked against the workload's golden final state (foo.txt ->
+// foo.golden) when one exists; -c only does that check. -b compares against
+// a results file from an earlier -o run and fails on any change in simulated
+// cycles or instructions, or on a throughput drop that is both larger than
+// the threshold and significant under a one-sided Mann-Whitney U test.
+// The SIMD extension is on for every workload; the scalar ones do not use
+// opcodes 13-15.
+
+#define MAX_REPS       100
+#define MIN_SAMPLE_NS  5000000ULL   // each timed sample runs at least 5 ms
+#define MAX_BASELINE   256
+#define ALPHA          0.01         // significance level of the regression test
+#define MAX_CYCLES     100000000ULL // a run still going after this many cycles fails
+
+typedef struct {
+    const char *name;
+    void (*run)(Processor *p);
+} Engine;
+
+static void run_step(Processor *p) {
+    while (proc_running(p) && p->cycle < MAX_CYCLES) {
+        process_cycle(p);
+    }
+}
+
+static void run_skip(Processor *p) {
+    while (proc_running(p) && p->cycle < MAX_CYCLES) {
+        proc_skip_idle(p);
+        process_cycle(p);
+    }
+}
+
+static void run_until(Processor *p) {
+    StopCond cond = { MAX_CYCLES, 0, -1, -1, 0, -1, false };
+    proc_run(p, &cond);
+}
+
+static bool check_finished(const Processor *got, const char *workload, const char *engine) {
+    if (!proc_running(got)) return true;
+    fprintf(stderr, "%s [%s]: still running after %llu cycles\n", workload, engine, MAX_CYCLES);
+    return false;
+}
+
+static const Engine engines[] = {
+    { "step", run_step },
+    { "skip", run_skip },
+    { "run",  run_until },
+};
+#define NUM_ENGINES (int)(sizeof(engines) / sizeof(engines[0]))
+
+static unsigned long long alloc_count;
+static unsigned long long alloc_bytes;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    alloc_count++;
+    alloc_bytes += size;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    alloc_count++;
+    alloc_bytes += n * size;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    alloc_count++;
+    alloc_bytes += size;
+    return __real_realloc(ptr, size);
+}
+
+static bool parse_sim_options(char *options, Processor *expect) {
+    for (char *opt = strtok(options, " \t\n"); opt; opt = strtok(NULL, " \t\n")) {
+        if (strcmp(opt, "-m") == 0) {
+            expect->counter_mmio = true;
+        } else if (strcmp(opt, "-i") == 0) {
+            expect->irq.on = true;
+        } else if (strcmp(opt, "-l") == 0 && (opt = strtok(NULL, " \t\n"))) {
+            expect->mem_latency = (uint16_t)atoi(opt);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Reads the expected registers, SREG and data memory of a workload. Lines are
+// "R<n> <value>", "SREG <value>" or "MEM <addr> <value>"; anything not listed
+// is expected to be zero. A "SIM <options>" line names the sim options the
+// workload runs with (-m, -i); they are left in expect for the caller to
+// copy. With -i, "IRQ <line> <raised> <taken> <lost>" lines give the expected
+// interrupt counts, again zero when not listed. How many timer ticks fit in
+// a run depends on the memory latency, so they are only compared at the one
+// the golden was recorded with, "-l <n>" on the SIM line (0 by default).
+// Returns false when there is no golden file.
+static bool load_golden(const char *workload, Processor *expect) {
+    char path[512];
+    size_t len = strlen(workload);
+    expect->counter_mmio = false;
+    expect->irq.on = false;
+    expect->mem_latency = 0;
+    if (len < 4 || len + 4 > sizeof(path) || strcmp(workload + len - 4, ".txt") != 0) {
+        return false;
+    }
+    memcpy(path, workload, len - 4);
+    strcpy(path + len - 4, ".golden");
+
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return false;
+    }
+    memset(expect->Register, 0, sizeof(expect->Register));
+    memset(expect->data_mem, 0, sizeof(expect->data_mem));
+    expect->SREG = 0;
+    memset(expect->irq.raised, 0, sizeof(expect->irq.raised));
+    memset(expect->irq.taken, 0, sizeof(expect->irq.taken));
+    memset(expect->irq.lost, 0, sizeof(expect->irq.lost));
+
+    char line[128];
+    unsigned reg, addr, value, raised, taken, lost;
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '\n' || line[0] == ';' || line[0] == '#') continue;
+        if (sscanf(line, "R%u %x", &reg, &value) == 2 && reg < 64) {
+            expect->Register[reg] = (uint8_t)value;
+        } else if (sscanf(line, "SREG %x", &value) == 1) {
+            expect->SREG = (uint8_t)value;
+        } else if (sscanf(line, "MEM %x %x", &addr, &value) == 2 && addr < 2048) {
+            expect->data_mem[addr] = (uint8_t)value;
+        } else if (sscanf(line, "IRQ %u %u %u %u", &reg, &raised, &taken, &lost) == 4 && reg < IRQ_LINES) {
+            expect->irq.raised[reg] = raised;
+            expect->irq.taken[reg] = taken;
+            expect->irq.lost[reg] = lost;
+        } else if (strncmp(line, "SIM ", 4) == 0 && parse_sim_options(line + 4, expect)) {
+            continue;
+        } else {
+            fprintf(stderr, "%s: invalid line: %s", path, line);
+            exit(EXIT_FAILURE);
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+static bool check_golden(const Processor *expect, const Processor *got, const char *workload, const char *engine) {
+    bool ok = true;
+    for (int i = 0; i < 64; i++) {
+        if (expect->Register[i] != got->Register[i]) {
+            fprintf(stderr, "%s [%s]: R%d is 0x%02X, expected 0x%02X\n", workload, engine, i, got->Register[i], expect->Register[i]);
+            ok = false;
+        }
+    }
+    if (expect->SREG != got->SREG) {
+        fprintf(stderr, "%s [%s]: SREG is 0x%02X, expected 0x%02X\n", workload, engine, got->SREG, expect->SREG);
+        ok = false;
+    }
+    for (int i = 0; i < 2048; i++) {
+        if (expect->data_mem[i] != got->data_mem[i]) {
+            fprintf(stderr, "%s [%s]: data[0x%04X] is 0x%02X, expected 0x%02X\n", workload, engine, i, got->data_mem[i], expect->data_mem[i]);
+            ok = false;
+        }
+    }
+    for (int l = 0; expect->irq.on && expect->mem_latency == got->mem_latency && l < IRQ_LINES; l++) {
+        const IrqState *e = &expect->irq, *g = &got->irq;
+        if (e->raised[l] != g->raised[l] || e->taken[l] != g->taken[l] || e->lost[l] != g->lost[l]) {
+            fprintf(stderr, "%s [%s]: line %d raised/taken/lost %llu/%llu/%llu, expected %llu/%llu/%llu\n", workload, engine, l,
+                    (unsigned long long)g->raised[l], (unsigned long long)g->taken[l], (unsigned long long)g->lost[l],
+                    (unsigned long long)e->raised[l], (unsigned long long)e->taken[l], (unsigned long long)e->lost[l]);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// Latencies depend on -l, so rather than against a golden value each engine
+// is checked against the interrupt latencies the first one measured.
+static bool check_latency(const IrqState *first, const Processor *got, const char *workload, const char *engine) {
+    bool ok = true;
+    for (int l = 0; l < IRQ_LINES; l++) {
+        const IrqState *g = &got->irq;
+        if (first->latency_min[l] != g->latency_min[l] || first->latency_max[l] != g->latency_max[l] ||
+            first->latency_total[l] != g->latency_total[l]) {
+            fprintf(stderr, "%s [%s]: line %d latency min/max/total %llu/%llu/%llu, %s measured %llu/%llu/%llu\n", workload, engine, l,
+                    (unsigned long long)g->latency_min[l], (unsigned long long)g->latency_max[l], (unsigned long long)g->latency_total[l],
+                    engines[0].name, (unsigned long long)first->latency_min[l], (unsigned long long)first->latency_max[l],
+                    (unsigned long long)first->latency_total[l]);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// nearest-rank percentile of a sorted sample
+static double percentile(const double *sorted, int n, double pct) {
+    int rank = (int)(pct / 100.0 * n + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > n) rank = n;
+    return sorted[rank - 1];
+}
+
+typedef struct {
+    uint64_t cycles;
+    uint64_t instructions;
+    double   mips[MAX_REPS];
+    double   mcps[MAX_REPS];
+} Result;
+
+static void bench_one(const Processor *image, const Engine *e, int warmup, int reps, Result *r, Processor *cpu) {
+    // find how many runs make one sample long enough to time, then warm up
+    uint64_t batch = 1;
+    for (;;) {
+        uint64_t start = now_ns();
+        for (uint64_t b = 0; b < batch; b++) {
+            *cpu = *image;
+            e->run(cpu);
+        }
+        if (now_ns() - start >= MIN_SAMPLE_NS) break;
+        batch *= 2;
+    }
+    for (int i = 0; i < warmup; i++) {
+        for (uint64_t b = 0; b < batch; b++) {
+            *cpu = *image;
+            e->run(cpu);
+        }
+    }
+    r->cycles = cpu->perf.cycles;
+    r->instructions = cpu->perf.instret;
+
+    for (int i = 0; i < reps; i++) {
+        uint64_t start = now_ns();
+        for (uint64_t b = 0; b < batch; b++) {
+            *cpu = *image;
+            e->run(cpu);
+        }
+        double secs = (now_ns() - start) / 1e9;
+        r->mips[i] = (double)r->instructions * batch / secs / 1e6;
+        r->mcps[i] = (double)r->cycles * batch / secs / 1e6;
+    }
+}
+
+typedef struct {
+    char     workload[256];
+    char     engine[16];
+    uint64_t cycles;
+    uint64_t instructions;
+    int      nsamples;
+    double   mips[MAX_REPS];
+} BaselineEntry;
+
+typedef struct {
+    int           mem_latency;
+    int           count;
+    BaselineEntry entries[MAX_BASELINE];
+} Baseline;
+
+// Finds "key": inside [p, end) and returns a pointer just past the colon.
+static const char *json_field(const char *p, const char *end, const char *key) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    size_t len = strlen(pattern);
+    for (; p + len <= end; p++) {
+        if (memcmp(p, pattern, len) == 0) {
+            return p + len;
+        }
+    }
+    return NULL;
+}
+
+static bool json_string(const char *p, const char *end, const char *key, char *out, size_t size) {
+    p = json_field(p, end, key);
+    if (!p) return false;
+    while (p < end && *p != '"') p++;
+    const char *q = ++p;
+    while (q < end && *q != '"') q++;
+    if (q >= end || (size_t)(q - p) >= size) return false;
+    memcpy(out, p, q - p);
+    out[q - p] = '\0';
+    return true;
+}
+
+// Loads the results file written by -o. Only the fields the comparison needs
+// are read; the parser relies on the layout dbhbench itself writes.
+static bool load_baseline(const char *path, Baseline *b) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *text = malloc(size + 1);
+    if (!text || fread(text, 1, size, f) != (size_t)size) {
+        fprintf(stderr, "%s: read failed\n", path);
+        fclose(f);
+        free(text);
+        return false;
+    }
+    text[size] = '\0';
+    fclose(f);
+
+    const char *end = text + size;
+    const char *p = json_field(text, end, "mem_latency");
+    b->mem_latency = p ? atoi(p) : 0;
+    b->count = 0;
+    p = json_field(text, end, "results");
+    while (p && (p = strchr(p, '{')) && b->count < MAX_BASELINE) {
+        const char *close = strchr(p, '}');
+        if (!close) break;
+        BaselineEntry *e = &b->entries[b->count];
+        const char *v;
+        if (json_string(p, close, "workload", e->workload, sizeof(e->workload)) &&
+            json_string(p, close, "engine", e->engine, sizeof(e->engine)) &&
+            (v = json_field(p, close, "cycles"))) {
+            e->cycles = strtoull(v, NULL, 10);
+            v = json_field(p, close, "instructions");
+            e->instructions = v ? strtoull(v, NULL, 10) : 0;
+            e->nsamples = 0;
+            v = json_field(p, close, "mips_samples");
+            if (v && (v = strchr(v, '['))) {
+                char *next;
+                v++;
+                while (e->nsamples < MAX_REPS) {
+                    double x = strtod(v, &next);
+                    if (next == v) break;
+                    e->mips[e->nsamples++] = x;
+                    v = next;
+                    while (*v == ',' || *v == ' ') v++;
+                }
+            }
+            b->count++;
+        }
+        p = close + 1;
+    }
+    free(text);
+    return true;
+}
+
+static const BaselineEntry *find_baseline(const Baseline *b, const char *workload, const char *engine) {
+    for (int i = 0; i < b->count; i++) {
+        if (strcmp(b->entries[i].workload, workload) == 0 && strcmp(b->entries[i].engine, engine) == 0) {
+            return &b->entries[i];
+        }
+    }
+    return NULL;
+}
+
+// One-sided Mann-Whitney U test (normal approximation with tie correction):
+// probability of seeing samples this much lower than the baseline by chance.
+static double mann_whitney_p(const double *cur, int n1, const double *base, int n2) {
+    int n = n1 + n2;
+    double all[2 * MAX_REPS];
+    memcpy(all, cur, n1 * sizeof(double));
+    memcpy(all + n1, base, n2 * sizeof(double));
+    qsort(all, n, sizeof(double), cmp_double);
+
+    double rank_sum = 0, ties = 0;
+    for (int i = 0; i < n; ) {
+        int j = i;
+        while (j < n && all[j] == all[i]) j++;
+        double t = j - i;
+        ties += t * t * t - t;
+        i = j;
+    }
+    for (int k = 0; k < n1; k++) {
+        int lo = 0, hi = 0;
+        for (int i = 0; i < n; i++) {
+            if (all[i] < cur[k]) lo++;
+            if (all[i] <= cur[k]) hi++;
+        }
+        rank_sum += (lo + 1 + hi) / 2.0;
+    }
+    double u = rank_sum - n1 * (n1 + 1) / 2.0;
+    double mean = n1 * (double)n2 / 2.0;
+    double var = n1 * (double)n2 / 12.0 * ((n + 1) - ties / ((double)n * (n - 1)));
+    if (var <= 0) return 1.0;
+    double z = (u - mean + 0.5) / sqrt(var);
+    return 0.5 * erfc(-z / sqrt(2.0));
+}
+
+// relative p10-p90 spread of a sample, used to widen the threshold on noisy hosts
+static double spread(const double *v, int n, double *med) {
+    double sorted[MAX_REPS];
+    memcpy(sorted, v, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), cmp_double);
+    *med = percentile(sorted, n, 50);
+    return (percentile(sorted, n, 90) - percentile(sorted, n, 10)) / *med;
+}
+
+// Returns false when the run regressed against its baseline entry.
+static bool compare_baseline(const Baseline *b, const char *workload, const char *engine,
+                             const Result *r, int reps, double threshold) {
+    const BaselineEntry *e = find_baseline(b, workload, engine);
+    if (!e) {
+        printf("  %s [%s]: not in baseline\n", workload, engine);
+        return true;
+    }
+    bool ok = true;
+    if (e->cycles != r->cycles || e->instructions != r->instructions) {
+        printf("  %s [%s]: FAIL simulated cycles/instructions changed: %llu/%llu -> %llu/%llu\n", workload, engine,
+               (unsigned long long)e->cycles, (unsigned long long)e->instructions,
+               (unsigned long long)r->cycles, (unsigned long long)r->instructions);
+        ok = false;
+    }
+    if (e->nsamples < 2) {
+        return ok;
+    }
+    double base, cur;
+    double noise = spread(e->mips, e->nsamples, &base);
+    spread(r->mips, reps, &cur);
+    if (noise > threshold) {
+        threshold = noise;
+    }
+    double change = (cur - base) / base;
+    double p = mann_whitney_p(r->mips, reps, e->mips, e->nsamples);
+    bool slower = change < -threshold && p < ALPHA;
+    printf("  %s [%s]: %s MIPS %.2f -> %.2f (%+.1f%%, limit -%.1f%%, p=%.4f)\n", workload, engine,
+           slower ? "FAIL" : "ok  ", base, cur, 100.0 * change, 100.0 * threshold, p);
+    return ok && !slower;
+}
+
+static void write_samples(FILE *f, const char *key, const double *v, int n) {
+    fprintf(f, "\"%s\": [", key);
+    for (int i = 0; i < n; i++) {
+        fprintf(f, "%s%.4f", i ? ", " : "", v[i]);
+    }
+    fprintf(f, "]");
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-c] [-w warmup] [-r reps] [-l mem_latency] [-o results.json]\n"
+                    "       [-b baseline.json] [-t threshold_pct] workload.txt...\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    int warmup = 3;
+    int reps = 11;
+    int mem_latency = 0;
+    const char *out_path = NULL;
+    const char *baseline_path = NULL;
+    double threshold = 5.0;
+    bool check_only = false;
+    int first = argc;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-c") == 0) {
+            check_only = true;
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            warmup = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            reps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            mem_latency = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+        } else {
+            first = i;
+            break;
+        }
+    }
+    if (first == argc || reps < 1 || reps > MAX_REPS || warmup < 0 || mem_latency < 0 || mem_latency > 0xFFFF) {
+        usage(argv[0]);
+    }
+
+    Processor *image = malloc(sizeof(Processor));
+    Processor *expect = malloc(sizeof(Processor));
+    Processor *cpu = malloc(sizeof(Processor));
+    Result *r = malloc(sizeof(Result));
+    if (!image || !expect || !cpu || !r) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+
+    if (check_only) {
+        int failed = 0;
+        for (int w = first; w < argc; w++) {
+            proc_init(image);
+            mem_init(image);
+            image->quiet = true;
+            image->mem_latency = (uint16_t)mem_latency;
+            image->simd = true;
+            bool has_golden = load_golden(argv[w], expect);
+            image->counter_mmio = expect->counter_mmio;
+            image->irq.on = expect->irq.on;
+            if (mem_load_program(image, argv[w]) != DBH_OK) {
+                fprintf(stderr, "%s\n", image->error_msg);
+                failed++;
+                continue;
+            }
+            IrqState irq0;
+            for (int e = 0; e < NUM_ENGINES; e++) {
+                *cpu = *image;
+                engines[e].run(cpu);
+                bool ok = check_finished(cpu, argv[w], engines[e].name) &&
+                          (!has_golden || check_golden(expect, cpu, argv[w], engines[e].name));
+                if (e == 0) {
+                    irq0 = cpu->irq;
+                } else if (cpu->irq.on && !check_latency(&irq0, cpu, argv[w], engines[e].name)) {
+                    ok = false;
+                }
+                failed += !ok;
+                printf("%-24s %-6s %-8s %llu cycles\n", argv[w], engines[e].name,
+                       !has_golden ? "NOGOLDEN" : ok ? "PASS" : "FAIL", (unsigned long long)cpu->perf.cycles);
+            }
+        }
+        free(r);
+        free(cpu);
+        free(expect);
+        free(image);
+        return failed ? EXIT_FAILURE : 0;
+    }
+
+    Baseline *baseline = NULL;
+    if (baseline_path) {
+        baseline = malloc(sizeof(Baseline));
+        if (!baseline || !load_baseline(baseline_path, baseline)) {
+            return EXIT_FAILURE;
+        }
+        if (baseline->mem_latency != mem_latency) {
+            fprintf(stderr, "%s was recorded with -l %d, not -l %d\n", baseline_path, baseline->mem_latency, mem_latency);
+            return EXIT_FAILURE;
+        }
+    }
+    int regressions = 0;
+
+    FILE *out = NULL;
+    if (out_path) {
+        out = fopen(out_path, "w");
+        if (!out) {
+            perror("fopen");
+            return EXIT_FAILURE;
+        }
+        fprintf(out, "{\n  \"mem_latency\": %d, \"warmup\": %d, \"reps\": %d,\n  \"results\": [", mem_latency, warmup, reps);
+    }
+
+    printf("%-24s %-6s %10s %10s %10s %10s %10s %10s\n",
+           "Workload", "Engine", "Cycles", "Instrs", "MIPS p50", "MIPS p10", "MIPS p90", "MCPS p50");
+
+    int nresults = 0;
+    for (int w = first; w < argc; w++) {
+        proc_init(image);
+        mem_init(image);
+        image->quiet = true;
+        image->mem_latency = (uint16_t)mem_latency;
+        image->simd = true;
+        bool has_golden = load_golden(argv[w], expect);
+        image->counter_mmio = expect->counter_mmio;
+        image->irq.on = expect->irq.on;
+        if (mem_load_program(image, argv[w]) != DBH_OK) {
+            fprintf(stderr, "%s\n", image->error_msg);
+            return EXIT_FAILURE;
+        }
+
+        for (int e = 0; e < NUM_ENGINES; e++) {
+            bench_one(image, &engines[e], warmup, reps, r, cpu);
+            if (!check_finished(cpu, argv[w], engines[e].name) ||
+                (has_golden && !check_golden(expect, cpu, argv[w], engines[e].name))) {
+                fprintf(stderr, "%s [%s]: final state does not match the golden state\n", argv[w], engines[e].name);
+                return EXIT_FAILURE;
+            }
+            double mips[MAX_REPS], mcps[MAX_REPS];
+            memcpy(mips, r->mips, reps * sizeof(double));
+            memcpy(mcps, r->mcps, reps * sizeof(double));
+            qsort(mips, reps, sizeof(double), cmp_double);
+            qsort(mcps, reps, sizeof(double), cmp_double);
+
+            printf("%-24s %-6s %10llu %10llu %10.2f %10.2f %10.2f %10.2f\n", argv[w], engines[e].name,
+                   (unsigned long long)r->cycles, (unsigned long long)r->instructions,
+                   percentile(mips, reps, 50), percentile(mips, reps, 10),
+                   percentile(mips, reps, 90), percentile(mcps, reps, 50));
+
+            if (out) {
+                fprintf(out, "%s\n    {\"workload\": \"%s\", \"engine\": \"%s\", \"cycles\": %llu, \"instructions\": %llu,\n",
+                        nresults++ ? "," : "", argv[w], engines[e].name,
+                        (unsigned long long)r->cycles, (unsigned long long)r->instructions);
+                fprintf(out, "     \"mips_p50\": %.4f, \"mips_p10\": %.4f, \"mips_p90\": %.4f, \"mcps_p50\": %.4f,\n     ",
+                        percentile(mips, reps, 50), percentile(mips, reps, 10),
+                        percentile(mips, reps, 90), percentile(mcps, reps, 50));
+                write_samples(out, "mips_samples", r->mips, reps);
+                fprintf(out, "}");
+            }
+            if (baseline && !compare_baseline(baseline, argv[w], engines[e].name, r, reps, threshold / 100.0)) {
+                regressions++;
+            }
+        }
+    }
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    printf("Allocations: %llu (%llu bytes), peak RSS: %ld KiB\n", alloc_count, alloc_bytes, ru.ru_maxrss);
+    if (out) {
+        fprintf(out, "\n  ],\n  \"allocations\": %llu, \"allocated_bytes\": %llu, \"peak_rss_kib\": %ld\n}\n",
+                alloc_count, alloc_bytes, ru.ru_maxrss);
+        fclose(out);
+    }
+    if (baseline) {
+        printf("%d regression(s) against %s\n", regressions, baseline_path);
+        free(baseline);
+    }
+
+    free(r);
+    free(cpu);
+    free(expect);
+    free(image);
+    HOSTPROF_REPORT();
+    return regressions ? EXIT_FAILURE : 0;
+}
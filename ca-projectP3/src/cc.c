@@ -0,0 +1,2033 @@
+#include "processor.h"
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// dbhcc: compiler for a small C-like language, emitting assembly that
+// mem_load_program() accepts.
+//
+//   int n = 10, i;            scalars: signed 8-bit, kept in registers
+//   int a[16] = {3, 1, 2};    arrays: bytes in data memory, from address 0
+//   for (i = 0; i < n; i++) { a[i] = a[i] * 4 + i; }
+//
+// A program is a list of declarations and statements run top to bottom.
+// There are if/else, while, do/while, for, break and continue; the operators
+// are + - * ^ << >> (constant shift counts), & with a constant mask of 0-63
+// or 255, the comparisons (signed), && || ! - ~ and the compound assignments.
+// Arithmetic wraps at 8 bits. Results are meant to be left in arrays:
+// which register a scalar ends up in depends on allocation.
+//
+// Expressions become three-address code over virtual registers. Constants
+// (including the address of every loop head, since backward jumps are BR)
+// are hoisted out of loops together with other invariant expressions,
+// repeated expressions in a block are computed once, and dead code goes.
+// Virtual registers are then colored onto R1-R60 by Chaitin-Briggs graph
+// coloring after conservative coalescing, so a copy or a two-address
+// operation mostly shares the register of its operand; what does not fit is
+// spilled to data memory. Multiplication by a power of two becomes SAL.
+//
+// LDR/STR only take an immediate address, so a[i] with i not constant jumps
+// into a table of "LDR R61 k / BR R62 R63" stubs (one per element, one
+// table per array and direction) with the return address in R62:R63, the
+// same way the hand-written workloads do. All arrays share addresses 0-39;
+// spilled values take the top of that range. Addresses 40-63 hold the
+// interrupt controller (sim -i) and the counters (sim -m), so compiled code
+// stays clear of them and runs the same in every mode.
+
+#define ALLOC_REGS 60   // R1-R60
+#define R_VAL      61   // value passed to and from the memory stubs
+#define R_HI       62   // stub return address and jump scratch
+#define R_LO       63
+#define DATA_SIZE  IRQ_MMIO_BASE   // LDR/STR addresses below the MMIO windows
+
+static const char *src_name;
+
+static void fail(int line, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    if (line) fprintf(stderr, "%s:%d: error: ", src_name, line);
+    else fprintf(stderr, "%s: error: ", src_name);
+    vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+    exit(EXIT_FAILURE);
+}
+
+static void *grow(void *p, int *cap, int need, size_t size) {
+    if (need <= *cap) return p;
+    int n = *cap ? *cap : 64;
+    while (n < need) n *= 2;
+    p = realloc(p, (size_t)n * size);
+    if (!p) fail(0, "out of memory");
+    memset((char *)p + (size_t)*cap * size, 0, (size_t)(n - *cap) * size);
+    *cap = n;
+    return p;
+}
+
+// ---- lexer ----------------------------------------------------------------
+
+enum {
+    TK_EOF = 256, TK_NUM, TK_ID,
+    TK_INT, TK_IF, TK_ELSE, TK_WHILE, TK_DO, TK_FOR, TK_BREAK, TK_CONTINUE,
+    TK_LE, TK_GE, TK_EQ, TK_NE, TK_ANDAND, TK_OROR, TK_SHL, TK_SHR, TK_INC, TK_DEC,
+    TK_ADDEQ, TK_SUBEQ, TK_MULEQ, TK_XOREQ, TK_ANDEQ, TK_SHLEQ, TK_SHREQ
+};
+
+typedef struct {
+    int  kind;
+    int  value;
+    int  line;
+    char text[32];
+} Token;
+
+static Token *toks;
+static int ntoks, cap_toks, tpos;
+
+static const struct { const char *text; int kind; } keywords[] = {
+    { "int", TK_INT }, { "if", TK_IF }, { "else", TK_ELSE }, { "while", TK_WHILE },
+    { "do", TK_DO }, { "for", TK_FOR }, { "break", TK_BREAK }, { "continue", TK_CONTINUE },
+};
+
+static const struct { const char *text; int kind; } operators[] = {
+    { "<<=", TK_SHLEQ }, { ">>=", TK_SHREQ },
+    { "<=", TK_LE }, { ">=", TK_GE }, { "==", TK_EQ }, { "!=", TK_NE }, { "&&", TK_ANDAND },
+    { "||", TK_OROR }, { "<<", TK_SHL }, { ">>", TK_SHR }, { "++", TK_INC }, { "--", TK_DEC },
+    { "+=", TK_ADDEQ }, { "-=", TK_SUBEQ }, { "*=", TK_MULEQ }, { "^=", TK_XOREQ }, { "&=", TK_ANDEQ },
+};
+
+static void lex(const char *s) {
+    int line = 1;
+    for (;;) {
+        while (*s && (isspace((unsigned char)*s) || (s[0] == '/' && (s[1] == '/' || s[1] == '*')))) {
+            if (*s == '\n') line++;
+            if (s[0] == '/' && s[1] == '/') {
+                while (*s && *s != '\n') s++;
+            } else if (s[0] == '/') {
+                s += 2;
+                while (*s && !(s[0] == '*' && s[1] == '/')) {
+                    if (*s == '\n') line++;
+                    s++;
+                }
+                if (!*s) fail(line, "unterminated comment");
+                s += 2;
+            } else {
+                s++;
+            }
+        }
+        toks = grow(toks, &cap_toks, ntoks + 1, sizeof(Token));
+        Token *t = &toks[ntoks++];
+        t->line = line;
+        if (!*s) {
+            t->kind = TK_EOF;
+            return;
+        }
+        if (isdigit((unsigned char)*s)) {
+            char *end;
+            long v = strtol(s, &end, 0);
+            if (isalnum((unsigned char)*end) || v > 255) fail(line, "bad number (0-255)");
+            t->kind = TK_NUM;
+            t->value = (int)v;
+            s = end;
+        } else if (s[0] == '\'' && s[1] && s[2] == '\'') {
+            t->kind = TK_NUM;
+            t->value = (uint8_t)s[1];
+            s += 3;
+        } else if (isalpha((unsigned char)*s) || *s == '_') {
+            size_t n = 0;
+            while (isalnum((unsigned char)s[n]) || s[n] == '_') n++;
+            if (n >= sizeof(t->text)) fail(line, "name too long");
+            memcpy(t->text, s, n);
+            t->text[n] = '\0';
+            s += n;
+            t->kind = TK_ID;
+            for (size_t k = 0; k < sizeof(keywords) / sizeof(keywords[0]); k++) {
+                if (strcmp(t->text, keywords[k].text) == 0) t->kind = keywords[k].kind;
+            }
+        } else {
+            t->kind = 0;
+            for (size_t k = 0; k < sizeof(operators) / sizeof(operators[0]) && !t->kind; k++) {
+                size_t n = strlen(operators[k].text);
+                if (strncmp(s, operators[k].text, n) == 0) {
+                    t->kind = operators[k].kind;
+                    strcpy(t->text, operators[k].text);
+                    s += n;
+                }
+            }
+            if (!t->kind) {
+                if (!strchr("+-*/%^&|~!<>=()[]{};,", *s)) fail(line, "unexpected character '%c'", *s);
+                t->kind = *s;
+                t->text[0] = *s++;
+                t->text[1] = '\0';
+            }
+        }
+    }
+}
+
+// ---- syntax tree ----------------------------------------------------------
+
+enum {
+    N_NUM, N_VAR, N_INDEX, N_UNARY, N_BINARY,
+    N_ASSIGN, N_IF, N_WHILE, N_DO, N_FOR, N_BLOCK, N_BREAK, N_CONTINUE
+};
+
+typedef struct Node Node;
+struct Node {
+    int   kind;
+    int   op;
+    int   value;      // N_NUM
+    int   sym;        // N_VAR, N_INDEX
+    Node *a, *b, *c, *d;
+    Node *next;       // next statement in a block
+    int   line;
+};
+
+typedef struct {
+    char name[32];
+    int  size;                      // array length, 0 for a scalar
+    int  base;                      // arrays: first data address
+    int  vreg;                      // scalars
+    int  table[2];                  // label of the load/store stub table, -1 if none
+} Sym;
+
+static Sym *syms;
+static int nsyms, cap_syms;
+static int data_end;                // first data address no array uses
+
+typedef struct {
+    int addr;
+    int value;
+} Init;
+
+static Init inits[DATA_SIZE];
+static int ninits;
+
+static Node *new_node(int kind, int line) {
+    Node *n = calloc(1, sizeof(Node));
+    if (!n) fail(0, "out of memory");
+    n->kind = kind;
+    n->line = line;
+    return n;
+}
+
+static Token *peek(void) {
+    return &toks[tpos];
+}
+
+static bool accept(int kind) {
+    if (toks[tpos].kind != kind) return false;
+    tpos++;
+    return true;
+}
+
+static Token *expect(int kind, const char *what) {
+    if (toks[tpos].kind != kind) fail(toks[tpos].line, "expected %s", what);
+    return &toks[tpos++];
+}
+
+static int find_sym(const char *name) {
+    for (int i = 0; i < nsyms; i++) {
+        if (strcmp(syms[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+// value of an operator on 8-bit operands, as the generated code computes it
+static int eval_op(int op, int a, int b) {
+    int8_t sa = (int8_t)a, sb = (int8_t)b;
+    switch (op) {
+        case '+':       return (uint8_t)(a + b);
+        case '-':       return (uint8_t)(a - b);
+        case '*':       return (uint8_t)(a * b);
+        case '^':       return a ^ b;
+        case '&':       return a & b;
+        case '|':       return a | b;
+        case TK_SHL:    return b < 8 ? (uint8_t)(a << b) : 0;
+        case TK_SHR:    return (uint8_t)(sa >> (b < 8 ? b : 7));
+        case TK_EQ:     return a == b;
+        case TK_NE:     return a != b;
+        case '<':       return sa < sb;
+        case '>':       return sa > sb;
+        case TK_LE:     return sa <= sb;
+        case TK_GE:     return sa >= sb;
+        case TK_ANDAND: return a && b;
+        case TK_OROR:   return a || b;
+    }
+    return -1;
+}
+
+static Node *binary(int op, Node *a, Node *b, int line) {
+    if (a->kind == N_NUM && b->kind == N_NUM && eval_op(op, a->value, b->value) >= 0) {
+        a->value = eval_op(op, a->value, b->value);
+        free(b);
+        return a;
+    }
+    Node *n = new_node(N_BINARY, line);
+    n->op = op;
+    n->a = a;
+    n->b = b;
+    return n;
+}
+
+static Node *parse_expr(int min_prec);
+
+static Node *parse_primary(void) {
+    Token *t = peek();
+    if (accept(TK_NUM)) {
+        Node *n = new_node(N_NUM, t->line);
+        n->value = t->value;
+        return n;
+    }
+    if (accept('(')) {
+        Node *n = parse_expr(1);
+        expect(')', "')'");
+        return n;
+    }
+    if (accept(TK_ID)) {
+        int s = find_sym(t->text);
+        if (s < 0) fail(t->line, "'%s' is not declared", t->text);
+        Node *n = new_node(N_VAR, t->line);
+        n->sym = s;
+        if (accept('[')) {
+            if (!syms[s].size) fail(t->line, "'%s' is not an array", t->text);
+            n->kind = N_INDEX;
+            n->a = parse_expr(1);
+            expect(']', "']'");
+        } else if (syms[s].size) {
+            fail(t->line, "array '%s' needs an index", t->text);
+        }
+        return n;
+    }
+    fail(t->line, "expected an expression");
+    return NULL;
+}
+
+static Node *parse_unary(void) {
+    Token *t = peek();
+    if (accept('-') || accept('~') || accept('!') || accept('+')) {
+        int op = t->kind;
+        Node *a = parse_unary();
+        if (op == '+') return a;
+        if (a->kind == N_NUM) {
+            a->value = op == '-' ? (uint8_t)-a->value : op == '~' ? (uint8_t)~a->value : !a->value;
+            return a;
+        }
+        Node *n = new_node(N_UNARY, t->line);
+        n->op = op;
+        n->a = a;
+        return n;
+    }
+    return parse_primary();
+}
+
+static int precedence(int kind) {
+    switch (kind) {
+        case TK_OROR:                     return 1;
+        case TK_ANDAND:                   return 2;
+        case '|':                         return 3;
+        case '^':                         return 4;
+        case '&':                         return 5;
+        case TK_EQ: case TK_NE:           return 6;
+        case '<': case '>': case TK_LE: case TK_GE: return 7;
+        case TK_SHL: case TK_SHR:         return 8;
+        case '+': case '-':               return 9;
+        case '*': case '/': case '%':     return 10;
+    }
+    return 0;
+}
+
+static Node *parse_expr(int min_prec) {
+    Node *lhs = parse_unary();
+    for (;;) {
+        Token *t = peek();
+        int prec = precedence(t->kind);
+        if (!prec || prec < min_prec) return lhs;
+        tpos++;
+        Node *rhs = parse_expr(prec + 1);
+        lhs = binary(t->kind, lhs, rhs, t->line);
+    }
+}
+
+static Node *lvalue(void) {
+    Node *n = parse_primary();
+    if (n->kind != N_VAR && n->kind != N_INDEX) fail(n->line, "cannot assign to this");
+    return n;
+}
+
+static Node *assignment(Node *target, Node *value, int line) {
+    Node *n = new_node(N_ASSIGN, line);
+    n->a = target;
+    n->b = value;
+    return n;
+}
+
+// copy of an lvalue; index expressions have no side effects, so evaluating
+// one twice for "a[i] += 1" is harmless
+static Node *clone(const Node *n) {
+    if (!n) return NULL;
+    Node *c = new_node(n->kind, n->line);
+    *c = *n;
+    c->a = clone(n->a);
+    c->b = clone(n->b);
+    return c;
+}
+
+// assignment, compound assignment, ++ or --
+static Node *parse_simple(void) {
+    int line = peek()->line;
+    if (accept(TK_INC) || accept(TK_DEC)) {
+        int op = toks[tpos - 1].kind == TK_INC ? '+' : '-';
+        Node *t = lvalue();
+        Node *one = new_node(N_NUM, line);
+        one->value = 1;
+        return assignment(t, binary(op, clone(t), one, line), line);
+    }
+    Node *t = lvalue();
+    Token *op = peek();
+    tpos++;
+    int bin = 0;
+    switch (op->kind) {
+        case '=':      break;
+        case TK_ADDEQ: bin = '+'; break;
+        case TK_SUBEQ: bin = '-'; break;
+        case TK_MULEQ: bin = '*'; break;
+        case TK_XOREQ: bin = '^'; break;
+        case TK_ANDEQ: bin = '&'; break;
+        case TK_SHLEQ: bin = TK_SHL; break;
+        case TK_SHREQ: bin = TK_SHR; break;
+        case TK_INC:
+        case TK_DEC: {
+            Node *one = new_node(N_NUM, line);
+            one->value = 1;
+            return assignment(t, binary(op->kind == TK_INC ? '+' : '-', clone(t), one, line), line);
+        }
+        default:
+            fail(op->line, "expected an assignment");
+    }
+    Node *v = parse_expr(1);
+    return assignment(t, bin ? binary(bin, clone(t), v, line) : v, line);
+}
+
+static Node *parse_stmt(void);
+
+// "int x = 1, a[4] = {1, 2};" declares and returns the initializing statements
+static Node *parse_decl(void) {
+    Node *first = NULL, **tail = &first;
+    do {
+        Token *name = expect(TK_ID, "a name");
+        if (find_sym(name->text) >= 0) fail(name->line, "'%s' is already declared", name->text);
+        syms = grow(syms, &cap_syms, nsyms + 1, sizeof(Sym));
+        int s = nsyms++;
+        Sym *sym = &syms[s];
+        strcpy(sym->name, name->text);
+        sym->table[0] = sym->table[1] = -1;
+        if (accept('[')) {
+            Token *len = expect(TK_NUM, "an array length");
+            expect(']', "']'");
+            if (len->value < 1 || data_end + len->value > DATA_SIZE) {
+                fail(len->line, "arrays only fit in data addresses 0-%d", DATA_SIZE - 1);
+            }
+            sym->size = len->value;
+            sym->base = data_end;
+            data_end += len->value;
+            if (accept('=')) {
+                expect('{', "'{'");
+                int k = 0;
+                do {
+                    Node *v = parse_expr(1);
+                    if (v->kind != N_NUM) fail(v->line, "array initializers must be constant");
+                    if (k >= sym->size) fail(v->line, "too many initializers for '%s'", sym->name);
+                    inits[ninits].addr = sym->base + k++;
+                    inits[ninits++].value = v->value;
+                    free(v);
+                } while (accept(','));
+                expect('}', "'}'");
+            }
+        } else if (accept('=')) {
+            Node *v = new_node(N_VAR, name->line);
+            v->sym = s;
+            *tail = assignment(v, parse_expr(1), name->line);
+            tail = &(*tail)->next;
+        }
+    } while (accept(','));
+    expect(';', "';'");
+    if (!first) first = new_node(N_BLOCK, toks[tpos - 1].line);
+    return first;
+}
+
+static Node *parse_block_body(int end) {
+    Node *b = new_node(N_BLOCK, peek()->line);
+    Node **tail = &b->a;
+    while (!accept(end)) {
+        if (peek()->kind == TK_EOF) fail(peek()->line, "expected '}'");
+        *tail = accept(TK_INT) ? parse_decl() : parse_stmt();
+        while (*tail) tail = &(*tail)->next;
+    }
+    return b;
+}
+
+static Node *parse_stmt(void) {
+    Token *t = peek();
+    Node *n;
+    if (accept('{')) return parse_block_body('}');
+    if (accept(';')) return new_node(N_BLOCK, t->line);
+    if (accept(TK_INT)) {
+        // a declaration as the body of if/while: keep it in a block
+        n = new_node(N_BLOCK, t->line);
+        n->a = parse_decl();
+        return n;
+    }
+    if (accept(TK_IF)) {
+        n = new_node(N_IF, t->line);
+        expect('(', "'('");
+        n->a = parse_expr(1);
+        expect(')', "')'");
+        n->b = parse_stmt();
+        if (accept(TK_ELSE)) n->c = parse_stmt();
+        return n;
+    }
+    if (accept(TK_WHILE)) {
+        n = new_node(N_WHILE, t->line);
+        expect('(', "'('");
+        n->a = parse_expr(1);
+        expect(')', "')'");
+        n->b = parse_stmt();
+        return n;
+    }
+    if (accept(TK_DO)) {
+        n = new_node(N_DO, t->line);
+        n->b = parse_stmt();
+        expect(TK_WHILE, "'while'");
+        expect('(', "'('");
+        n->a = parse_expr(1);
+        expect(')', "')'");
+        expect(';', "';'");
+        return n;
+    }
+    if (accept(TK_FOR)) {
+        n = new_node(N_FOR, t->line);
+        expect('(', "'('");
+        if (!accept(';')) {
+            n->a = parse_simple();
+            expect(';', "';'");
+        }
+        if (!accept(';')) {
+            n->b = parse_expr(1);
+            expect(';', "';'");
+        }
+        if (!accept(')')) {
+            n->c = parse_simple();
+            expect(')', "')'");
+        }
+        n->d = parse_stmt();
+        return n;
+    }
+    if (accept(TK_BREAK) || accept(TK_CONTINUE)) {
+        n = new_node(t->kind == TK_BREAK ? N_BREAK : N_CONTINUE, t->line);
+        expect(';', "';'");
+        return n;
+    }
+    n = parse_simple();
+    expect(';', "';'");
+    return n;
+}
+
+// ---- intermediate code ----------------------------------------------------
+
+// Three-address code over virtual registers; vreg 0 is R0. d = a op b for
+// the ALU ops, d = a op imm for ANDI/SAL/SAR.
+enum {
+    I_NOP, I_ADD, I_SUB, I_MUL, I_EOR, I_ANDI, I_SAL, I_SAR,
+    I_MOVSH,    // d = imm << imm2
+    I_COPY,     // d = a
+    I_LA,       // d = high (imm 0) or low (imm 1) byte of the address of label
+    I_LDR,      // d = data[imm]
+    I_STR,      // data[imm] = a
+    I_GET,      // d = R61
+    I_SET,      // R61 = a
+    I_STUB,     // call the stub at a:b (imm = array, imm2 = 1 for a store)
+    I_LABEL,
+    I_JMP,      // forward jump
+    I_BZ,       // forward jump if a == 0
+    I_BNZ,      // forward jump if a != 0
+    I_BR        // jump to a:b, which holds the address of label
+};
+
+typedef struct {
+    uint8_t op;
+    int     d, a, b;
+    int     imm, imm2;
+    int     label;
+} Ir;
+
+typedef struct {
+    bool temp;      // an expression temporary rather than a named variable
+    bool nospill;   // a spill reload or store: spilling it again cannot help
+} Vreg;
+
+typedef struct {
+    int head, exit;   // labels
+} Loop;
+
+static Ir *ir;
+static int nir, cap_ir;
+static Vreg *vregs;
+static int nvregs, cap_vregs;
+static int *label_pos;
+static int nlabels, cap_labels;
+static Loop *loops;
+static int nloops, cap_loops;
+static int break_label[64], continue_label[64], loop_nest;
+
+static int new_vreg(bool temp) {
+    vregs = grow(vregs, &cap_vregs, nvregs + 1, sizeof(Vreg));
+    vregs[nvregs].temp = temp;
+    return nvregs++;
+}
+
+static int new_label(void) {
+    label_pos = grow(label_pos, &cap_labels, nlabels + 1, sizeof(int));
+    label_pos[nlabels] = -1;
+    return nlabels++;
+}
+
+static Ir *emit(int op) {
+    ir = grow(ir, &cap_ir, nir + 1, sizeof(Ir));
+    Ir *i = &ir[nir++];
+    memset(i, 0, sizeof(*i));
+    i->op = (uint8_t)op;
+    return i;
+}
+
+static void place(int label) {
+    emit(I_LABEL)->label = label;
+    label_pos[label] = nir - 1;
+}
+
+static int op3(int op, int a, int b) {
+    Ir *i = emit(op);
+    i->a = a;
+    i->b = b;
+    return i->d = new_vreg(true);
+}
+
+static int op_imm(int op, int a, int imm) {
+    Ir *i = emit(op);
+    i->a = a;
+    i->imm = imm;
+    return i->d = new_vreg(true);
+}
+
+static int movsh(int q, int k) {
+    Ir *i = emit(I_MOVSH);
+    i->imm = q;
+    i->imm2 = k;
+    return i->d = new_vreg(true);
+}
+
+// a register holding c; 0 (R0) for zero
+static int constant(int c) {
+    c &= 0xFF;
+    if (c == 0) return 0;
+    for (int k = 0; k < 8; k++) {
+        if ((c >> k) <= 63 && (c & ((1 << k) - 1)) == 0) return movsh(c >> k, k);
+    }
+    return op3(I_ADD, movsh(c >> 2, 2), movsh(c & 3, 0));
+}
+
+static int address_of(int label, int low) {
+    Ir *i = emit(I_LA);
+    i->label = label;
+    i->imm = low;
+    return i->d = new_vreg(true);
+}
+
+static void jump(int label) {
+    if (label_pos[label] >= 0) {
+        // backward: BR through the loop head's address
+        int hi = address_of(label, 0);
+        int lo = address_of(label, 1);
+        Ir *i = emit(I_BR);
+        i->a = hi;
+        i->b = lo;
+        i->label = label;
+    } else {
+        emit(I_JMP)->label = label;
+    }
+}
+
+static void branch(int op, int a, int label) {
+    Ir *i = emit(op);
+    i->a = a;
+    i->label = label;
+}
+
+static bool const_value(const Node *n, int *v) {
+    if (n->kind != N_NUM) return false;
+    *v = n->value;
+    return true;
+}
+
+static void cond_jump(const Node *e, bool when, int label);
+static int gen_expr(const Node *e);
+
+static int table_label(Sym *s, int store) {
+    if (s->table[store] < 0) s->table[store] = new_label();
+    return s->table[store];
+}
+
+// address of element idx's stub in a's table, as hi:lo registers
+static void stub_address(Sym *s, int store, const Node *idx, int *hi, int *lo) {
+    int i = gen_expr(idx);
+    int label = table_label(s, store);
+    int twice = op_imm(I_SAL, i, 1);
+    *lo = op3(I_ADD, twice, address_of(label, 1));
+    *hi = address_of(label, 0);
+}
+
+static void stub_call(int sym, int store, int hi, int lo) {
+    Ir *i = emit(I_STUB);
+    i->a = hi;
+    i->b = lo;
+    i->imm = sym;
+    i->imm2 = store;
+}
+
+static int gen_load(const Node *e) {
+    Sym *s = &syms[e->sym];
+    int k;
+    if (const_value(e->a, &k)) {
+        if (k >= s->size) fail(e->line, "index %d is out of range for '%s'", k, s->name);
+        Ir *i = emit(I_LDR);
+        i->imm = s->base + k;
+        return i->d = new_vreg(true);
+    }
+    int hi, lo;
+    stub_address(s, 0, e->a, &hi, &lo);
+    stub_call(e->sym, 0, hi, lo);
+    Ir *i = emit(I_GET);
+    return i->d = new_vreg(true);
+}
+
+static void gen_store(const Node *e, int v) {
+    Sym *s = &syms[e->sym];
+    int k;
+    if (const_value(e->a, &k)) {
+        if (k >= s->size) fail(e->line, "index %d is out of range for '%s'", k, s->name);
+        Ir *i = emit(I_STR);
+        i->a = v;
+        i->imm = s->base + k;
+        return;
+    }
+    int hi, lo;
+    stub_address(s, 1, e->a, &hi, &lo);
+    emit(I_SET)->a = v;
+    stub_call(e->sym, 1, hi, lo);
+}
+
+// a truth value as 0 or 1
+static int gen_bool(const Node *e) {
+    int d = new_vreg(true);
+    int skip = new_label();
+    Ir *i = emit(I_MOVSH);
+    i->d = d;
+    cond_jump(e, false, skip);
+    i = emit(I_MOVSH);
+    i->d = d;
+    i->imm = 1;
+    place(skip);
+    return d;
+}
+
+// Signed a < b, as a register that is non-zero exactly when it holds:
+// the sign of a - b, corrected when the subtraction overflows (operands of
+// different signs and a result whose sign differs from a's). The overflow
+// test ANDs two sign masks with MUL, as there is no register AND.
+static int gen_less(int a, int b) {
+    if (b == 0) return op_imm(I_SAR, a, 7);
+    int d = op3(I_SUB, a, b);
+    int differ = op_imm(I_SAR, op3(I_EOR, a, b), 7);
+    int flipped = op_imm(I_SAR, op3(I_EOR, a, d), 7);
+    int overflow = op3(I_MUL, differ, flipped);   // 1 or 0
+    return op3(I_ADD, op_imm(I_SAR, d, 7), overflow);
+}
+
+// a < c for a constant c of 0-127: a - c only overflows when a is negative,
+// and then a < c anyway, so the sum of the two sign masks will do
+static int gen_less_const(int a, int c) {
+    if (c == 0) return op_imm(I_SAR, a, 7);
+    int d = op3(I_SUB, a, constant(c));
+    return op3(I_ADD, op_imm(I_SAR, a, 7), op_imm(I_SAR, d, 7));
+}
+
+static int gen_binary(const Node *e) {
+    int op = e->op;
+    int k;
+    switch (op) {
+        case TK_EQ: case TK_NE: case '<': case '>': case TK_LE: case TK_GE: case TK_ANDAND: case TK_OROR:
+            return gen_bool(e);
+        case '|': case '/': case '%':
+            fail(e->line, "operator '%c' is not supported", op);
+            break;
+        case TK_SHL:
+        case TK_SHR: {
+            if (!const_value(e->b, &k)) fail(e->line, "shift counts must be constant");
+            int a = gen_expr(e->a);
+            if (k == 0 || a == 0) return a;
+            if (op == TK_SHL) return k < 8 ? op_imm(I_SAL, a, k) : 0;
+            return op_imm(I_SAR, a, k < 8 ? k : 7);
+        }
+        case '&': {
+            const Node *x = e->a, *m = e->b;
+            if (!const_value(m, &k)) {
+                x = e->b;
+                m = e->a;
+                if (!const_value(m, &k)) fail(e->line, "'&' needs a constant mask");
+            }
+            if (k == 255) return gen_expr(x);
+            if (k > 63) fail(e->line, "'&' masks must be 0-63 or 255");
+            int a = gen_expr(x);
+            return k && a ? op_imm(I_ANDI, a, k) : 0;
+        }
+        case '*': {
+            const Node *x = e->a, *m = e->b;
+            if (const_value(x, &k)) {
+                x = e->b;
+                m = e->a;
+            }
+            if (const_value(m, &k)) {
+                // strength reduction
+                if (k == 0) return 0;
+                int a = gen_expr(x);
+                if (k == 1) return a;
+                if ((k & (k - 1)) == 0) return op_imm(I_SAL, a, __builtin_ctz((unsigned)k));
+                return op3(I_MUL, a, constant(k));
+            }
+            return op3(I_MUL, gen_expr(e->a), gen_expr(e->b));
+        }
+        case '+':
+        case '^': {
+            int a = gen_expr(e->a), b = gen_expr(e->b);
+            if (a == 0) return b;
+            if (b == 0) return a;
+            return op3(op == '+' ? I_ADD : I_EOR, a, b);
+        }
+        case '-': {
+            int a = gen_expr(e->a), b = gen_expr(e->b);
+            return b ? op3(I_SUB, a, b) : a;
+        }
+    }
+    fail(e->line, "unsupported operator");
+    return 0;
+}
+
+static int gen_expr(const Node *e) {
+    switch (e->kind) {
+        case N_NUM:   return constant(e->value);
+        case N_VAR:   return syms[e->sym].vreg;
+        case N_INDEX: return gen_load(e);
+        case N_UNARY:
+            if (e->op == '!') return gen_bool(e);
+            if (e->op == '-') return op3(I_SUB, 0, gen_expr(e->a));
+            return op3(I_EOR, gen_expr(e->a), constant(0xFF));
+        case N_BINARY:
+            return gen_binary(e);
+    }
+    fail(e->line, "not an expression");
+    return 0;
+}
+
+// Jumps to label when e's truth equals when, else falls through.
+static void cond_jump(const Node *e, bool when, int label) {
+    int k;
+    if (const_value(e, &k)) {
+        if (!!k == when) jump(label);
+        return;
+    }
+    if (e->kind == N_UNARY && e->op == '!') {
+        cond_jump(e->a, !when, label);
+        return;
+    }
+    if (e->kind != N_BINARY) {
+        branch(when ? I_BNZ : I_BZ, gen_expr(e), label);
+        return;
+    }
+    int skip;
+    switch (e->op) {
+        case TK_ANDAND:
+            if (when) {
+                skip = new_label();
+                cond_jump(e->a, false, skip);
+                cond_jump(e->b, true, label);
+                place(skip);
+            } else {
+                cond_jump(e->a, false, label);
+                cond_jump(e->b, false, label);
+            }
+            return;
+        case TK_OROR:
+            if (when) {
+                cond_jump(e->a, true, label);
+                cond_jump(e->b, true, label);
+            } else {
+                skip = new_label();
+                cond_jump(e->a, true, skip);
+                cond_jump(e->b, false, label);
+                place(skip);
+            }
+            return;
+        case TK_EQ:
+        case TK_NE: {
+            int a = gen_expr(e->a), b = gen_expr(e->b);
+            int diff = a == 0 ? b : b == 0 ? a : op3(I_EOR, a, b);
+            bool jump_if_equal = (e->op == TK_EQ) == when;
+            branch(jump_if_equal ? I_BZ : I_BNZ, diff, label);
+            return;
+        }
+        case '<': case '>': case TK_LE: case TK_GE: {
+            // a > b is b < a, a <= b is !(b < a), a >= b is !(a < b), and
+            // c < y is !(y < c + 1)
+            bool swap = e->op == '>' || e->op == TK_LE;
+            bool negate = e->op == TK_LE || e->op == TK_GE;
+            const Node *x = swap ? e->b : e->a, *y = swap ? e->a : e->b;
+            int lt;
+            if (const_value(y, &k) && k <= 127) {
+                lt = gen_less_const(gen_expr(x), k);
+            } else if (const_value(x, &k) && k < 127) {
+                lt = gen_less_const(gen_expr(y), k + 1);
+                negate = !negate;
+            } else {
+                int a = gen_expr(x);
+                lt = gen_less(a, gen_expr(y));
+            }
+            branch(when != negate ? I_BNZ : I_BZ, lt, label);
+            return;
+        }
+    }
+    branch(when ? I_BNZ : I_BZ, gen_expr(e), label);
+}
+
+static void gen_stmt(const Node *s);
+
+static void gen_assign(const Node *s) {
+    int v = gen_expr(s->b);
+    if (s->a->kind == N_INDEX) {
+        gen_store(s->a, v);
+        return;
+    }
+    int x = syms[s->a->sym].vreg;
+    if (v != x) {
+        Ir *i = emit(I_COPY);
+        i->d = x;
+        i->a = v;
+    }
+}
+
+static void gen_loop_body(const Node *body, int brk, int cont) {
+    if (loop_nest == 64) fail(body->line, "loops nested too deeply");
+    break_label[loop_nest] = brk;
+    continue_label[loop_nest++] = cont;
+    gen_stmt(body);
+    loop_nest--;
+}
+
+static void add_loop(int head, int exit) {
+    loops = grow(loops, &cap_loops, nloops + 1, sizeof(Loop));
+    loops[nloops].head = head;
+    loops[nloops++].exit = exit;
+}
+
+static void gen_stmt(const Node *s) {
+    for (; s; s = s->next) {
+        int head, exit, step;
+        switch (s->kind) {
+            case N_BLOCK:
+                gen_stmt(s->a);
+                break;
+            case N_ASSIGN:
+                gen_assign(s);
+                break;
+            case N_IF: {
+                int other = new_label();
+                cond_jump(s->a, false, other);
+                gen_stmt(s->b);
+                if (s->c) {
+                    int end = new_label();
+                    jump(end);
+                    place(other);
+                    gen_stmt(s->c);
+                    place(end);
+                } else {
+                    place(other);
+                }
+                break;
+            }
+            case N_WHILE:
+                head = new_label();
+                exit = new_label();
+                place(head);
+                cond_jump(s->a, false, exit);
+                gen_loop_body(s->b, exit, head);
+                jump(head);
+                place(exit);
+                add_loop(head, exit);
+                break;
+            case N_DO:
+                head = new_label();
+                exit = new_label();
+                step = new_label();
+                place(head);
+                gen_loop_body(s->b, exit, step);
+                place(step);
+                cond_jump(s->a, false, exit);
+                jump(head);
+                place(exit);
+                add_loop(head, exit);
+                break;
+            case N_FOR:
+                if (s->a) gen_stmt(s->a);
+                head = new_label();
+                exit = new_label();
+                step = new_label();
+                place(head);
+                if (s->b) cond_jump(s->b, false, exit);
+                gen_loop_body(s->d, exit, step);
+                place(step);
+                if (s->c) gen_stmt(s->c);
+                jump(head);
+                place(exit);
+                add_loop(head, exit);
+                break;
+            case N_BREAK:
+            case N_CONTINUE:
+                if (!loop_nest) fail(s->line, "%s outside a loop", s->kind == N_BREAK ? "break" : "continue");
+                jump(s->kind == N_BREAK ? break_label[loop_nest - 1] : continue_label[loop_nest - 1]);
+                break;
+        }
+    }
+}
+
+// ---- passes over the intermediate code -------------------------------------
+
+static bool is_pure(int op) {
+    return (op >= I_ADD && op <= I_LA) || op == I_LDR;
+}
+
+static bool defines(const Ir *i) {
+    return (i->op >= I_ADD && i->op <= I_LDR) || i->op == I_GET;
+}
+
+// vregs read, up to two
+static int uses(const Ir *i, int *u) {
+    switch (i->op) {
+        case I_ADD: case I_SUB: case I_MUL: case I_EOR: case I_STUB: case I_BR:
+            u[0] = i->a;
+            u[1] = i->b;
+            return 2;
+        case I_ANDI: case I_SAL: case I_SAR: case I_COPY: case I_STR: case I_SET: case I_BZ: case I_BNZ:
+            u[0] = i->a;
+            return 1;
+    }
+    return 0;
+}
+
+// ops whose d starts as a copy of a
+static bool ir_reads_a(int op) {
+    return (op >= I_ADD && op <= I_SAR) || op == I_COPY;
+}
+
+static bool commutative(int op) {
+    return op == I_ADD || op == I_MUL || op == I_EOR;
+}
+
+static void compact(void) {
+    int n = 0;
+    for (int k = 0; k < nir; k++) {
+        if (ir[k].op == I_NOP) continue;
+        ir[n++] = ir[k];
+    }
+    nir = n;
+    for (int k = 0; k < nlabels; k++) label_pos[k] = -1;
+    for (int k = 0; k < nir; k++) {
+        if (ir[k].op == I_LABEL) label_pos[ir[k].label] = k;
+    }
+}
+
+static int *def_counts(void) {
+    int *n = calloc((size_t)nvregs, sizeof(int));
+    if (!n) fail(0, "out of memory");
+    for (int k = 0; k < nir; k++) {
+        if (defines(&ir[k])) n[ir[k].d]++;
+    }
+    return n;
+}
+
+// Computes each pure expression over a temporary once per basic block.
+static int local_cse(void) {
+    int *ndefs = def_counts();
+    int *rep = malloc((size_t)nvregs * sizeof(int));
+    int *avail = malloc((size_t)nir * sizeof(int));
+    if (!rep || !avail) fail(0, "out of memory");
+    for (int v = 0; v < nvregs; v++) rep[v] = v;
+    int navail = 0, removed = 0;
+    for (int k = 0; k < nir; k++) {
+        Ir *i = &ir[k];
+        i->a = rep[i->a];
+        i->b = rep[i->b];
+        if (i->op == I_LABEL || i->op == I_JMP || i->op == I_BZ || i->op == I_BNZ || i->op == I_BR) {
+            navail = 0;
+            continue;
+        }
+        if (commutative(i->op) && i->a > i->b) {
+            int t = i->a;
+            i->a = i->b;
+            i->b = t;
+        }
+        if (is_pure(i->op) && vregs[i->d].temp && ndefs[i->d] == 1) {
+            int found = -1;
+            for (int m = 0; m < navail && found < 0; m++) {
+                const Ir *x = &ir[avail[m]];
+                if (x->op == i->op && x->a == i->a && x->b == i->b && x->imm == i->imm &&
+                    x->imm2 == i->imm2 && x->label == i->label) found = x->d;
+            }
+            if (found >= 0) {
+                rep[i->d] = found;
+                i->op = I_NOP;
+                removed++;
+                continue;
+            }
+        }
+        // forget what this instruction invalidates
+        int d = defines(i) ? i->d : -1;
+        int n = 0;
+        for (int m = 0; m < navail; m++) {
+            const Ir *x = &ir[avail[m]];
+            bool stale = (d >= 0 && (x->a == d || x->b == d || x->d == d)) ||
+                         (x->op == I_LDR && ((i->op == I_STR && i->imm == x->imm) ||
+                                             (i->op == I_STUB && i->imm2)));
+            if (!stale) avail[n++] = avail[m];
+        }
+        navail = n;
+        if (is_pure(i->op) && vregs[i->d].temp && ndefs[i->d] == 1) avail[navail++] = k;
+    }
+    for (int k = 0; k < nir; k++) {
+        ir[k].a = rep[ir[k].a];
+        ir[k].b = rep[ir[k].b];
+    }
+    free(ndefs);
+    free(rep);
+    free(avail);
+    compact();
+    return removed;
+}
+
+// Moves invariant computations of temporaries out of every loop, innermost
+// first, to just before its head. A temporary is only read after its single
+// definition in the same iteration, so computing it early is safe; loads
+// move only if the loop stores nothing that could change them.
+static int licm(void) {
+    int hoisted = 0;
+    int *ndefs = def_counts();
+    int *indef = calloc((size_t)nvregs, sizeof(int));
+    Ir *moved = malloc((size_t)nir * sizeof(Ir));
+    bool *hoist = malloc((size_t)nir);
+    if (!indef || !moved || !hoist) fail(0, "out of memory");
+    for (int l = 0; l < nloops; l++) {
+        for (bool changed = true; changed; ) {
+            changed = false;
+            int h = label_pos[loops[l].head], e = label_pos[loops[l].exit];
+            memset(indef, 0, (size_t)nvregs * sizeof(int));
+            uint64_t stored = 0;
+            bool stub_stores = false;
+            for (int k = h; k < e; k++) {
+                if (defines(&ir[k])) indef[ir[k].d]++;
+                if (ir[k].op == I_STR) stored |= 1ULL << ir[k].imm;
+                if (ir[k].op == I_STUB && ir[k].imm2) stub_stores = true;
+            }
+            int nmoved = 0;
+            for (int k = h; k < e; k++) {
+                const Ir *i = &ir[k];
+                int u[2];
+                int nu = uses(i, u);
+                bool ok = is_pure(i->op) && vregs[i->d].temp && ndefs[i->d] == 1 &&
+                          (i->op != I_LDR || (!(stored >> i->imm & 1) && !stub_stores));
+                for (int m = 0; m < nu && ok; m++) ok = u[m] == 0 || indef[u[m]] == 0;
+                hoist[k] = ok;
+                if (ok) {
+                    indef[i->d]--;
+                    moved[nmoved++] = *i;
+                }
+            }
+            if (!nmoved) continue;
+            // [h, e) becomes the hoisted code, then the rest of the loop
+            Ir *rest = moved + nmoved;
+            int nrest = 0;
+            for (int k = h; k < e; k++) {
+                if (!hoist[k]) rest[nrest++] = ir[k];
+            }
+            memcpy(&ir[h], moved, (size_t)(nmoved + nrest) * sizeof(Ir));
+            hoisted += nmoved;
+            compact();
+            changed = true;
+        }
+    }
+    free(ndefs);
+    free(indef);
+    free(moved);
+    free(hoist);
+    return hoisted;
+}
+
+static void dead_code(void) {
+    int *nuses = malloc((size_t)nvregs * sizeof(int));
+    if (!nuses) fail(0, "out of memory");
+    for (bool changed = true; changed; ) {
+        changed = false;
+        memset(nuses, 0, (size_t)nvregs * sizeof(int));
+        for (int k = 0; k < nir; k++) {
+            int u[2];
+            int nu = uses(&ir[k], u);
+            for (int m = 0; m < nu; m++) nuses[u[m]]++;
+        }
+        for (int k = 0; k < nir; k++) {
+            Ir *i = &ir[k];
+            if ((is_pure(i->op) || i->op == I_GET) && !nuses[i->d]) {
+                i->op = I_NOP;
+                changed = true;
+            }
+            // jumps to the next instruction
+            if (i->op == I_JMP || i->op == I_BZ || i->op == I_BNZ) {
+                int n = k + 1;
+                while (n < nir && (ir[n].op == I_NOP || (ir[n].op == I_LABEL && ir[n].label != i->label))) n++;
+                if (n < nir && ir[n].op == I_LABEL && ir[n].label == i->label) {
+                    i->op = I_NOP;
+                    changed = true;
+                }
+            }
+        }
+        compact();
+    }
+    free(nuses);
+}
+
+// ---- register allocation --------------------------------------------------
+
+typedef struct {
+    int       words;      // per bit set
+    uint64_t *live_out;   // per instruction
+    uint64_t *live_in;
+} Liveness;
+
+static int successors(int k, int *s) {
+    const Ir *i = &ir[k];
+    switch (i->op) {
+        case I_JMP:
+        case I_BR:
+            s[0] = label_pos[i->label];
+            return 1;
+        case I_BZ:
+        case I_BNZ:
+            s[0] = k + 1;
+            s[1] = label_pos[i->label];
+            return 2;
+    }
+    s[0] = k + 1;
+    return 1;
+}
+
+static void liveness(Liveness *lv) {
+    int w = lv->words = (nvregs + 63) / 64;
+    free(lv->live_out);
+    free(lv->live_in);
+    lv->live_out = calloc((size_t)(nir + 1) * w, sizeof(uint64_t));
+    lv->live_in = calloc((size_t)(nir + 1) * w, sizeof(uint64_t));
+    if (!lv->live_out || !lv->live_in) fail(0, "out of memory");
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (int k = nir - 1; k >= 0; k--) {
+            uint64_t *out = &lv->live_out[(size_t)k * w];
+            uint64_t *in = &lv->live_in[(size_t)k * w];
+            int s[2];
+            int ns = successors(k, s);
+            for (int m = 0; m < ns; m++) {
+                const uint64_t *si = &lv->live_in[(size_t)s[m] * w];
+                for (int x = 0; x < w; x++) out[x] |= si[x];
+            }
+            uint64_t tmp[w];
+            memcpy(tmp, out, sizeof(tmp));
+            if (defines(&ir[k])) tmp[ir[k].d >> 6] &= ~(1ULL << (ir[k].d & 63));
+            int u[2];
+            int nu = uses(&ir[k], u);
+            for (int m = 0; m < nu; m++) {
+                if (u[m]) tmp[u[m] >> 6] |= 1ULL << (u[m] & 63);
+            }
+            if (memcmp(tmp, in, sizeof(tmp))) {
+                memcpy(in, tmp, sizeof(tmp));
+                changed = true;
+            }
+        }
+    }
+}
+
+static bool bit(const uint64_t *set, int v) {
+    return set[v >> 6] >> (v & 63) & 1;
+}
+
+static int next_slot = DATA_SIZE - 1;
+static int nspilled;
+
+// spilled vregs with their slot and interference at the time; two of them
+// share a slot when they never interfere
+typedef struct {
+    int       vreg;
+    int       slot;
+    int       nv;
+    uint64_t *row;
+} Spilled;
+
+static Spilled *spills;
+static int cap_spills;
+
+static void insert_at(int k, Ir x) {
+    emit(I_NOP);
+    memmove(&ir[k + 1], &ir[k], (size_t)(nir - 1 - k) * sizeof(Ir));
+    ir[k] = x;
+}
+
+static bool row_has(const Spilled *s, int v) {
+    return v < s->nv && bit(s->row, v);
+}
+
+// Rewrites every access to v through a memory slot; row is v's
+// interference over nv vregs.
+static void spill(int v, const uint64_t *row, int nv) {
+    // a constant is cheaper to recompute at each use than to reload
+    int def = -1, ndefs = 0;
+    for (int k = 0; k < nir; k++) {
+        if (defines(&ir[k]) && ir[k].d == v) {
+            def = k;
+            ndefs++;
+        }
+    }
+    if (ndefs == 1 && (ir[def].op == I_MOVSH || ir[def].op == I_LA)) {
+        Ir remat = ir[def];
+        ir[def].op = I_NOP;
+        for (int k = 0; k < nir; k++) {
+            int u[2];
+            int nu = uses(&ir[k], u);
+            if (!nu || (u[0] != v && (nu < 2 || u[1] != v))) continue;
+            remat.d = new_vreg(true);
+            vregs[remat.d].nospill = true;
+            if (ir[k].a == v) ir[k].a = remat.d;
+            if (nu == 2 && ir[k].b == v) ir[k].b = remat.d;
+            insert_at(k, remat);
+            k++;
+        }
+        compact();
+        return;
+    }
+    spills = grow(spills, &cap_spills, nspilled + 1, sizeof(Spilled));
+    Spilled *me = &spills[nspilled];
+    me->vreg = v;
+    me->nv = nv;
+    me->row = malloc((size_t)(nv + 63) / 64 * sizeof(uint64_t));
+    if (!me->row) fail(0, "out of memory");
+    memcpy(me->row, row, (size_t)(nv + 63) / 64 * sizeof(uint64_t));
+    int slot = -1;
+    for (int s = DATA_SIZE - 1; s > next_slot && slot < 0; s--) {
+        bool ok = true;
+        for (int k = 0; k < nspilled && ok; k++) {
+            if (spills[k].slot == s) ok = !row_has(&spills[k], v) && !row_has(me, spills[k].vreg);
+        }
+        if (ok) slot = s;
+    }
+    if (slot < 0) {
+        if (next_slot < data_end) fail(0, "too many values live at once: no data memory left to spill to");
+        slot = next_slot--;
+    }
+    me->slot = slot;
+    nspilled++;
+    for (int k = 0; k < nir; k++) {
+        Ir *i = &ir[k];
+        int u[2];
+        int nu = uses(i, u);
+        bool used = false;
+        for (int m = 0; m < nu; m++) used |= u[m] == v;
+        if (used) {
+            int t = new_vreg(true);
+            vregs[t].nospill = true;
+            Ir load = { .op = I_LDR, .d = t, .imm = slot };
+            if (ir[k].a == v) ir[k].a = t;
+            if (nu == 2 && ir[k].b == v) ir[k].b = t;
+            insert_at(k, load);
+            k++;
+            i = &ir[k];
+        }
+        if (defines(i) && i->d == v) {
+            int t = new_vreg(true);
+            vregs[t].nospill = true;
+            i->d = t;
+            Ir store = { .op = I_STR, .a = t, .imm = slot };
+            insert_at(k + 1, store);
+            k++;
+        }
+    }
+    compact();
+}
+
+static int loop_depth(int k) {
+    int depth = 0;
+    for (int l = 0; l < nloops; l++) {
+        if (k > label_pos[loops[l].head] && k < label_pos[loops[l].exit]) depth++;
+    }
+    return depth;
+}
+
+static int find(int *alias, int v) {
+    while (alias[v] != v) v = alias[v] = alias[alias[v]];
+    return v;
+}
+
+// Chaitin-Briggs coloring onto R1..R<nregs>. Returns false after spilling.
+static bool color(int nregs, int *phys) {
+    Liveness lv = { 0 };
+    liveness(&lv);
+    int w = lv.words;
+    int nv = nvregs;
+
+    // registers read before any write on some path start out as zero
+    const uint64_t *entry = &lv.live_in[0];
+    bool inserted = false;
+    for (int v = 1; v < nv; v++) {
+        if (bit(entry, v)) {
+            Ir zero = { .op = I_MOVSH, .d = v };
+            insert_at(0, zero);
+            inserted = true;
+        }
+    }
+    if (inserted) {
+        compact();
+        free(lv.live_out);
+        free(lv.live_in);
+        return color(nregs, phys);
+    }
+
+    uint64_t *adj = calloc((size_t)nv * w, sizeof(uint64_t));
+    int *degree = calloc((size_t)nv, sizeof(int));
+    double *cost = calloc((size_t)nv, sizeof(double));
+    bool *present = calloc((size_t)nv, sizeof(bool));
+    if (!adj || !degree || !cost || !present) fail(0, "out of memory");
+#define EDGE(x, y) do { \
+        if ((x) != (y) && (x) && (y) && !bit(&adj[(size_t)(x) * w], (y))) { \
+            adj[(size_t)(x) * w + ((y) >> 6)] |= 1ULL << ((y) & 63); \
+            adj[(size_t)(y) * w + ((x) >> 6)] |= 1ULL << ((x) & 63); \
+            degree[x]++; \
+            degree[y]++; \
+        } \
+    } while (0)
+
+    for (int k = 0; k < nir; k++) {
+        const Ir *i = &ir[k];
+        double weight = 1;
+        for (int d = loop_depth(k); d > 0 && weight < 1e6; d--) weight *= 8;
+        int u[2];
+        int nu = uses(i, u);
+        for (int m = 0; m < nu; m++) {
+            present[u[m]] = true;
+            cost[u[m]] += weight;
+        }
+        if (!defines(i)) continue;
+        int d = i->d;
+        present[d] = true;
+        cost[d] += weight;
+        const uint64_t *out = &lv.live_out[(size_t)k * w];
+        for (int x = 0; x < w; x++) {
+            for (uint64_t m = out[x]; m; m &= m - 1) {
+                int v = x * 64 + __builtin_ctzll(m);
+                if (i->op == I_COPY && v == i->a) continue;
+                EDGE(d, v);
+            }
+        }
+        // "SUB d a b" copies a into d first, so d must not be b
+        if (i->op == I_SUB) EDGE(d, i->b);
+    }
+#undef EDGE
+
+    // Conservative coalescing: the two sides of a copy, or of a two-address
+    // operation whose operand dies there, become one node when they do not
+    // interfere and the merged node keeps fewer than nregs neighbours of
+    // significant degree (Briggs), so it stays as colorable as before.
+    int *alias = malloc((size_t)nv * sizeof(int));
+    if (!alias) fail(0, "out of memory");
+    for (int v = 0; v < nv; v++) alias[v] = v;
+    for (int k = 0; k < 2 * nir; k++) {
+        const Ir *i = &ir[k % nir];
+        if ((i->op == I_COPY) != (k < nir) || !ir_reads_a(i->op)) continue;
+        for (int side = 0; side < (commutative(i->op) ? 2 : 1); side++) {
+            int x = find(alias, i->d), y = find(alias, side ? i->b : i->a);
+            if (x == y || !x || !y || vregs[x].nospill || vregs[y].nospill || bit(&adj[(size_t)x * w], y)) continue;
+            const uint64_t *ax = &adj[(size_t)x * w], *ay = &adj[(size_t)y * w];
+            int significant = 0;
+            for (int q = 0; q < w; q++) {
+                for (uint64_t m = ax[q] | ay[q]; m; m &= m - 1) {
+                    int n = q * 64 + __builtin_ctzll(m);
+                    int both = (ax[q] & ay[q]) >> (n & 63) & 1;
+                    significant += degree[n] - both >= nregs;
+                }
+            }
+            if (significant >= nregs) continue;
+            for (int q = 0; q < w; q++) {
+                for (uint64_t m = ay[q]; m; m &= m - 1) {
+                    int n = q * 64 + __builtin_ctzll(m);
+                    uint64_t *an = &adj[(size_t)n * w];
+                    an[y >> 6] &= ~(1ULL << (y & 63));
+                    if (bit(an, x)) {
+                        degree[n]--;
+                    } else {
+                        an[x >> 6] |= 1ULL << (x & 63);
+                        adj[(size_t)x * w + (n >> 6)] |= 1ULL << (n & 63);
+                        degree[x]++;
+                    }
+                }
+            }
+            memset(&adj[(size_t)y * w], 0, (size_t)w * sizeof(uint64_t));
+            degree[y] = 0;
+            present[y] = false;
+            cost[x] += cost[y];
+            alias[y] = x;
+            break;
+        }
+    }
+
+    // simplify, choosing a spill candidate when every node is significant
+    int *stack = malloc((size_t)nv * sizeof(int));
+    bool *removed = calloc((size_t)nv, sizeof(bool));
+    int *deg = malloc((size_t)nv * sizeof(int));
+    if (!stack || !removed || !deg) fail(0, "out of memory");
+    memcpy(deg, degree, (size_t)nv * sizeof(int));
+    int top = 0, left = 0;
+    for (int v = 1; v < nv; v++) left += present[v];
+    while (left) {
+        int pick = -1;
+        for (int v = 1; v < nv && pick < 0; v++) {
+            if (present[v] && !removed[v] && deg[v] < nregs) pick = v;
+        }
+        if (pick < 0) {
+            double best = 0;
+            for (int v = 1; v < nv; v++) {
+                if (!present[v] || removed[v]) continue;
+                double c = vregs[v].nospill ? 1e300 : cost[v] / deg[v];
+                if (pick < 0 || c < best) {
+                    pick = v;
+                    best = c;
+                }
+            }
+        }
+        removed[pick] = true;
+        stack[top++] = pick;
+        left--;
+        for (int x = 0; x < w; x++) {
+            for (uint64_t m = adj[(size_t)pick * w + x]; m; m &= m - 1) deg[x * 64 + __builtin_ctzll(m)]--;
+        }
+    }
+
+    // select, preferring the register of a copy or two-address partner
+    for (int v = 0; v < nv; v++) phys[v] = v ? -1 : 0;
+    int *victims = malloc((size_t)nv * sizeof(int));
+    int *partners = malloc((size_t)(3 * nir + 1) * sizeof(int));
+    if (!victims || !partners) fail(0, "out of memory");
+    int nvictims = 0;
+    while (top) {
+        int v = stack[--top];
+        bool taken[ALLOC_REGS + 1] = { false };
+        for (int x = 0; x < w; x++) {
+            for (uint64_t m = adj[(size_t)v * w + x]; m; m &= m - 1) {
+                int n = x * 64 + __builtin_ctzll(m);
+                if (phys[n] > 0) taken[phys[n]] = true;
+            }
+        }
+        // partners: the other side of a copy (first, as sharing a register
+        // removes it outright) or of a two-address operation
+        int npartners = 0;
+        for (int k = 0; k < 2 * nir; k++) {
+            const Ir *i = &ir[k % nir];
+            if ((i->op == I_COPY) != (k < nir) || !defines(i) || !ir_reads_a(i->op)) continue;
+            int d = find(alias, i->d), a = find(alias, i->a), b = find(alias, i->b);
+            if (d == v) {
+                partners[npartners++] = a;
+                if (commutative(i->op)) partners[npartners++] = b;
+            } else if (a == v || (commutative(i->op) && b == v)) {
+                partners[npartners++] = d;
+            }
+        }
+        int choice = -1;
+        for (int k = 0; k < npartners && choice < 0; k++) {
+            int n = partners[k];
+            if (n > 0 && phys[n] > 0 && !taken[phys[n]]) choice = phys[n];
+        }
+        // else a register the first uncolored partner could still take
+        for (int k = 0; k < npartners && choice < 0; k++) {
+            int n = partners[k];
+            if (n <= 0 || phys[n] >= 0) continue;
+            bool also[ALLOC_REGS + 1] = { false };
+            for (int x = 0; x < w; x++) {
+                for (uint64_t m = adj[(size_t)n * w + x]; m; m &= m - 1) {
+                    int o = x * 64 + __builtin_ctzll(m);
+                    if (phys[o] > 0) also[phys[o]] = true;
+                }
+            }
+            for (int r = 1; r <= nregs && choice < 0; r++) {
+                if (!taken[r] && !also[r]) choice = r;
+            }
+            break;
+        }
+        for (int r = 1; r <= nregs && choice < 0; r++) {
+            if (!taken[r]) choice = r;
+        }
+        if (choice < 0) {
+            // a reload or store temporary cannot shrink; spill its cheapest
+            // neighbour instead
+            int victim = vregs[v].nospill ? -1 : v;
+            for (int x = 0; x < w && victim < 0; x++) {
+                for (uint64_t m = adj[(size_t)v * w + x]; m; m &= m - 1) {
+                    int n = x * 64 + __builtin_ctzll(m);
+                    if (!vregs[n].nospill && (victim < 0 || cost[n] < cost[victim])) victim = n;
+                }
+            }
+            if (victim < 0) fail(0, "too few registers for one instruction");
+            bool listed = false;
+            for (int k = 0; k < nvictims; k++) listed |= victims[k] == victim;
+            if (!listed) victims[nvictims++] = victim;
+            continue;
+        }
+        phys[v] = choice;
+    }
+    // the rows go with the spills, so take them before adj is freed; the
+    // code is rewritten afterwards as that renumbers nothing below nv
+    for (int v = 1; v < nv; v++) phys[v] = phys[find(alias, v)];
+    for (int k = 0; k < nvictims; k++) {
+        for (int v = 1; v < nv; v++) {
+            if (find(alias, v) == victims[k]) spill(v, &adj[(size_t)victims[k] * w], nv);
+        }
+    }
+    free(adj);
+    free(degree);
+    free(cost);
+    free(present);
+    free(stack);
+    free(removed);
+    free(deg);
+    free(victims);
+    free(partners);
+    free(alias);
+    free(lv.live_out);
+    free(lv.live_in);
+    return nvictims == 0;
+}
+
+// ---- emission -------------------------------------------------------------
+
+typedef struct {
+    char  *text;
+    size_t len, cap;
+} Buf;
+
+static void out(Buf *b, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (b->len + (size_t)n + 1 > b->cap) {
+        b->cap = (b->len + (size_t)n + 1) * 2;
+        b->text = realloc(b->text, b->cap);
+        if (!b->text) fail(0, "out of memory");
+    }
+    va_start(ap, fmt);
+    vsnprintf(b->text + b->len, (size_t)n + 1, fmt, ap);
+    va_end(ap);
+    b->len += (size_t)n;
+}
+
+typedef struct {
+    int  *phys;
+    int  *addr;      // per instruction
+    bool *far;       // jumps that need a BR
+    int  *form;      // per instruction: how it builds a low address byte
+    int  *label_addr;
+    Buf  *buf;       // NULL while only measuring
+    int   words;
+} Emitter;
+
+static void word(Emitter *em, const char *fmt, ...) {
+    em->words++;
+    if (!em->buf) return;
+    va_list ap;
+    va_start(ap, fmt);
+    char line[48];
+    vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    out(em->buf, "%s\n", line);
+}
+
+// d = a, where a may be R0
+static void copy_reg(Emitter *em, int d, int a) {
+    if (d == a) return;
+    word(em, "MOVI R%d 0", d);
+    if (a) word(em, "ADD R%d R%d", d, a);
+}
+
+// Whether an address's low byte can be built in form f: 0 is one MOVI, 1
+// is MOVI and SAL, 2 (always possible) adds the low two bits through R62.
+static bool fits(int f, int addr) {
+    int lo = addr & 0xFF;
+    return f == 2 || lo <= 63 || (f == 1 && !(lo & 3));
+}
+
+static void low_byte(Emitter *em, int r, int form, int addr) {
+    int lo = addr & 0xFF;
+    if (form == 0) {
+        word(em, "MOVI R%d %d", r, lo);
+    } else if (form == 1 && lo <= 63) {
+        word(em, "MOVI R%d %d", r, lo);
+        word(em, "SAL R%d 0", r);
+    } else {
+        word(em, "MOVI R%d %d", r, lo >> 2);
+        word(em, "SAL R%d 2", r);
+        if (form == 2) {
+            word(em, "MOVI R%d %d", R_HI, lo & 3);
+            word(em, "ADD R%d R%d", r, R_HI);
+        }
+    }
+}
+
+// words of "R62:R63 = target; BR R62 R63"
+static int far_jump_size(int form) {
+    return (form == 2 ? 4 : form + 1) + 2;
+}
+
+// R62:R63 = addr
+static void load_address(Emitter *em, int form, int addr) {
+    low_byte(em, R_LO, form, addr);
+    word(em, "MOVI R%d %d", R_HI, addr >> 8);
+}
+
+static const char *alu_name[] = {
+    [I_ADD] = "ADD", [I_SUB] = "SUB", [I_MUL] = "MUL", [I_EOR] = "EOR",
+    [I_ANDI] = "ANDI", [I_SAL] = "SAL", [I_SAR] = "SAR",
+};
+
+static void emit_one(Emitter *em, int k) {
+    const Ir *i = &ir[k];
+    int D = em->phys[i->d], A = em->phys[i->a], B = em->phys[i->b];
+    int target = em->label_addr[i->label];
+    int here = em->words;
+    switch (i->op) {
+        case I_ADD: case I_MUL: case I_EOR:
+            if (D == B && D != A) {
+                word(em, "%s R%d R%d", alu_name[i->op], D, A);
+                break;
+            }
+            copy_reg(em, D, A);
+            word(em, "%s R%d R%d", alu_name[i->op], D, B);
+            break;
+        case I_SUB:
+            copy_reg(em, D, A);
+            word(em, "SUB R%d R%d", D, B);
+            break;
+        case I_ANDI: case I_SAL: case I_SAR:
+            copy_reg(em, D, A);
+            word(em, "%s R%d %d", alu_name[i->op], D, i->imm);
+            break;
+        case I_MOVSH:
+            word(em, "MOVI R%d %d", D, i->imm);
+            if (i->imm2) word(em, "SAL R%d %d", D, i->imm2);
+            break;
+        case I_COPY:
+            copy_reg(em, D, A);
+            break;
+        case I_LA:
+            if (!i->imm) {
+                word(em, "MOVI R%d %d", D, target >> 8);
+            } else {
+                low_byte(em, D, em->form[k], target);
+            }
+            break;
+        case I_LDR:
+            word(em, "LDR R%d %d", D, i->imm);
+            break;
+        case I_STR:
+            word(em, "STR R%d %d", A, i->imm);
+            break;
+        case I_GET:
+            copy_reg(em, D, R_VAL);
+            break;
+        case I_SET:
+            copy_reg(em, R_VAL, A);
+            break;
+        case I_STUB:
+            load_address(em, em->form[k], em->addr[k + 1]);
+            word(em, "BR R%d R%d", A, B);
+            break;
+        case I_LABEL:
+            if (em->buf) out(em->buf, "; L%d\n", i->label);
+            break;
+        case I_BR:
+            word(em, "BR R%d R%d", A, B);
+            break;
+        case I_JMP:
+            if (!em->far[k]) {
+                word(em, "BEQZ R0 %d", target - (here + 1));
+            } else {
+                load_address(em, em->form[k], target);
+                word(em, "BR R%d R%d", R_HI, R_LO);
+            }
+            break;
+        case I_BZ:
+            if (!em->far[k]) {
+                word(em, "BEQZ R%d %d", A, target - (here + 1));
+            } else {
+                word(em, "BEQZ R%d 1", A);
+                word(em, "BEQZ R0 %d", far_jump_size(em->form[k]));
+                load_address(em, em->form[k], target);
+                word(em, "BR R%d R%d", R_HI, R_LO);
+            }
+            break;
+        case I_BNZ:
+            if (!em->far[k]) {
+                word(em, "BEQZ R%d 1", A);
+                word(em, "BEQZ R0 %d", target - (here + 2));
+            } else {
+                word(em, "BEQZ R%d %d", A, far_jump_size(em->form[k]));
+                load_address(em, em->form[k], target);
+                word(em, "BR R%d R%d", R_HI, R_LO);
+            }
+            break;
+    }
+}
+
+// Lays the program out, growing forward jumps that do not reach with a
+// BEQZ into BR sequences and address loads into longer forms until nothing
+// changes (sizes only grow, so this ends), then writes it.
+static void emit_program(int *phys, Buf *buf) {
+    Emitter em = { .phys = phys };
+    em.addr = calloc((size_t)nir + 1, sizeof(int));
+    em.far = calloc((size_t)nir + 1, sizeof(bool));
+    em.form = calloc((size_t)nir + 1, sizeof(int));
+    em.label_addr = calloc((size_t)nlabels + 1, sizeof(int));
+    if (!em.addr || !em.far || !em.form || !em.label_addr) fail(0, "out of memory");
+
+    int code_end = 0, end = 0;
+    for (bool changed = true; changed; ) {
+        changed = false;
+        em.words = 0;
+        for (int k = 0; k < nir; k++) {
+            em.addr[k] = em.words;
+            if (ir[k].op == I_LABEL) em.label_addr[ir[k].label] = em.words;
+            emit_one(&em, k);
+        }
+        code_end = em.addr[nir] = em.words;
+
+        // stub tables after an empty word, each within one 256-word page so
+        // the low address byte of an element never carries
+        end = code_end + 1;
+        for (int s = 0; s < nsyms; s++) {
+            for (int store = 0; store < 2; store++) {
+                if (syms[s].table[store] < 0) continue;
+                int size = 2 * syms[s].size;
+                if ((end & 0xFF) + size > 0x100) end = (end | 0xFF) + 1;
+                em.label_addr[syms[s].table[store]] = end;
+                end += size;
+            }
+        }
+
+        for (int k = 0; k < nir; k++) {
+            const Ir *i = &ir[k];
+            int target = em.label_addr[i->label];
+            if ((i->op == I_JMP || i->op == I_BZ || i->op == I_BNZ) && !em.far[k]) {
+                int off = target - (em.addr[k] + (i->op == I_BNZ ? 2 : 1));
+                em.far[k] = off < 0 || off > 63;
+                changed |= em.far[k];
+                continue;
+            }
+            if (i->op == I_STUB) target = em.addr[k + 1];
+            bool builds = em.far[k] || i->op == I_STUB || (i->op == I_LA && i->imm);
+            if (builds && !fits(em.form[k], target)) {
+                em.form[k]++;
+                changed = true;
+            }
+        }
+    }
+    if (end > 1024) fail(0, "program needs %d words, instruction memory has 1024", end);
+
+    em.buf = buf;
+    em.words = 0;
+    for (int k = 0; k < nir; k++) emit_one(&em, k);
+    bool tables = false;
+    for (int s = 0; s < nsyms; s++) tables |= syms[s].table[0] >= 0 || syms[s].table[1] >= 0;
+    if (tables) {
+        out(buf, "; end of program: the empty word stops fetch\nADD R0 R0\n");
+        em.words++;
+    }
+    for (int s = 0; s < nsyms; s++) {
+        for (int store = 0; store < 2; store++) {
+            if (syms[s].table[store] < 0) continue;
+            int at = em.label_addr[syms[s].table[store]];
+            if (em.words < at) out(buf, "; padding to a 256-word page, never executed\n");
+            while (em.words < at) {
+                out(buf, "ADD R0 R0\n");
+                em.words++;
+            }
+            out(buf, "; %s stubs for %s[]: element i at %d + 2*i\n", store ? "store" : "load", syms[s].name, at);
+            for (int k = 0; k < syms[s].size; k++) {
+                out(buf, "%s R%d %d\nBR R%d R%d\n", store ? "STR" : "LDR", R_VAL, syms[s].base + k, R_HI, R_LO);
+                em.words += 2;
+            }
+        }
+    }
+    free(em.addr);
+    free(em.far);
+    free(em.form);
+    free(em.label_addr);
+}
+
+// ---- driver ---------------------------------------------------------------
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-O0] [-o out.txt] [-r] [-l latency] [-k registers] [-s] program.c\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+static char *read_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "cannot open %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    size_t cap = 4096, len = 0;
+    char *s = malloc(cap);
+    size_t n;
+    while (s && (n = fread(s + len, 1, cap - len - 1, f)) > 0) {
+        len += n;
+        if (len + 1 == cap) s = realloc(s, cap *= 2);
+    }
+    if (!s) fail(0, "out of memory");
+    s[len] = '\0';
+    fclose(f);
+    return s;
+}
+
+// runs the compiled program and prints every array
+static int run(const char *text, int latency) {
+    Processor *p = proc_create();
+    if (!p) {
+        fprintf(stderr, "%s\n", proc_strerror(DBH_ERR_NOMEM));
+        return EXIT_FAILURE;
+    }
+    p->quiet = true;
+    p->mem_latency = (uint16_t)latency;
+    if (mem_load_source(p, text) != DBH_OK) {
+        fprintf(stderr, "%s\n", p->error_msg);
+        return EXIT_FAILURE;
+    }
+    StopCond c = { 100000000, 0, -1, -1, 0, -1, false };
+    int r = proc_run(p, &c);
+    if (r != STOP_DONE) {
+        fprintf(stderr, "%s: %s\n", src_name, r == STOP_CYCLES ? "still running after 100000000 cycles" : p->error_msg);
+        return EXIT_FAILURE;
+    }
+    for (int s = 0; s < nsyms; s++) {
+        if (!syms[s].size) continue;
+        printf("%s =", syms[s].name);
+        for (int k = 0; k < syms[s].size; k++) printf(" %d", (int8_t)p->data_mem[syms[s].base + k]);
+        printf("\n");
+    }
+    printf("%llu cycles, %llu instructions, %llu stall cycles\n", (unsigned long long)p->perf.cycles,
+           (unsigned long long)p->perf.instret, (unsigned long long)p->perf.stall_cycles);
+    proc_destroy(p);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *output = NULL;
+    bool run_it = false, stats = false, optimize = true;
+    int latency = 0;
+    int nregs = ALLOC_REGS;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "-O0") == 0) {
+            optimize = false;
+        } else if (strcmp(argv[i], "-r") == 0) {
+            run_it = true;
+        } else if (strcmp(argv[i], "-s") == 0) {
+            stats = true;
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            latency = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            nregs = atoi(argv[++i]);
+        } else if (argv[i][0] == '-' || src_name) {
+            usage(argv[0]);
+        } else {
+            src_name = argv[i];
+        }
+    }
+    if (!src_name || latency < 0 || latency > 0xFFFF || nregs < 4 || nregs > ALLOC_REGS) {
+        usage(argv[0]);
+    }
+
+    lex(read_file(src_name));
+    Node *program = parse_block_body(TK_EOF);
+    new_vreg(false);   // R0
+    for (int s = 0; s < nsyms; s++) {
+        if (!syms[s].size) syms[s].vreg = new_vreg(false);
+    }
+    for (int k = 0; k < ninits; k++) {
+        int v = constant(inits[k].value);
+        Ir *i = emit(I_STR);
+        i->a = v;
+        i->imm = inits[k].addr;
+    }
+    gen_stmt(program);
+
+    int hoisted = 0;
+    if (optimize) {
+        local_cse();
+        hoisted = licm();
+        local_cse();
+    }
+    dead_code();
+    int vregs_used = nvregs;
+    int *phys = NULL;
+    int rounds = 0;
+    do {
+        free(phys);
+        phys = malloc((size_t)nvregs * sizeof(int));
+        if (!phys) fail(0, "out of memory");
+        if (++rounds > 200) fail(0, "register allocation does not converge");
+    } while (!color(nregs, phys));
+
+    Buf buf = { 0 };
+    out(&buf, "; compiled by dbhcc from %s\n", src_name);
+    for (int s = 0; s < nsyms; s++) {
+        if (syms[s].size) out(&buf, "; %s[%d] at data %d-%d\n", syms[s].name, syms[s].size, syms[s].base,
+                              syms[s].base + syms[s].size - 1);
+    }
+    emit_program(phys, &buf);
+    if (stats) {
+        fprintf(stderr, "%s: %d virtual registers, %d hoisted out of loops, %d spilled\n",
+                src_name, vregs_used, hoisted, nspilled);
+    }
+
+    if (output) {
+        FILE *f = fopen(output, "w");
+        if (!f || fputs(buf.text, f) < 0 || fclose(f)) {
+            fprintf(stderr, "cannot write %s\n", output);
+            return EXIT_FAILURE;
+        }
+    } else if (!run_it) {
+        fputs(buf.text, stdout);
+    }
+    return run_it ? run(buf.text, latency) : 0;
+}
@@ -0,0 +1,481 @@
+#include "processor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Static control-flow graph of instruction memory. BR targets come from
+// registers, so the graph is built together with a value analysis of the
+// register file: the program is entered at address 0 with every register
+// zero, as after loading, and each register holds a small set of possible
+// values at each address. A BR gets an edge for every target its registers
+// can form, which resolves subroutine returns and small jump tables; the
+// same sets prune BEQZ edges that can never be taken. LDR results, lanes
+// written by packed SIMD operations and registers with too many possible
+// values are unknown.
+//
+// Execution is sequential as far as the analysis is concerned: operands are
+// read in decode after the previous instruction has executed and an LDR in
+// flight holds decode, so the pipeline never exposes a stale value.
+
+#define VSET_MAX   32     // more possible values than this is "unknown"
+#define VSET_UNDEF 0      // no path has reached this point yet
+#define VSET_ANY   0xFF
+
+typedef struct {
+    uint8_t n;              // VSET_UNDEF, a count, or VSET_ANY
+    uint8_t v[VSET_MAX];    // sorted
+} ValSet;
+
+typedef ValSet RegVals[64];
+
+// ends a block: BEQZ, BR and RETI
+static bool is_branch(uint8_t opcode) {
+    return opcode == 4 || opcode == 7 || opcode == 12;
+}
+
+// an address execution can continue at; anything else ends the program
+static bool is_code(const Processor *p, uint32_t addr) {
+    return addr < 1024 && p->instr_mem[addr] != 0;
+}
+
+// R0 is defined at every address some path reaches
+static bool reached(RegVals *in, int addr) {
+    return in[addr][0].n != VSET_UNDEF;
+}
+
+static void vset_add(ValSet *s, uint8_t x) {
+    if (s->n == VSET_ANY) return;
+    int i = 0;
+    while (i < s->n && s->v[i] < x) i++;
+    if (i < s->n && s->v[i] == x) return;
+    if (s->n == VSET_MAX) {
+        s->n = VSET_ANY;
+        return;
+    }
+    memmove(s->v + i + 1, s->v + i, s->n - i);
+    s->v[i] = x;
+    s->n++;
+}
+
+// merges b into a, returns true if a grew
+static bool vset_join(ValSet *a, const ValSet *b) {
+    if (a->n == VSET_ANY || b->n == VSET_UNDEF) return false;
+    uint8_t n = a->n;
+    if (b->n == VSET_ANY) {
+        a->n = VSET_ANY;
+    } else {
+        for (int i = 0; i < b->n && a->n != VSET_ANY; i++) vset_add(a, b->v[i]);
+    }
+    return a->n != n;
+}
+
+static uint16_t alu(uint8_t opcode, uint8_t a, uint8_t b) {
+    switch (opcode) {
+        case 0: return (uint8_t)(a + b);
+        case 1: return (uint8_t)(a - b);
+        case 2: return (uint8_t)(a * b);
+        case 5: return a & b;
+        case 6: return a ^ b;
+        // the simulator shifts an int, so only small counts are well defined
+        case 8: return b < 8 ? (uint8_t)(a << b) : 0x100;
+        case 9: return b < 8 ? (uint8_t)((int8_t)a >> b) : 0x100;
+    }
+    return 0x100;
+}
+
+// the values execute() can write to rs
+static void evaluate(const Predecoded *d, const RegVals r, ValSet *out) {
+    out->n = 0;
+    if (d->opcode == 3) {
+        vset_add(out, (uint8_t)d->imm);
+        return;
+    }
+    bool rtype = d->opcode <= 2 || d->opcode == 6;
+    ValSet imm = { 1, { (uint8_t)d->imm } };
+    const ValSet *a = &r[d->rs], *b = rtype ? &r[d->rt] : &imm;
+    if (d->opcode == 10 || a->n == VSET_ANY || b->n == VSET_ANY) {
+        out->n = VSET_ANY;
+        return;
+    }
+    for (int i = 0; i < a->n; i++) {
+        // one register read twice holds the same value both times
+        for (int j = 0; j < b->n; j++) {
+            if (rtype && d->rs == d->rt && i != j) continue;
+            uint16_t x = alu(d->opcode, a->v[i], b->v[j]);
+            if (x > 0xFF) {
+                out->n = VSET_ANY;
+                return;
+            }
+            vset_add(out, (uint8_t)x);
+        }
+    }
+}
+
+// Where the instruction at pc can go next given the registers before it:
+// *fall is set if it can continue at pc + 1 and the possible jump targets
+// (which may be 1024 or more) are returned in targets. Returns the number of
+// targets, or -1 for a BR whose registers are unknown and for RETI, which
+// returns to wherever an interrupt was taken.
+static int successors(const Processor *p, uint16_t pc, const RegVals r, bool *fall, uint16_t *targets) {
+    const Predecoded *d = &p->decoded[pc];
+    *fall = d->opcode != 7 && d->opcode != 12;
+    if (d->opcode == 12) return -1;
+    if (d->opcode == 4) {
+        const ValSet *c = &r[d->rs];
+        bool zero = c->n == VSET_ANY || c->v[0] == 0;
+        *fall = c->n == VSET_ANY || c->v[c->n - 1] != 0;
+        targets[0] = (uint16_t)(pc + 1 + (uint8_t)d->imm);
+        return zero;
+    }
+    if (d->opcode == 7) {
+        const ValSet *hi = &r[d->rs], *lo = &r[d->rt];
+        if (hi->n == VSET_ANY || lo->n == VSET_ANY || hi->n * lo->n > VSET_MAX) return -1;
+        int n = 0;
+        for (int i = 0; i < hi->n; i++) {
+            for (int j = 0; j < lo->n; j++) {
+                if (d->rs == d->rt && i != j) continue;
+                targets[n++] = (uint16_t)(hi->v[i] << 8 | lo->v[j]);
+            }
+        }
+        return n;
+    }
+    return 0;
+}
+
+static void propagate(const Processor *p, RegVals *in, bool *queued, uint16_t *work, int *nwork,
+                      uint32_t addr, const RegVals out) {
+    if (!is_code(p, addr)) return;
+    bool changed = false;
+    for (int i = 0; i < 64; i++) {
+        changed |= vset_join(&in[addr][i], &out[i]);
+    }
+    if (changed && !queued[addr]) {
+        queued[addr] = true;
+        work[(*nwork)++] = (uint16_t)addr;
+    }
+}
+
+static void analyze(const Processor *p, RegVals *in) {
+    bool queued[1024] = {0};
+    uint16_t work[1024];
+    uint16_t targets[VSET_MAX];
+    int nwork = 0;
+    RegVals out;
+
+    memset(in, 0, 1024 * sizeof(RegVals));
+    for (int i = 0; i < 64; i++) {
+        out[i].n = 0;
+        vset_add(&out[i], 0);
+    }
+    propagate(p, in, queued, work, &nwork, 0, out);
+    while (nwork) {
+        uint16_t pc = work[--nwork];
+        queued[pc] = false;
+        const Predecoded *d = &p->decoded[pc];
+        memcpy(out, in[pc], sizeof(out));
+        if (op_writes_rs(d->opcode) && d->rs != 0) {
+            evaluate(d, in[pc], &out[d->rs]);
+        } else if (d->opcode >= 13 && p->simd) {
+            uint64_t lanes = simd_writes(p->instr_mem[pc]);
+            for (int r = 1; r < 64; r++) {
+                if (lanes >> r & 1) out[r].n = VSET_ANY;
+            }
+        }
+        bool fall;
+        int n = successors(p, pc, in[pc], &fall, targets);
+        if (fall) propagate(p, in, queued, work, &nwork, pc + 1u, out);
+        for (int i = 0; i < n; i++) propagate(p, in, queued, work, &nwork, targets[i], out);
+    }
+}
+
+static void add_succ(const Processor *p, Cfg *g, CfgBlock *b, uint32_t addr) {
+    if (!is_code(p, addr)) {
+        b->exits = true;
+        return;
+    }
+    uint16_t s = g->block_of[addr];
+    for (int k = 0; k < b->nsucc; k++) {
+        if (g->succs[b->succ + k] == s) return;
+    }
+    if (g->nedges == CFG_MAX_EDGES) {
+        b->unresolved = true;
+        return;
+    }
+    g->succs[g->nedges++] = s;
+    b->nsucc++;
+}
+
+static void build_blocks(const Processor *p, Cfg *g, RegVals *in) {
+    bool leader[1024] = {0};
+    uint16_t targets[VSET_MAX];
+    bool fall;
+    for (int a = 0; a < 1024; a++) {
+        if (!is_code(p, a)) continue;
+        bool live = reached(in, a);
+        if (a == 0 || !is_code(p, a - 1) || is_branch(p->decoded[a - 1].opcode) ||
+            live != reached(in, a - 1)) {
+            leader[a] = true;
+        }
+        int n = live ? successors(p, (uint16_t)a, in[a], &fall, targets) : 0;
+        for (int i = 0; i < n; i++) {
+            if (targets[i] < 1024) leader[targets[i]] = true;
+        }
+    }
+
+    g->nblocks = 0;
+    for (int a = 0; a < 1024; a++) {
+        if (!is_code(p, a)) {
+            g->block_of[a] = CFG_NONE;
+            continue;
+        }
+        if (leader[a]) {
+            CfgBlock b = { (uint16_t)a, (uint16_t)a, 0, 0, 0, reached(in, a), false, false };
+            g->blocks[g->nblocks++] = b;
+        }
+        g->blocks[g->nblocks - 1].end = (uint16_t)a;
+        g->block_of[a] = (uint16_t)(g->nblocks - 1);
+    }
+
+    // not executed from the entry: keep the edges the code spells out
+    RegVals any;
+    for (int r = 0; r < 64; r++) any[r].n = VSET_ANY;
+
+    g->nedges = 0;
+    g->nunresolved = 0;
+    g->handler = false;
+    for (int i = 0; i < g->nblocks; i++) {
+        CfgBlock *b = &g->blocks[i];
+        uint16_t last = b->end;
+        int n = successors(p, last, b->reachable ? in[last] : any, &fall, targets);
+        b->succ = (uint16_t)g->nedges;
+        if (fall) add_succ(p, g, b, last + 1u);
+        for (int k = 0; k < n; k++) add_succ(p, g, b, targets[k]);
+        if (n < 0 && b->reachable) b->unresolved = true;
+        g->nunresolved += b->unresolved;
+        g->handler |= p->decoded[last].opcode == 12;
+    }
+}
+
+// numbers the blocks reachable from the entry in reverse postorder
+static int reverse_postorder(const Cfg *g, uint16_t *order, uint16_t *rpo) {
+    uint16_t stack[1024];
+    uint16_t next[1024] = {0};
+    bool seen[1024] = {0};
+    int n = g->nblocks, sp = 0, done = 0;
+    uint16_t post[1024];
+
+    stack[sp++] = 0;
+    seen[0] = true;
+    while (sp) {
+        uint16_t b = stack[sp - 1];
+        if (next[b] < g->blocks[b].nsucc) {
+            uint16_t s = g->succs[g->blocks[b].succ + next[b]++];
+            if (!seen[s]) {
+                seen[s] = true;
+                stack[sp++] = s;
+            }
+        } else {
+            post[done++] = b;
+            sp--;
+        }
+    }
+    for (int i = 0; i < n; i++) rpo[i] = CFG_NONE;
+    for (int i = 0; i < done; i++) {
+        order[i] = post[done - 1 - i];
+        rpo[order[i]] = (uint16_t)i;
+    }
+    return done;
+}
+
+static uint16_t intersect(const uint16_t *idom, const uint16_t *rpo, uint16_t a, uint16_t b) {
+    while (a != b) {
+        while (rpo[a] > rpo[b]) a = idom[a];
+        while (rpo[b] > rpo[a]) b = idom[b];
+    }
+    return a;
+}
+
+static bool dominates(const uint16_t *idom, uint16_t a, uint16_t b) {
+    for (;;) {
+        if (b == a) return true;
+        if (idom[b] == b) return false;
+        b = idom[b];
+    }
+}
+
+// Dominators come from Cooper, Harvey and Kennedy's iterative algorithm; an
+// edge to a dominator is a back edge and closes a natural loop.
+static void find_loops(Cfg *g) {
+    uint16_t order[1024], rpo[1024], idom[1024];
+    uint16_t pred_start[1025] = {0}, preds[CFG_MAX_EDGES];
+    int n = g->nblocks;
+
+    g->nloops = 0;
+    g->irreducible = false;
+    g->terminates = true;   // empty memory at address 0 ends the program at once
+    if (!n || !g->blocks[0].reachable) return;
+
+    for (int e = 0; e < g->nedges; e++) {
+        pred_start[g->succs[e] + 1]++;
+    }
+    for (int i = 0; i < n; i++) pred_start[i + 1] += pred_start[i];
+    uint16_t fill[1024];
+    memcpy(fill, pred_start, n * sizeof(fill[0]));
+    for (int i = 0; i < n; i++) {
+        for (int k = 0; k < g->blocks[i].nsucc; k++) preds[fill[g->succs[g->blocks[i].succ + k]]++] = (uint16_t)i;
+    }
+
+    int reached = reverse_postorder(g, order, rpo);
+    for (int i = 0; i < n; i++) idom[i] = CFG_NONE;
+    idom[0] = 0;
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (int i = 1; i < reached; i++) {
+            uint16_t b = order[i], d = CFG_NONE;
+            for (int k = pred_start[b]; k < pred_start[b + 1]; k++) {
+                uint16_t q = preds[k];
+                if (idom[q] == CFG_NONE) continue;
+                d = d == CFG_NONE ? q : intersect(idom, rpo, q, d);
+            }
+            if (d != idom[b]) {
+                idom[b] = d;
+                changed = true;
+            }
+        }
+    }
+
+    // one loop per header, the union of the natural loops of its back edges
+    uint16_t mark[1024], work[1024];
+    for (int i = 0; i < n; i++) mark[i] = CFG_NONE;
+    for (int i = 0; i < reached; i++) {
+        uint16_t h = order[i];
+        CfgLoop loop = { h, CFG_NONE, 0, 0 };
+        int nwork = 0;
+        for (int k = pred_start[h]; k < pred_start[h + 1]; k++) {
+            uint16_t u = preds[k];
+            if (rpo[u] == CFG_NONE || rpo[u] < rpo[h]) continue;
+            if (!dominates(idom, h, u)) {
+                g->irreducible = true;   // a cycle entered other than through h
+                continue;
+            }
+            if (loop.latch == CFG_NONE || g->blocks[u].end > g->blocks[loop.latch].end) loop.latch = u;
+            if (mark[u] != h) {
+                mark[u] = h;
+                work[nwork++] = u;
+            }
+        }
+        if (loop.latch == CFG_NONE || g->nloops == CFG_MAX_LOOPS) continue;
+        mark[h] = h;
+        while (nwork) {
+            uint16_t b = work[--nwork];
+            if (b == h) continue;
+            for (int k = pred_start[b]; k < pred_start[b + 1]; k++) {
+                uint16_t q = preds[k];
+                if (rpo[q] != CFG_NONE && mark[q] != h) {
+                    mark[q] = h;
+                    work[nwork++] = q;
+                }
+            }
+        }
+        for (int b = 0; b < n; b++) {
+            if (mark[b] != h) continue;
+            loop.nblocks++;
+            loop.ninstr += g->blocks[b].end - g->blocks[b].start + 1;
+            g->blocks[b].loop_depth++;
+        }
+        g->loops[g->nloops++] = loop;
+    }
+
+    // the program can finish if an exit is reachable from the entry
+    bool can_exit[1024] = {0};
+    int nwork = 0;
+    for (int i = 0; i < n; i++) {
+        if (g->blocks[i].reachable && g->blocks[i].exits) {
+            can_exit[i] = true;
+            work[nwork++] = (uint16_t)i;
+        }
+    }
+    while (nwork) {
+        uint16_t b = work[--nwork];
+        for (int k = pred_start[b]; k < pred_start[b + 1]; k++) {
+            if (!can_exit[preds[k]]) {
+                can_exit[preds[k]] = true;
+                work[nwork++] = preds[k];
+            }
+        }
+    }
+    g->terminates = can_exit[0];
+}
+
+// Builds the control-flow graph of the program in p's instruction memory.
+// Only instr_mem and the predecoded copy are read, so this can run before a
+// program is started or on a stopped machine.
+int cfg_build(const Processor *p, Cfg *g) {
+    RegVals *in = malloc(1024 * sizeof(RegVals));
+    if (!in) return DBH_ERR_NOMEM;
+    analyze(p, in);
+    build_blocks(p, g, in);
+    free(in);
+    find_loops(g);
+    return DBH_OK;
+}
+
+// With an unresolved BR, blocks only it leads to look unreachable and loops
+// through it are missing, so those claims are qualified like terminates.
+// Interrupt handlers are entered through the vector, not along an edge, so
+// with a RETI in the program the same claims only cover code from the entry.
+void print_cfg(const Processor *p, const Cfg *g) {
+    const char *partial = g->nunresolved ? " through resolved edges" : g->handler ? " from the entry" : "";
+    const char *dead = g->nunresolved ? "Not reached through resolved edges" : g->handler ? "Not reached from the entry"
+                                                                                          : "Unreachable";
+    int reachable = 0;
+    for (int i = 0; i < g->nblocks; i++) reachable += g->blocks[i].reachable;
+    proc_printf(p, "Basic blocks (%d, %d reachable%s):\n", g->nblocks, reachable, partial);
+    proc_printf(p, "%-6s %-13s %6s %5s  %s\n", "Block", "Addresses", "Instrs", "Depth", "Successors");
+    for (int i = 0; i < g->nblocks; i++) {
+        const CfgBlock *b = &g->blocks[i];
+        char range[16];
+        snprintf(range, sizeof(range), "0x%04X-0x%04X", b->start, b->end);
+        proc_printf(p, "B%-5d %-13s %6d %5d  ", i, range, b->end - b->start + 1, b->loop_depth);
+        for (int k = 0; k < b->nsucc; k++) proc_printf(p, "B%d ", g->succs[b->succ + k]);
+        if (b->exits) proc_printf(p, "exit ");
+        if (b->unresolved) proc_printf(p, "?");
+        proc_printf(p, "%s\n", b->reachable ? "" : g->nunresolved ? "(not reached through resolved edges)"
+                                                 : g->handler ? "(not reached from the entry)" : "(unreachable)");
+    }
+
+    if (g->nloops) {
+        proc_printf(p, "Loops%s:\n", partial);
+        proc_printf(p, "%-8s %-8s %6s %6s\n", "Header", "Branch", "Blocks", "Instrs");
+        for (int i = 0; i < g->nloops; i++) {
+            const CfgLoop *l = &g->loops[i];
+            proc_printf(p, "0x%04X   0x%04X   %6d %6d\n", g->blocks[l->header].start,
+                        g->blocks[l->latch].end, l->nblocks, l->ninstr);
+        }
+    } else {
+        proc_printf(p, "No loops%s.\n", partial);
+    }
+    if (g->irreducible) {
+        proc_printf(p, "Irreducible control flow: a cycle can be entered at more than one block.\n");
+    }
+
+    char text[32];
+    for (int i = 0; i < g->nblocks; i++) {
+        const CfgBlock *b = &g->blocks[i];
+        if (!b->reachable) {
+            int len = b->end - b->start + 1;
+            proc_printf(p, "%s: 0x%04X-0x%04X (%d instruction%s)\n", dead, b->start, b->end,
+                        len, len == 1 ? "" : "s");
+        }
+        if (p->decoded[b->end].opcode == 12) {
+            proc_printf(p, "Handler: 0x%04X RETI, its code is entered through the interrupt vector\n", b->end);
+        }
+        if (b->unresolved) {
+            disassemble(p->instr_mem[b->end], text, sizeof(text));
+            proc_printf(p, "Unresolved: 0x%04X %s, target registers unknown\n", b->end, text);
+        }
+    }
+    if (!g->terminates && !g->nunresolved) {
+        proc_printf(p, "Never finishes: no path from the entry reaches the end of the program.\n");
+    }
+}
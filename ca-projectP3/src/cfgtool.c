@@ -0,0 +1,62 @@
+#include "processor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// dbhcfg: static control-flow analysis of a program without running it.
+// Exits with 2 when the program can never finish or has a reachable BR whose
+// targets the analysis cannot work out, so a job runner can turn it away (or
+// at least give it a cycle budget) before spending simulation time on it.
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-q] [-v] program.txt\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    const char *program = NULL;
+    bool brief = false;
+    bool simd = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-q") == 0) {
+            brief = true;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            simd = true;
+        } else if (argv[i][0] == '-' || program) {
+            usage(argv[0]);
+        } else {
+            program = argv[i];
+        }
+    }
+    if (!program) {
+        usage(argv[0]);
+    }
+
+    static Cfg cfg;
+    Processor *p = proc_create();
+    if (!p) {
+        fprintf(stderr, "%s\n", proc_strerror(DBH_ERR_NOMEM));
+        return EXIT_FAILURE;
+    }
+    p->quiet = true;
+    p->simd = simd;
+    if (mem_load_program(p, program) != DBH_OK) {
+        fprintf(stderr, "%s\n", p->error_msg);
+        return EXIT_FAILURE;
+    }
+    if (cfg_build(p, &cfg) != DBH_OK) {
+        fprintf(stderr, "%s\n", proc_strerror(DBH_ERR_NOMEM));
+        return EXIT_FAILURE;
+    }
+    bool broken = cfg.nunresolved || !cfg.terminates;
+    if (brief) {
+        printf("%s: %d blocks, %d loops%s%s%s\n", program, cfg.nblocks, cfg.nloops,
+               cfg.nunresolved ? ", unresolved BR" : "", cfg.handler ? ", interrupt handler" : "",
+               !cfg.terminates && !cfg.nunresolved ? ", never finishes" : "");
+    } else {
+        print_cfg(p, &cfg);
+    }
+    proc_destroy(p);
+    return broken ? 2 : 0;
+}
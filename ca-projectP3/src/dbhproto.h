@@ -0,0 +1,56 @@
+#ifndef DBHPROTO_H
+#define DBHPROTO_H
+
+#include <stdint.h>
+
+// Wire format of the dbhserver job protocol. Every field is in host byte
+// order (little-endian on all supported hosts) and the structs have no
+// padding, so both sides can read and write them directly.
+//
+// request:  JobRequest, ninstr instruction words, ndata bytes loaded at
+//           data[0], then 64 register values if JOB_REGS is set
+// response: JobResult, 64 register values, then the 2048 bytes of data
+//           memory if JOB_WANT_DATA was set
+//
+// Results are streamed back as jobs finish, not necessarily in request
+// order; job_id ties them together.
+
+#define JOB_REQUEST_MAGIC 0x4A484244u   // "DBHJ"
+#define JOB_RESULT_MAGIC  0x52484244u   // "DBHR"
+
+enum {
+    JOB_REGS      = 0x01,   // initial register values follow the data
+    JOB_MMIO      = 0x02,   // map the performance counters (sim -m)
+    JOB_WANT_DATA = 0x04,   // send the final data memory back
+    JOB_SIMD      = 0x08    // enable the packed-SIMD extension (sim -v)
+};
+
+typedef struct {
+    uint32_t magic;
+    uint32_t job_id;
+    uint16_t ninstr;            // at most 1024
+    uint16_t ndata;             // at most 2048
+    uint16_t mem_latency;
+    uint8_t  flags;             // JOB_* bits
+    uint8_t  reserved;
+    uint64_t max_cycles;        // 0 = run to completion
+    uint64_t max_instructions;
+} JobRequest;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t job_id;
+    int32_t  status;            // DBH_OK or a DBH_ERR_* code
+    int32_t  stop;              // STOP_* reason from proc_run()
+    uint64_t cycles;
+    uint64_t instructions;
+    uint16_t pc;
+    uint8_t  sreg;
+    uint8_t  flags;             // JOB_WANT_DATA if data memory follows
+    uint32_t reserved;
+} JobResult;
+
+_Static_assert(sizeof(JobRequest) == 32, "JobRequest must not be padded");
+_Static_assert(sizeof(JobResult) == 40, "JobResult must not be padded");
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef DBHSIM_H
+#define DBHSIM_H
+
+// libdbhsim: the Double Big Harvard simulator core as an embeddable library.
+//
+// All simulator state lives in the Processor, so any number of instances can
+// run side by side (one thread per instance). Nothing in the library exits or
+// writes to stdout on its own: fallible calls return a DBH_ERR_* code and leave
+// a message in proc_error_msg(), and all text goes through the Processor's
+// output sink.
+//
+//     Processor *p = proc_create();
+//     proc_set_output(p, my_sink, my_ctx);   // or NULL to discard output
+//     proc_set_quiet(p, true);
+//     if (mem_load_source(p, "MOVI R1 5\nADD R1 R1\n") != DBH_OK)
+//         handle(proc_error_msg(p));
+//     while (proc_running(p)) {
+//         proc_skip_idle(p);
+//         process_cycle(p);
+//     }
+//     // proc_error(p) is non-zero if the run stopped on an error
+//     proc_reset(p);                         // before loading and running another program
+//     proc_destroy(p);
+//
+// This header is the whole public interface: the Processor is opaque and
+// libdbhsim.so exports nothing else. processor.h is internal to the tools
+// built in this tree.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define DBHSIM_VERSION_MAJOR 2
+#define DBHSIM_VERSION_MINOR 0
+
+#if defined(__GNUC__)
+#define DBHSIM_API __attribute__((visibility("default")))
+#else
+#define DBHSIM_API
+#endif
+
+typedef struct Processor Processor;
+
+// status codes returned by fallible calls; 0 is success
+enum {
+    DBH_OK          =  0,
+    DBH_ERR_OPEN    = -1,  // program file could not be opened
+    DBH_ERR_SYNTAX  = -2,  // line is neither "OP Rn Rm" nor "OP Rn imm"
+    DBH_ERR_OPCODE  = -3,  // unknown mnemonic
+    DBH_ERR_NOMEM   = -4,
+    DBH_ERR_EVENTS  = -5,  // timing event queue overflow
+    DBH_ERR_RANGE   = -6   // argument out of range or table full
+};
+
+// Receives all text a Processor prints (traces, dumps, reports). ctx is the
+// pointer given to proc_set_output(); a NULL sink discards output.
+typedef void (*OutputSink)(void *ctx, const char *text);
+
+// performance counters for proc_read_counter(); the addresses are where
+// proc_set_counter_mmio() maps them for LDR
+enum {
+    CTR_CYCLES,          // 0x30-0x33
+    CTR_INSTRET,         // 0x34-0x37
+    CTR_TAKEN_BRANCHES,  // 0x38-0x39
+    CTR_FLUSHES,         // 0x3A-0x3B
+    CTR_LOADS,           // 0x3C-0x3D
+    CTR_STORES,          // 0x3E-0x3F
+    CTR_STALLS,          // not memory-mapped
+    CTR_COUNT
+};
+
+// Conditions for proc_run(). Budgets count from the start of the call and 0
+// means unlimited; pc, reg and write_addr are disabled when negative.
+typedef struct {
+    uint64_t max_cycles;
+    uint64_t max_instructions;
+    int      pc;          // stop before the instruction at pc executes
+    int      reg;         // stop when a write leaves Register[reg] == reg_value
+    uint8_t  reg_value;
+    int      write_addr;  // stop after a store to data[write_addr]
+    bool     reg_written; // stop after any write to reg, ignoring reg_value
+} StopCond;
+
+// why proc_run() returned
+enum {
+    STOP_DONE,          // program finished
+    STOP_ERROR,         // proc_error() is set
+    STOP_CYCLES,
+    STOP_INSTRUCTIONS,
+    STOP_PC,
+    STOP_REG,
+    STOP_WRITE,
+    STOP_BREAK,         // reached a breakpoint, same position as STOP_PC
+    STOP_WATCH          // a data watchpoint fired, see proc_watch_hit()
+};
+
+// data watchpoint kinds for mem_watch_add()
+enum {
+    WATCH_READ   = 0x01,
+    WATCH_WRITE  = 0x02,
+    WATCH_CHANGE = 0x04   // a write that changes the value
+};
+
+typedef struct {
+    uint64_t cycle;
+    uint16_t pc;      // the LDR/STR in EX
+    uint16_t addr;
+    uint8_t  kind;    // WATCH_* bit that fired
+    uint8_t  old_value;
+    uint8_t  new_value;
+} WatchHit;
+
+// A checkpoint after a program's input-independent prefix, see prefix_run().
+enum {
+    PREFIX_INPUT_DATA = 0x01,   // initial data memory varies between runs
+    PREFIX_INPUT_REGS = 0x02    // initial registers vary between runs
+};
+
+typedef struct {
+    uint64_t instructions;        // executed by the prefix
+    uint64_t cycles;
+    uint64_t regs_written;        // bit n set if the prefix wrote Rn
+    uint8_t  data_written[256];   // bitmap of data bytes the prefix stored
+    uint8_t  inputs;              // PREFIX_INPUT_* bits it was built for
+} Prefix;
+
+DBHSIM_API Processor *proc_create(void);
+DBHSIM_API void proc_destroy(Processor *p);
+DBHSIM_API void proc_copy(Processor *dst, const Processor *src);
+DBHSIM_API void proc_reset(Processor *p);
+DBHSIM_API void proc_set_output(Processor *p, OutputSink sink, void *ctx);
+DBHSIM_API void proc_set_quiet(Processor *p, bool quiet);
+DBHSIM_API void proc_set_mem_latency(Processor *p, uint16_t cycles);
+DBHSIM_API void proc_set_counter_mmio(Processor *p, bool on);
+DBHSIM_API void proc_set_interrupts(Processor *p, bool on);
+DBHSIM_API void proc_set_simd(Processor *p, bool on);
+DBHSIM_API const char *proc_strerror(int status);
+DBHSIM_API int proc_error(const Processor *p);
+DBHSIM_API const char *proc_error_msg(const Processor *p);
+
+DBHSIM_API int mem_load_program(Processor *p, const char *filename);
+DBHSIM_API int mem_load_source(Processor *p, const char *source);
+DBHSIM_API int proc_write_instr(Processor *p, uint16_t addr, uint16_t word);
+
+DBHSIM_API void process_cycle(Processor *p);
+DBHSIM_API uint64_t proc_skip_idle(Processor *p);
+DBHSIM_API bool proc_running(const Processor *p);
+DBHSIM_API int proc_run(Processor *p, const StopCond *cond);
+DBHSIM_API void proc_set_breakpoint(Processor *p, uint16_t addr);
+DBHSIM_API void proc_clear_breakpoint(Processor *p, uint16_t addr);
+DBHSIM_API bool proc_has_breakpoint(const Processor *p, uint16_t addr);
+DBHSIM_API int mem_watch_add(Processor *p, uint16_t addr, uint16_t len, uint8_t kind);
+DBHSIM_API void mem_watch_remove(Processor *p, int id);
+DBHSIM_API const WatchHit *proc_watch_hit(const Processor *p);
+
+DBHSIM_API uint8_t proc_get_register(const Processor *p, int reg);
+DBHSIM_API uint8_t proc_get_sreg(const Processor *p);
+DBHSIM_API uint16_t proc_get_pc(const Processor *p);
+DBHSIM_API uint8_t proc_get_data(const Processor *p, uint16_t addr);
+DBHSIM_API int proc_set_register(Processor *p, int reg, uint8_t value);
+DBHSIM_API int proc_set_data(Processor *p, uint16_t addr, uint8_t value);
+DBHSIM_API uint64_t proc_read_counter(const Processor *p, int counter);
+DBHSIM_API void proc_reset_counters(Processor *p);
+
+// raise an interrupt line now or at a later cycle; needs proc_set_interrupts()
+DBHSIM_API int irq_raise(Processor *p, uint8_t line);
+DBHSIM_API int irq_schedule(Processor *p, uint8_t line, uint64_t cycle);
+
+DBHSIM_API int tt_enable(Processor *p);
+DBHSIM_API void tt_free(Processor *p);
+DBHSIM_API void tt_checkpoint(Processor *p);
+DBHSIM_API int tt_goto_cycle(Processor *p, uint64_t cycle);
+DBHSIM_API int tt_step_back(Processor *p);
+DBHSIM_API int tt_reverse(Processor *p, const StopCond *cond);
+
+DBHSIM_API int prefix_run(Processor *p, uint8_t inputs, uint64_t limit, Prefix *out);
+DBHSIM_API int prefix_set_input(Processor *p, const Prefix *pre, const uint8_t *data, size_t len, const uint8_t *regs);
+
+#endif
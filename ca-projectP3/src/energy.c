@@ -0,0 +1,318 @@
+#include "processor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Event-based energy model. Every instruction that reaches EX costs its
+// opcode class, its register file reads and writes and, for LDR/STR, a data
+// memory access; a taken branch adds the cost of the flush. The pipeline
+// registers are compared once per cycle and every bit that changed costs a
+// latch toggle. Clock tree and leakage cost a fixed amount each cycle,
+// including cycles skipped while the pipeline is idle.
+//
+// A packed SIMD operation costs one operation of its class plus a register
+// read or write per lane.
+//
+// Dynamic energy is also charged to an instruction address (latch toggles to
+// the instruction that entered the latch), so it can be summed per basic
+// block. Costs are in picojoules; the defaults are illustrative values for a
+// small in-order core, not measurements.
+
+#define ENERGY_BLOCKS 20   // blocks listed in the report
+
+struct Energy {
+    EnergyCosts costs;
+    double   op_energy[16];   // per execution: class, operand reads, memory access
+    double   pc_energy[1024];
+    uint64_t exec[1024];
+    uint64_t ops[16];
+    uint64_t reg_writes;
+    uint64_t lane_reads;      // register reads of packed SIMD operations
+    uint64_t toggles;
+    uint64_t flushes;
+    uint64_t cycles;
+    uint64_t if_id;           // latch contents seen at the end of the last cycle
+    uint64_t id_ex;
+};
+
+static const char *const cost_names[] = {
+    "alu", "mul", "branch", "mem_op", "reg_read", "reg_write",
+    "mem_access", "latch_toggle", "flush", "cycle", "clock_mhz"
+};
+
+static double *cost_field(EnergyCosts *c, int i) {
+    double *fields[] = {
+        &c->op[EN_ALU], &c->op[EN_MUL], &c->op[EN_BRANCH], &c->op[EN_MEM],
+        &c->reg_read, &c->reg_write, &c->mem_access, &c->latch_toggle,
+        &c->flush, &c->cycle, &c->clock_mhz
+    };
+    return fields[i];
+}
+
+void energy_default_costs(EnergyCosts *c) {
+    c->op[EN_ALU]    = 1.0;
+    c->op[EN_MUL]    = 3.5;
+    c->op[EN_BRANCH] = 1.2;
+    c->op[EN_MEM]    = 1.0;
+    c->reg_read      = 0.4;
+    c->reg_write     = 0.6;
+    c->mem_access    = 5.0;
+    c->latch_toggle  = 0.05;
+    c->flush         = 2.0;
+    c->cycle         = 0.8;
+    c->clock_mhz     = 100.0;
+}
+
+// Reads "name value" lines over the defaults; blank lines and lines starting
+// with '#' or ';' are skipped.
+int energy_load_costs(Processor *p, const char *path, EnergyCosts *c) {
+    energy_default_costs(c);
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        snprintf(p->error_msg, sizeof(p->error_msg), "cannot open %s", path);
+        return DBH_ERR_OPEN;
+    }
+    char line[128];
+    char name[32];
+    double value;
+    int lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        if (line[0] == '\n' || line[0] == ';' || line[0] == '#') continue;
+        int i = 0;
+        if (sscanf(line, "%31s %lf", name, &value) == 2 && value >= 0) {
+            int n = (int)(sizeof(cost_names) / sizeof(cost_names[0]));
+            while (i < n && strcmp(name, cost_names[i]) != 0) i++;
+            if (i < n && !(i == n - 1 && value == 0)) {
+                *cost_field(c, i) = value;
+                continue;
+            }
+        }
+        snprintf(p->error_msg, sizeof(p->error_msg), "%s:%d: invalid energy cost", path, lineno);
+        fclose(f);
+        return DBH_ERR_SYNTAX;
+    }
+    fclose(f);
+    return DBH_OK;
+}
+
+static int op_class(uint8_t opcode) {
+    switch (opcode) {
+        case 2:  return EN_MUL;
+        case 4:
+        case 7:
+        case 12: return EN_BRANCH;
+        case 10:
+        case 11:
+        case 14:
+        case 15: return EN_MEM;
+        default: return EN_ALU;
+    }
+}
+
+// register file reads of an executed instruction: both operands of the
+// register forms, rs of the immediate forms that use it
+static int op_reads(uint8_t opcode) {
+    switch (opcode) {
+        case 0: case 1: case 2: case 6: case 7: return 2;
+        case 3: case 10: case 12:               return 0;
+        case 13: case 14: case 15:              return 0;   // per lane, see energy_record()
+        default:                                return 1;
+    }
+}
+
+static uint64_t if_id_bits(const IF_ID_Reg *r) {
+    return r->instr | (uint64_t)(r->pc & 0x3FF) << 16 | (uint64_t)r->valid << 26;
+}
+
+static uint64_t id_ex_bits(const ID_EX_Reg *r) {
+    return r->instr | (uint64_t)(r->pc & 0x3FF) << 16 | (uint64_t)r->valueRS << 26 |
+           (uint64_t)r->valueRT << 34 | (uint64_t)r->valid << 42;
+}
+
+// costs NULL selects energy_default_costs()
+int energy_enable(Processor *p, const EnergyCosts *costs) {
+    if (p->energy) return DBH_OK;
+    struct Energy *e = calloc(1, sizeof(struct Energy));
+    if (!e) return DBH_ERR_NOMEM;
+    if (costs) {
+        e->costs = *costs;
+    } else {
+        energy_default_costs(&e->costs);
+    }
+    for (int op = 0; op < 16; op++) {
+        e->op_energy[op] = e->costs.op[op_class((uint8_t)op)] + op_reads((uint8_t)op) * e->costs.reg_read +
+                           (op_class((uint8_t)op) == EN_MEM ? e->costs.mem_access : 0.0);
+    }
+    e->if_id = if_id_bits(&p->IF_ID);
+    e->id_ex = id_ex_bits(&p->ID_EX);
+    p->energy = e;
+    return DBH_OK;
+}
+
+void energy_free(Processor *p) {
+    free(p->energy);
+    p->energy = NULL;
+}
+
+// clears the totals, keeps the costs
+void energy_reset(Processor *p) {
+    size_t keep = offsetof(struct Energy, pc_energy);
+    memset((uint8_t *)p->energy + keep, 0, sizeof(struct Energy) - keep);
+}
+
+// bytes behind p->energy, which reverse-execution snapshots copy
+size_t energy_state_size(void) {
+    return sizeof(struct Energy);
+}
+
+void energy_record(Processor *p, uint8_t opcode, uint8_t rs) {
+    struct Energy *e = p->energy;
+    double pj = e->op_energy[opcode];
+    e->ops[opcode]++;
+    if (opcode >= 13) {
+        if (p->simd) {
+            int reads = __builtin_popcountll(simd_reads(p->ID_EX.instr));
+            int writes = __builtin_popcountll(simd_writes(p->ID_EX.instr));
+            e->lane_reads += (uint64_t)reads;
+            e->reg_writes += (uint64_t)writes;
+            pj += reads * e->costs.reg_read + writes * e->costs.reg_write;
+        }
+    } else if (rs != 0 && op_writes_rs(opcode)) {
+        e->reg_writes++;
+        pj += e->costs.reg_write;
+    }
+    e->exec[p->ID_EX.pc & 0x3FF]++;
+    e->pc_energy[p->ID_EX.pc & 0x3FF] += pj;
+}
+
+void energy_flush(Processor *p, uint16_t pc) {
+    struct Energy *e = p->energy;
+    e->flushes++;
+    e->pc_energy[pc & 0x3FF] += e->costs.flush;
+}
+
+void energy_cycle(Processor *p) {
+    struct Energy *e = p->energy;
+    uint64_t if_id = if_id_bits(&p->IF_ID);
+    uint64_t id_ex = id_ex_bits(&p->ID_EX);
+    int a = __builtin_popcountll(if_id ^ e->if_id);
+    int b = __builtin_popcountll(id_ex ^ e->id_ex);
+    e->pc_energy[p->IF_ID.pc & 0x3FF] += a * e->costs.latch_toggle;
+    e->pc_energy[p->ID_EX.pc & 0x3FF] += b * e->costs.latch_toggle;
+    e->toggles += (uint64_t)(a + b);
+    e->if_id = if_id;
+    e->id_ex = id_ex;
+    e->cycles++;
+}
+
+void energy_skip(Processor *p, uint64_t cycles) {
+    p->energy->cycles += cycles;
+}
+
+typedef struct {
+    double ops[EN_CLASSES];
+    double reg_read, reg_write, mem, latch, flush, clock;
+    double total;
+} Breakdown;
+
+static void breakdown(const struct Energy *e, Breakdown *b) {
+    const EnergyCosts *c = &e->costs;
+    memset(b, 0, sizeof(*b));
+    uint64_t reads = 0;
+    for (int op = 0; op < 16; op++) {
+        b->ops[op_class((uint8_t)op)] += e->ops[op] * c->op[op_class((uint8_t)op)];
+        reads += e->ops[op] * (uint64_t)op_reads((uint8_t)op);
+    }
+    reads += e->lane_reads;
+    b->reg_read = reads * c->reg_read;
+    b->reg_write = e->reg_writes * c->reg_write;
+    b->mem = (e->ops[10] + e->ops[11] + e->ops[14] + e->ops[15]) * c->mem_access;
+    b->latch = e->toggles * c->latch_toggle;
+    b->flush = e->flushes * c->flush;
+    b->clock = e->cycles * c->cycle;
+    for (int i = 0; i < EN_CLASSES; i++) b->total += b->ops[i];
+    b->total += b->reg_read + b->reg_write + b->mem + b->latch + b->flush + b->clock;
+}
+
+// total energy in picojoules so far, 0 when the model is off
+double energy_total(const Processor *p) {
+    if (!p->energy) return 0.0;
+    Breakdown b;
+    breakdown(p->energy, &b);
+    return b.total;
+}
+
+typedef struct {
+    uint16_t block;
+    double   pj;
+} BlockEnergy;
+
+static int by_energy_desc(const void *a, const void *b) {
+    const BlockEnergy *x = a, *y = b;
+    if (x->pj != y->pj) return x->pj < y->pj ? 1 : -1;
+    return x->block - y->block;
+}
+
+static void print_blocks(const Processor *p, const struct Energy *e, double dynamic) {
+    Cfg *cfg = malloc(sizeof(Cfg));
+    if (!cfg) return;
+    int status = cfg_build(p, cfg);
+    if (status != DBH_OK) {
+        proc_printf(p, "Energy per basic block unavailable: %s\n", proc_strerror(status));
+        free(cfg);
+        return;
+    }
+    BlockEnergy order[1024];
+    int n = 0;
+    for (int b = 0; b < cfg->nblocks; b++) {
+        double pj = 0.0;
+        for (int a = cfg->blocks[b].start; a <= cfg->blocks[b].end; a++) pj += e->pc_energy[a];
+        if (pj > 0.0) {
+            order[n].block = (uint16_t)b;
+            order[n++].pj = pj;
+        }
+    }
+    qsort(order, n, sizeof(order[0]), by_energy_desc);
+
+    proc_printf(p, "Energy per basic block (dynamic%s):\n",
+                cfg->nunresolved ? ", blocks approximate: a BR has unknown targets" : "");
+    proc_printf(p, "%-15s %10s %14s %12s %7s\n", "Block", "Entries", "Energy (pJ)", "pJ/entry", "%");
+    for (int i = 0; i < n && i < ENERGY_BLOCKS; i++) {
+        const CfgBlock *blk = &cfg->blocks[order[i].block];
+        uint64_t entries = e->exec[blk->start];
+        proc_printf(p, "0x%04X-0x%04X %10llu %14.1f %12.2f %6.2f%%\n", blk->start, blk->end,
+                    (unsigned long long)entries, order[i].pj, entries ? order[i].pj / entries : 0.0,
+                    dynamic > 0.0 ? 100.0 * order[i].pj / dynamic : 0.0);
+    }
+    free(cfg);
+}
+
+void print_energy(const Processor *p) {
+    const struct Energy *e = p->energy;
+    if (!e) return;
+    Breakdown b;
+    breakdown(e, &b);
+    static const char *const class_names[EN_CLASSES] = { "ALU ops", "MUL ops", "Branch ops", "Memory ops" };
+
+    proc_printf(p, "%-18s %14s %7s\n", "Component", "Energy (pJ)", "%");
+    for (int i = 0; i < EN_CLASSES; i++) {
+        proc_printf(p, "%-18s %14.1f %6.2f%%\n", class_names[i], b.ops[i], b.total > 0.0 ? 100.0 * b.ops[i] / b.total : 0.0);
+    }
+    const struct { const char *name; double pj; } rows[] = {
+        { "Register reads", b.reg_read }, { "Register writes", b.reg_write },
+        { "Data memory", b.mem }, { "Latch toggles", b.latch },
+        { "Flushes", b.flush }, { "Clock/leakage", b.clock }
+    };
+    for (size_t i = 0; i < sizeof(rows) / sizeof(rows[0]); i++) {
+        proc_printf(p, "%-18s %14.1f %6.2f%%\n", rows[i].name, rows[i].pj, b.total > 0.0 ? 100.0 * rows[i].pj / b.total : 0.0);
+    }
+    double seconds = e->cycles / (e->costs.clock_mhz * 1e6);
+    uint64_t instret = 0;
+    for (int op = 0; op < 16; op++) instret += e->ops[op];
+    proc_printf(p, "Total energy: %.1f pJ over %llu cycles (%.2f pJ/instruction)\n", b.total,
+                (unsigned long long)e->cycles, instret ? b.total / instret : 0.0);
+    proc_printf(p, "Average power: %.3f mW at %.1f MHz\n", seconds > 0.0 ? b.total * 1e-9 / seconds : 0.0,
+                e->costs.clock_mhz);
+    print_blocks(p, e, b.total - b.clock);
+}
@@ -0,0 +1,38 @@
+#include "processor.h"
+
+// Pending timing events (delayed load writebacks) are kept in a min-heap so the simulator can jump straight to the next cycle
+// where something happens instead of stepping through idle cycles.
+
+// returns false when the queue is full
+bool evq_push(EventQueue *q, Event e) {
+    if (q->count >= EVQ_SIZE) {
+        return false;
+    }
+    int i = q->count++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (q->heap[parent].cycle <= e.cycle) break;
+        q->heap[i] = q->heap[parent];
+        i = parent;
+    }
+    q->heap[i] = e;
+    return true;
+}
+
+Event evq_pop(EventQueue *q) {
+    Event top = q->heap[0];
+    Event last = q->heap[--q->count];
+    int i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= q->count) break;
+        if (child + 1 < q->count && q->heap[child + 1].cycle < q->heap[child].cycle) {
+            child++;
+        }
+        if (last.cycle <= q->heap[child].cycle) break;
+        q->heap[i] = q->heap[child];
+        i = child;
+    }
+    q->heap[i] = last;
+    return top;
+}
@@ -0,0 +1,500 @@
+#define _POSIX_C_SOURCE 200809L
+#include "gdbstub.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// Packets are at most PACKET_MAX characters of payload, which lets a single
+// 'm' request return 2 KiB of memory, i.e. the whole data memory.
+#define PACKET_MAX   4096
+#define RUN_SLICE    1000000   // cycles between checks for a Ctrl-C from the debugger
+#define NUM_REGS     66        // r0..r63, sreg, pc
+
+typedef struct {
+    Processor *p;
+    int        fd;
+    bool       noack;
+    bool       gone;        // the debugger hung up; treated as a detach
+    char       in[512];
+    int        in_len;
+    int        in_pos;
+} GdbConn;
+
+static const char target_xml[] =
+    "<?xml version=\"1.0\"?>"
+    "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+    "<target version=\"1.0\"><feature name=\"org.dbh.core\">"
+    "%s"
+    "<reg name=\"sreg\" bitsize=\"8\" type=\"uint8\" regnum=\"64\"/>"
+    "<reg name=\"pc\" bitsize=\"16\" type=\"code_ptr\" regnum=\"65\"/>"
+    "</feature></target>";
+
+static int read_char(GdbConn *c) {
+    if (c->in_pos == c->in_len) {
+        if (c->gone) return -1;
+        ssize_t n = recv(c->fd, c->in, sizeof(c->in), 0);
+        if (n <= 0) {
+            c->gone = true;
+            return -1;
+        }
+        c->in_len = (int)n;
+        c->in_pos = 0;
+    }
+    return (unsigned char)c->in[c->in_pos++];
+}
+
+// Sends all of buf. MSG_NOSIGNAL keeps a debugger that hangs up mid-reply
+// from killing the simulator with SIGPIPE; the connection is marked gone
+// instead and the session ends as if it had detached.
+static bool send_all(GdbConn *c, const char *buf, size_t len) {
+    while (len && !c->gone) {
+        ssize_t n = send(c->fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            c->gone = true;
+            break;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return !c->gone;
+}
+
+// true when the debugger sent a Ctrl-C (or hung up) while the target runs
+static bool interrupted(GdbConn *c) {
+    if (c->gone) return true;
+    if (c->in_pos == c->in_len) {
+        struct pollfd pfd = { c->fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 0) <= 0) return false;
+    }
+    int ch = read_char(c);
+    return ch == 0x03 || ch < 0;
+}
+
+static int hex_value(int ch) {
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    return -1;
+}
+
+// Reads the next packet payload into buf. Returns its length, or -1 when the
+// connection is gone.
+static int get_packet(GdbConn *c, char *buf, int size) {
+    for (;;) {
+        int ch;
+        do {
+            ch = read_char(c);
+            if (ch < 0) return -1;
+        } while (ch != '$');
+
+        int len = 0;
+        uint8_t sum = 0;
+        while ((ch = read_char(c)) >= 0 && ch != '#') {
+            if (len < size - 1) buf[len++] = (char)ch;
+            sum += (uint8_t)ch;
+        }
+        int hi = read_char(c), lo = read_char(c);
+        if (ch < 0 || hi < 0 || lo < 0) return -1;
+        buf[len] = '\0';
+        if (c->noack) return len;
+        if (hex_value(hi) * 16 + hex_value(lo) == sum) {
+            return send_all(c, "+", 1) ? len : -1;
+        }
+        if (!send_all(c, "-", 1)) return -1;
+    }
+}
+
+static void put_packet(GdbConn *c, const char *payload) {
+    static const char hex[] = "0123456789abcdef";
+    char frame[PACKET_MAX + 8];
+    size_t len = strlen(payload);
+    uint8_t sum = 0;
+    frame[0] = '$';
+    memcpy(frame + 1, payload, len);
+    for (size_t i = 0; i < len; i++) sum += (uint8_t)payload[i];
+    frame[len + 1] = '#';
+    frame[len + 2] = hex[sum >> 4];
+    frame[len + 3] = hex[sum & 0x0F];
+    for (;;) {
+        if (!send_all(c, frame, len + 4) || c->noack) return;
+        int ch;
+        while ((ch = read_char(c)) >= 0 && ch != '+' && ch != '-') {}
+        if (ch != '-') return;
+    }
+}
+
+static char *put_hex(char *out, uint8_t byte) {
+    static const char hex[] = "0123456789abcdef";
+    *out++ = hex[byte >> 4];
+    *out++ = hex[byte & 0x0F];
+    return out;
+}
+
+static bool get_hex_byte(const char **s, uint8_t *byte) {
+    int hi = hex_value((*s)[0]);
+    int lo = hi < 0 ? -1 : hex_value((*s)[1]);
+    if (lo < 0) return false;
+    *byte = (uint8_t)(hi << 4 | lo);
+    *s += 2;
+    return true;
+}
+
+// next instruction to execute, as a byte address
+static uint16_t current_pc(const Processor *p) {
+    if (p->ID_EX.valid) return p->ID_EX.pc * 2;
+    if (p->IF_ID.valid) return p->IF_ID.pc * 2;
+    return p->PC * 2;
+}
+
+static uint16_t read_reg(const Processor *p, int n) {
+    if (n < 64) return p->Register[n];
+    if (n == 64) return p->SREG;
+    return current_pc(p);
+}
+
+// The instruction waiting in ID/EX already holds its operands, so refresh
+// them after a register write; a different pc restarts fetch there. The
+// caller checkpoints once for the whole packet.
+static void write_reg(Processor *p, int n, uint16_t value) {
+    if (n == 0) return;   // R0 is hardwired to zero
+    if (n < 64) {
+        p->Register[n] = (uint8_t)value;
+        p->ID_EX.valueRS = p->Register[p->ID_EX.rs];
+        p->ID_EX.valueRT = p->Register[p->ID_EX.rt];
+    } else if (n == 64) {
+        p->SREG = (uint8_t)value;
+    } else {
+        uint16_t pc = (value / 2) < 1024 ? value / 2 : 1024;
+        if (pc * 2 == current_pc(p)) return;
+        p->IF_ID.valid = false;
+        p->ID_EX.valid = false;
+        p->PC = pc;
+    }
+}
+
+static void read_registers(GdbConn *c) {
+    char out[NUM_REGS * 4 + 1], *o = out;
+    for (int n = 0; n < NUM_REGS; n++) {
+        uint16_t v = read_reg(c->p, n);
+        o = put_hex(o, v & 0xFF);
+        if (n == 65) o = put_hex(o, v >> 8);
+    }
+    *o = '\0';
+    put_packet(c, out);
+}
+
+static void write_registers(GdbConn *c, const char *s) {
+    for (int n = 0; n < NUM_REGS; n++) {
+        uint8_t lo, hi = 0;
+        if (!get_hex_byte(&s, &lo) || (n == 65 && !get_hex_byte(&s, &hi))) break;
+        write_reg(c->p, n, (uint16_t)(hi << 8 | lo));
+    }
+    tt_checkpoint(c->p);
+    put_packet(c, "OK");
+}
+
+// Copies the whole range straight out of the memory arrays in one pass, so
+// large dumps cost one packet; MMIO and watchpoints are not triggered.
+static void read_memory(GdbConn *c, const char *args) {
+    unsigned long addr, len;
+    if (sscanf(args, "%lx,%lx", &addr, &len) != 2) {
+        put_packet(c, "E01");
+        return;
+    }
+    if (len > PACKET_MAX / 2) len = PACKET_MAX / 2;
+    char out[PACKET_MAX + 1], *o = out;
+    const Processor *p = c->p;
+    if (addr >= GDB_DATA_BASE) {
+        unsigned long a = addr - GDB_DATA_BASE;
+        for (; len && a < sizeof(p->data_mem); len--, a++) o = put_hex(o, p->data_mem[a]);
+    } else {
+        for (; len && addr < 2 * 1024; len--, addr++) {
+            uint16_t word = p->instr_mem[addr / 2];
+            o = put_hex(o, (addr & 1) ? word >> 8 : word & 0xFF);
+        }
+    }
+    *o = '\0';
+    put_packet(c, o == out ? "E01" : out);
+}
+
+static void write_memory(GdbConn *c, const char *args) {
+    unsigned long addr, len;
+    const char *data = strchr(args, ':');
+    if (sscanf(args, "%lx,%lx", &addr, &len) != 2 || !data) {
+        put_packet(c, "E01");
+        return;
+    }
+    data++;
+    Processor *p = c->p;
+    for (; len; len--, addr++) {
+        uint8_t byte;
+        if (!get_hex_byte(&data, &byte)) break;
+        if (addr >= GDB_DATA_BASE && addr - GDB_DATA_BASE < sizeof(p->data_mem)) {
+            p->data_mem[addr - GDB_DATA_BASE] = byte;
+        } else if (addr < 2 * 1024) {
+            uint16_t *word = &p->instr_mem[addr / 2];
+            *word = (addr & 1) ? (uint16_t)((*word & 0x00FF) | byte << 8) : (uint16_t)((*word & 0xFF00) | byte);
+            proc_predecode(p, (uint16_t)(addr / 2));
+        } else {
+            break;
+        }
+    }
+    tt_checkpoint(p);
+    put_packet(c, len ? "E01" : "OK");
+}
+
+// Z/z packets: 0/1 breakpoints, 2 write, 3 read and 4 access watchpoints
+static void breakpoint(GdbConn *c, const char *args, bool insert) {
+    int type;
+    unsigned long addr, len;
+    if (sscanf(args, "%d,%lx,%lx", &type, &addr, &len) != 3) {
+        put_packet(c, "E01");
+        return;
+    }
+    Processor *p = c->p;
+    if (type <= 1) {
+        if (addr >= 2 * 1024) {
+            put_packet(c, "E01");
+            return;
+        }
+        if (insert) proc_set_breakpoint(p, (uint16_t)(addr / 2));
+        else        proc_clear_breakpoint(p, (uint16_t)(addr / 2));
+        put_packet(c, "OK");
+        return;
+    }
+    static const uint8_t kinds[] = { WATCH_WRITE, WATCH_READ, WATCH_READ | WATCH_WRITE };
+    if (type > 4 || addr < GDB_DATA_BASE || !len) {
+        put_packet(c, "");
+        return;
+    }
+    // checked at full width: a cast first would wrap 0x810000 onto data[0]
+    if (addr - GDB_DATA_BASE >= 2048 || len > 2048 - (addr - GDB_DATA_BASE)) {
+        put_packet(c, "E01");
+        return;
+    }
+    uint8_t kind = kinds[type - 2];
+    uint16_t a = (uint16_t)(addr - GDB_DATA_BASE);
+    if (insert) {
+        put_packet(c, mem_watch_add(p, a, (uint16_t)len, kind) >= 0 ? "OK" : "E01");
+        return;
+    }
+    for (int i = 0; i < WATCH_MAX; i++) {
+        const Watchpoint *w = &p->watches[i];
+        if (w->kind == kind && w->addr == a && w->len == len) {
+            mem_watch_remove(p, i);
+            break;
+        }
+    }
+    put_packet(c, "OK");
+}
+
+static void stop_reply(GdbConn *c, int reason) {
+    char out[64];
+    const Processor *p = c->p;
+    switch (reason) {
+        case STOP_DONE:
+            put_packet(c, "W00");
+            return;
+        case STOP_ERROR:
+            put_packet(c, "S06");
+            return;
+        case STOP_WATCH: {
+            const char *what = p->watch_hit.kind == WATCH_READ ? "rwatch" : "watch";
+            for (int i = 0; i < WATCH_MAX; i++) {
+                const Watchpoint *w = &p->watches[i];
+                if (w->kind == (WATCH_READ | WATCH_WRITE) && p->watch_hit.addr >= w->addr &&
+                    p->watch_hit.addr < w->addr + w->len) {
+                    what = "awatch";
+                }
+            }
+            snprintf(out, sizeof(out), "T05%s:%x;", what, GDB_DATA_BASE + p->watch_hit.addr);
+            put_packet(c, out);
+            return;
+        }
+        default:
+            put_packet(c, "S05");
+            return;
+    }
+}
+
+// runs in slices so a Ctrl-C from the debugger can stop the target
+static void cont(GdbConn *c) {
+    StopCond cond = { RUN_SLICE, 0, -1, -1, 0, -1, false };
+    int reason;
+    while ((reason = proc_run(c->p, &cond)) == STOP_CYCLES) {
+        if (interrupted(c)) {
+            put_packet(c, "S02");
+            return;
+        }
+    }
+    stop_reply(c, reason);
+}
+
+static void step(GdbConn *c) {
+    StopCond cond = { 0, 1, -1, -1, 0, -1, false };
+    int reason = proc_run(c->p, &cond);
+    stop_reply(c, reason == STOP_INSTRUCTIONS ? STOP_PC : reason);
+}
+
+static void reverse(GdbConn *c, bool single) {
+    Processor *p = c->p;
+    if (!p->tt) {
+        put_packet(c, "E01");
+        return;
+    }
+    int reason = single ? (tt_step_back(p) == DBH_OK ? STOP_PC : STOP_DONE) : tt_reverse(p, NULL);
+    if (reason == STOP_DONE) {
+        put_packet(c, "T05replaylog:begin;");
+    } else {
+        stop_reply(c, reason);
+    }
+}
+
+static void query(GdbConn *c, const char *q) {
+    char out[PACKET_MAX + 1];
+    if (strncmp(q, "qSupported", 10) == 0) {
+        snprintf(out, sizeof(out), "PacketSize=%x;qXfer:features:read+;QStartNoAckMode+%s",
+                 PACKET_MAX, c->p->tt ? ";ReverseStep+;ReverseContinue+" : "");
+        put_packet(c, out);
+    } else if (strcmp(q, "QStartNoAckMode") == 0) {
+        put_packet(c, "OK");
+        c->noack = true;
+    } else if (strncmp(q, "qXfer:features:read:target.xml:", 31) == 0) {
+        char regs[64 * 64], xml[sizeof(regs) + sizeof(target_xml)];
+        int n = 0;
+        for (int i = 0; i < 64; i++) {
+            n += snprintf(regs + n, sizeof(regs) - n,
+                          "<reg name=\"r%d\" bitsize=\"8\" type=\"uint8\" regnum=\"%d\"/>", i, i);
+        }
+        int total = snprintf(xml, sizeof(xml), target_xml, regs);
+        unsigned long off, len;
+        if (sscanf(q + 31, "%lx,%lx", &off, &len) != 2 || off > (unsigned long)total) {
+            put_packet(c, "E01");
+            return;
+        }
+        if (len > PACKET_MAX - 1) len = PACKET_MAX - 1;
+        unsigned long left = total - off;
+        out[0] = left > len ? 'm' : 'l';
+        snprintf(out + 1, sizeof(out) - 1, "%.*s", (int)(left > len ? len : left), xml + off);
+        put_packet(c, out);
+    } else if (strcmp(q, "qAttached") == 0) {
+        put_packet(c, "1");
+    } else if (strcmp(q, "qC") == 0) {
+        put_packet(c, "QC1");
+    } else if (strcmp(q, "qfThreadInfo") == 0) {
+        put_packet(c, "m1");
+    } else if (strcmp(q, "qsThreadInfo") == 0) {
+        put_packet(c, "l");
+    } else {
+        put_packet(c, "");
+    }
+}
+
+int gdb_serve(Processor *p, int fd) {
+    GdbConn c = { p, fd, false, false, {0}, 0, 0 };
+    char buf[PACKET_MAX + 1];
+    int len;
+    while ((len = get_packet(&c, buf, sizeof(buf))) >= 0) {
+        switch (buf[0]) {
+            case '?': put_packet(&c, "S05"); break;
+            case 'g': read_registers(&c); break;
+            case 'G': write_registers(&c, buf + 1); break;
+            case 'p': {
+                int n = (int)strtol(buf + 1, NULL, 16);
+                char out[8];
+                if (n < 0 || n >= NUM_REGS) {
+                    put_packet(&c, "E01");
+                    break;
+                }
+                uint16_t v = read_reg(p, n);
+                if (n == 65) snprintf(out, sizeof(out), "%02x%02x", v & 0xFF, v >> 8);
+                else         snprintf(out, sizeof(out), "%02x", v);
+                put_packet(&c, out);
+                break;
+            }
+            case 'P': {
+                char *eq;
+                int n = (int)strtol(buf + 1, &eq, 16);
+                const char *s = eq + 1;
+                uint8_t lo, hi = 0;
+                if (*eq != '=' || n < 0 || n >= NUM_REGS || !get_hex_byte(&s, &lo)) {
+                    put_packet(&c, "E01");
+                    break;
+                }
+                if (n == 65) get_hex_byte(&s, &hi);
+                write_reg(p, n, (uint16_t)(hi << 8 | lo));
+                tt_checkpoint(p);
+                put_packet(&c, "OK");
+                break;
+            }
+            case 'm': read_memory(&c, buf + 1); break;
+            case 'M': write_memory(&c, buf + 1); break;
+            case 'Z': breakpoint(&c, buf + 1, true); break;
+            case 'z': breakpoint(&c, buf + 1, false); break;
+            case 'c': cont(&c); break;
+            case 's': step(&c); break;
+            case 'b':
+                if (buf[1] == 's' || buf[1] == 'c') reverse(&c, buf[1] == 's');
+                else put_packet(&c, "");
+                break;
+            case 'q':
+            case 'Q': query(&c, buf); break;
+            case 'H':
+            case 'T': put_packet(&c, "OK"); break;
+            case 'D': put_packet(&c, "OK"); return DBH_OK;
+            case 'k': return DBH_OK;
+            default:
+                if (strcmp(buf, "vKill;1") == 0) {
+                    put_packet(&c, "OK");
+                    return DBH_OK;
+                }
+                put_packet(&c, "");
+                break;
+        }
+    }
+    return DBH_OK;
+}
+
+int gdb_listen_and_serve(Processor *p, const char *where) {
+    bool tcp = where[0] && strspn(where, "0123456789") == strlen(where);
+    int server = socket(tcp ? AF_INET : AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0) return DBH_ERR_OPEN;
+
+    int status = DBH_ERR_OPEN;
+    if (tcp) {
+        struct sockaddr_in sa = {0};
+        int one = 1;
+        setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sa.sin_family = AF_INET;
+        sa.sin_port = htons((uint16_t)atoi(where));
+        sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(server, (struct sockaddr *)&sa, sizeof(sa)) < 0) goto out;
+    } else {
+        struct sockaddr_un sa = {0};
+        if (strlen(where) >= sizeof(sa.sun_path)) goto out;
+        sa.sun_family = AF_UNIX;
+        strcpy(sa.sun_path, where);
+        unlink(where);
+        if (bind(server, (struct sockaddr *)&sa, sizeof(sa)) < 0) goto out;
+    }
+    if (listen(server, 1) < 0) goto out;
+    proc_printf(p, "Waiting for GDB on %s%s\n", tcp ? "127.0.0.1:" : "", where);
+
+    int fd = accept(server, NULL, NULL);
+    if (fd >= 0) {
+        status = gdb_serve(p, fd);
+        close(fd);
+    }
+out:
+    close(server);
+    if (!tcp) unlink(where);
+    return status;
+}
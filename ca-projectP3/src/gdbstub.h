@@ -0,0 +1,22 @@
+#ifndef GDBSTUB_H
+#define GDBSTUB_H
+
+#include "processor.h"
+
+// GDB remote serial protocol stub. The target is laid out like AVR in GDB:
+//   registers  r0..r63 (8 bit), sreg (8 bit), pc (16 bit, byte address)
+//   0x000000   instruction memory, 2 bytes per word, little-endian
+//   0x800000   data memory
+// The reported pc is the next instruction to execute.
+
+#define GDB_DATA_BASE 0x800000
+
+// Serves one debugger session on an already connected socket.
+int gdb_serve(Processor *p, int fd);
+
+// Listens on where ("1234" for TCP port 1234 on 127.0.0.1, anything else is
+// a Unix socket path), accepts one connection and serves it. Returns DBH_OK
+// when the debugger detaches or kills the target, DBH_ERR_OPEN on socket errors.
+int gdb_listen_and_serve(Processor *p, const char *where);
+
+#endif
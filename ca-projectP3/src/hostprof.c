@@ -0,0 +1,71 @@
+#define _POSIX_C_SOURCE 200809L
+#include "hostprof.h"
+
+#ifdef DBH_HOSTPROF
+
+#include <stdio.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Timers read the TSC where there is one and clock_gettime() elsewhere. TSC
+// ticks are converted to nanoseconds at report time by comparing both clocks
+// over the whole run. State is per thread so concurrent simulators do not
+// share counters.
+
+static const char *phase_names[HP_COUNT] = {
+    "load", "events", "execute", "decode", "fetch", "trace", "print"
+};
+
+static _Thread_local uint64_t phase_ticks[HP_COUNT];
+static _Thread_local uint64_t phase_calls[HP_COUNT];
+static _Thread_local uint64_t start_ticks;
+static _Thread_local uint64_t start_ns;
+
+static uint64_t wall_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t hostprof_now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t t = __rdtsc();
+#else
+    uint64_t t = wall_ns();
+#endif
+    if (!start_ns) {
+        start_ns = wall_ns();
+        start_ticks = t;
+    }
+    return t;
+}
+
+void hostprof_add(int phase, uint64_t ticks) {
+    phase_ticks[phase] += ticks;
+    phase_calls[phase]++;
+}
+
+void hostprof_report(void) {
+    uint64_t ticks = hostprof_now() - start_ticks;
+    uint64_t ns = wall_ns() - start_ns;
+    double ns_per_tick = ticks ? (double)ns / ticks : 1.0;
+
+    uint64_t total = 0;
+    for (int i = 0; i < HP_COUNT; i++) total += phase_ticks[i];
+
+    fprintf(stderr, "\n===== Host Time by Phase =====\n");
+    fprintf(stderr, "%-8s %12s %12s %10s %7s\n", "Phase", "Calls", "Time (us)", "ns/call", "%");
+    for (int i = 0; i < HP_COUNT; i++) {
+        if (!phase_calls[i]) continue;
+        double t = phase_ticks[i] * ns_per_tick;
+        fprintf(stderr, "%-8s %12llu %12.1f %10.1f %6.2f%%\n", phase_names[i],
+                (unsigned long long)phase_calls[i], t / 1000.0, t / phase_calls[i],
+                total ? 100.0 * phase_ticks[i] / total : 0.0);
+    }
+    fprintf(stderr, "Total run time: %.1f us, %.1f us outside timed phases\n",
+            ns / 1000.0, (ns - total * ns_per_tick) / 1000.0);
+}
+
+#endif
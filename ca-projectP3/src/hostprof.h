@@ -0,0 +1,39 @@
+#ifndef HOSTPROF_H
+#define HOSTPROF_H
+
+#include <stdint.h>
+
+// Host-side self-profiling of the simulator's own phases. Build with
+// -DDBH_HOSTPROF (make HOSTPROF=1) to enable; otherwise every macro below
+// expands to nothing and the timers cost nothing.
+
+enum {
+    HP_LOAD,      // mem_load_program
+    HP_EVENTS,    // retiring timing events and skipping idle cycles
+    HP_EXECUTE,
+    HP_DECODE,
+    HP_FETCH,
+    HP_TRACE,     // per-cycle pipeline trace
+    HP_PRINT,     // register, memory and report output
+    HP_COUNT
+};
+
+#ifdef DBH_HOSTPROF
+
+uint64_t hostprof_now(void);
+void hostprof_add(int phase, uint64_t ticks);
+void hostprof_report(void);
+
+#define HOSTPROF_BEGIN(phase) uint64_t hostprof_start_##phase = hostprof_now()
+#define HOSTPROF_END(phase)   hostprof_add(phase, hostprof_now() - hostprof_start_##phase)
+#define HOSTPROF_REPORT()     hostprof_report()
+
+#else
+
+#define HOSTPROF_BEGIN(phase) ((void)0)
+#define HOSTPROF_END(phase)   ((void)0)
+#define HOSTPROF_REPORT()     ((void)0)
+
+#endif
+
+#endif
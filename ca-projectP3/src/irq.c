@@ -0,0 +1,198 @@
+#include "processor.h"
+#include <stdio.h>
+#include <string.h>
+
+// Interrupt controller and timer. A raised line stays pending until it is
+// taken or cleared; raising it again meanwhile is counted as lost. At the
+// start of a cycle, before EX, the lowest enabled pending line is taken
+// unless a handler is already running (there is no nesting). Every
+// instruction that has left EX is complete, so the interrupt is precise: the
+// ones in IF/ID and ID/EX are flushed, the oldest of them (or PC when both
+// are empty) becomes the return address, SREG is saved, the line's pending
+// bit is cleared and fetch continues at the vector. RETI restores SREG and
+// jumps back, and the instruction it returns to executes before the next
+// interrupt is taken, so the interrupted code makes progress even when
+// handlers take longer than the timer period. A handler saves the registers
+// it uses itself.
+//
+// Latency is counted from the cycle a line is raised to the cycle the
+// handler's first instruction executes, so it includes waiting for a running
+// handler, a decode stall and the refill of the pipeline (at least 2).
+
+static void raise_line(Processor *p, uint8_t line, uint64_t cycle) {
+    IrqState *q = &p->irq;
+    q->raised[line]++;
+    if (q->pending >> line & 1) {
+        q->lost[line]++;
+        return;
+    }
+    q->pending |= (uint8_t)(1u << line);
+    q->raised_at[line] = cycle;
+}
+
+// Raises a line now; it can be taken in the next cycle.
+int irq_raise(Processor *p, uint8_t line) {
+    if (!p->irq.on || line >= IRQ_LINES) return DBH_ERR_RANGE;
+    raise_line(p, line, p->cycle + 1);
+    return DBH_OK;
+}
+
+// Raises a line at the start of a future cycle. Returns DBH_ERR_RANGE for a
+// bad line, a cycle already simulated or a full table.
+int irq_schedule(Processor *p, uint8_t line, uint64_t cycle) {
+    IrqState *q = &p->irq;
+    if (!q->on || line >= IRQ_LINES || cycle <= p->cycle || q->nsched == IRQ_SCHED_MAX) {
+        return DBH_ERR_RANGE;
+    }
+    int i = q->nsched++;
+    while (i > 0 && q->sched[i - 1].cycle > cycle) {
+        q->sched[i] = q->sched[i - 1];
+        i--;
+    }
+    q->sched[i] = (IrqRaise){ cycle, line };
+    return DBH_OK;
+}
+
+static void take(Processor *p, uint8_t line) {
+    IrqState *q = &p->irq;
+    q->pending &= (uint8_t)~(1u << line);
+    q->cause = line;
+    q->taken[line]++;
+    q->in_handler = true;
+    q->entering = true;
+    q->entry_raised = q->raised_at[line];
+    q->epc = p->ID_EX.valid ? p->ID_EX.pc : p->IF_ID.valid ? p->IF_ID.pc : p->PC;
+    q->esreg = p->SREG;
+    if (p->energy) energy_flush(p, q->epc);
+    p->ID_EX.valid = false;
+    p->IF_ID.valid = false;
+    p->PC = q->vector;
+}
+
+// Called at the start of every cycle, before EX, while the controller is on.
+void irq_cycle(Processor *p) {
+    IrqState *q = &p->irq;
+    if (q->timer_next && p->cycle >= q->timer_next) {
+        raise_line(p, IRQ_TIMER, q->timer_next);
+        q->timer_next += q->period;
+    }
+    while (q->nsched && q->sched[0].cycle <= p->cycle) {
+        raise_line(p, q->sched[0].line, q->sched[0].cycle);
+        q->nsched--;
+        memmove(q->sched, q->sched + 1, (size_t)q->nsched * sizeof(q->sched[0]));
+    }
+    uint8_t ready = q->pending & q->enable;
+    if (!ready || q->in_handler || q->returning) return;
+    // nothing is left to interrupt once the program has ended
+    if (!p->ID_EX.valid && !p->IF_ID.valid && p->PC >= 1024) return;
+    take(p, (uint8_t)__builtin_ctz(ready));
+}
+
+// the handler's first instruction has just executed
+void irq_entered(Processor *p) {
+    IrqState *q = &p->irq;
+    uint8_t line = q->cause;
+    uint64_t latency = p->cycle - q->entry_raised;
+    q->entering = false;
+    q->latency_total[line] += latency;
+    if (q->taken[line] == 1 || latency < q->latency_min[line]) q->latency_min[line] = latency;
+    if (latency > q->latency_max[line]) q->latency_max[line] = latency;
+}
+
+// RETI; outside a handler it does nothing. Returns true if it jumped.
+bool irq_return(Processor *p) {
+    IrqState *q = &p->irq;
+    if (!q->in_handler) return false;
+    q->in_handler = false;
+    q->returning = true;
+    p->SREG = q->esreg;
+    p->PC = q->epc;
+    return true;
+}
+
+// First cycle at which the controller may take an interrupt, UINT64_MAX if
+// none is coming; proc_skip_idle() does not skip past it.
+uint64_t irq_next_event(const Processor *p) {
+    const IrqState *q = &p->irq;
+    if ((q->pending & q->enable) && !q->in_handler) return p->cycle + 1;
+    uint64_t next = q->timer_next ? q->timer_next : UINT64_MAX;
+    if (q->nsched && q->sched[0].cycle < next) next = q->sched[0].cycle;
+    return next;
+}
+
+uint8_t irq_mmio_read(Processor *p, uint16_t addr) {
+    const IrqState *q = &p->irq;
+    switch (addr - IRQ_MMIO_BASE) {
+        case IRQ_REG_ENABLE:    return q->enable;
+        case IRQ_REG_PENDING:   return q->pending;
+        case IRQ_REG_CAUSE:     return q->cause;
+        case IRQ_REG_PERIOD_LO: return (uint8_t)q->period;
+        case IRQ_REG_PERIOD_HI: return (uint8_t)(q->period >> 8);
+        case IRQ_REG_VECTOR_HI: return (uint8_t)(q->vector >> 8);
+        case IRQ_REG_VECTOR_LO: return (uint8_t)q->vector;
+        default:                return 0;
+    }
+}
+
+void irq_mmio_write(Processor *p, uint16_t addr, uint8_t data) {
+    IrqState *q = &p->irq;
+    switch (addr - IRQ_MMIO_BASE) {
+        case IRQ_REG_ENABLE:
+            q->enable = data;
+            break;
+        case IRQ_REG_PENDING:
+            q->pending &= (uint8_t)~data;
+            break;
+        case IRQ_REG_PERIOD_LO:
+            q->period = (uint16_t)((q->period & 0xFF00) | data);
+            break;
+        case IRQ_REG_PERIOD_HI:
+            q->period = (uint16_t)(data << 8 | (q->period & 0xFF));
+            q->timer_next = q->period ? p->cycle + q->period : 0;
+            break;
+        case IRQ_REG_VECTOR_HI:
+            q->vector = (uint16_t)(data << 8 | (q->vector & 0xFF));
+            break;
+        case IRQ_REG_VECTOR_LO:
+            q->vector = (uint16_t)((q->vector & 0xFF00) | data);
+            break;
+        case IRQ_REG_RAISE:
+            for (uint8_t line = 0; line < IRQ_LINES; line++) {
+                if (data >> line & 1) raise_line(p, line, p->cycle + 1);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void print_irq(const Processor *p) {
+    const IrqState *q = &p->irq;
+    if (!q->on) return;
+    proc_printf(p, "%-6s %10s %10s %8s %10s %10s %10s\n", "Line", "Raised", "Taken", "Lost", "Min lat", "Avg lat", "Max lat");
+    int worst = -1;
+    for (int l = 0; l < IRQ_LINES; l++) {
+        if (!q->raised[l]) continue;
+        // the last one taken may not have reached its handler yet
+        uint64_t entered = q->taken[l] - (q->entering && q->cause == l);
+        char name[8];
+        snprintf(name, sizeof(name), l == IRQ_TIMER ? "timer" : "%d", l);
+        proc_printf(p, "%-6s %10llu %10llu %8llu", name, (unsigned long long)q->raised[l],
+                    (unsigned long long)q->taken[l], (unsigned long long)q->lost[l]);
+        if (entered) {
+            proc_printf(p, " %10llu %10.1f %10llu\n", (unsigned long long)q->latency_min[l],
+                        (double)q->latency_total[l] / entered, (unsigned long long)q->latency_max[l]);
+            if (worst < 0 || q->latency_max[l] > q->latency_max[worst]) worst = l;
+        } else {
+            proc_printf(p, " %10s %10s %10s\n", "-", "-", "-");
+        }
+    }
+    if (worst < 0) {
+        proc_printf(p, "No interrupt reached its handler.\n");
+        return;
+    }
+    proc_printf(p, "Worst-case latency: %llu cycles (line %d)\n", (unsigned long long)q->latency_max[worst], worst);
+    if (q->in_handler) {
+        proc_printf(p, "The run ended inside the handler for line %d.\n", q->cause);
+    }
+}
@@ -1,34 +1,198 @@
 #include "processor.h"
+#include "hostprof.h"
+#include "gdbstub.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-l mem_latency] [-m] [-v] [-p] [-r] [-e] [-E costs.txt] [-i] [-I line@cycle]... [-T pc,pc[,...]] [-F rr|icount] [-w addr]... [-g port|socket] [program.txt]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    const char *program = "program.txt";
+    int mem_latency = 0;
+    bool counter_mmio = false;
+    bool simd = false;
+    bool profile = false;
+    bool regstats = false;
+    bool energy = false;
+    const char *energy_costs = NULL;
+    bool interrupts = false;
+    IrqRaise raises[IRQ_SCHED_MAX];
+    int nraises = 0;
+    uint16_t thread_start[SMT_MAX_THREADS];
+    int nthreads = 0;
+    int fetch_policy = SMT_ROUND_ROBIN;
+    long watch_addr[WATCH_MAX];
+    int nwatch = 0;
+    const char *gdb = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            mem_latency = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc && nwatch < WATCH_MAX) {
+            watch_addr[nwatch++] = strtol(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            gdb = argv[++i];
+        } else if (strcmp(argv[i], "-m") == 0) {
+            counter_mmio = true;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            simd = true;
+        } else if (strcmp(argv[i], "-p") == 0) {
+            profile = true;
+        } else if (strcmp(argv[i], "-r") == 0) {
+            regstats = true;
+        } else if (strcmp(argv[i], "-e") == 0) {
+            energy = true;
+        } else if (strcmp(argv[i], "-E") == 0 && i + 1 < argc) {
+            energy = true;
+            energy_costs = argv[++i];
+        } else if (strcmp(argv[i], "-i") == 0) {
+            interrupts = true;
+        } else if (strcmp(argv[i], "-I") == 0 && i + 1 < argc && nraises < IRQ_SCHED_MAX) {
+            unsigned line;
+            unsigned long long cycle;
+            char end;
+            if (sscanf(argv[++i], "%u@%llu%c", &line, &cycle, &end) != 2) {
+                usage(argv[0]);
+            }
+            raises[nraises++] = (IrqRaise){ cycle, (uint8_t)(line < IRQ_LINES ? line : IRQ_LINES) };
+            interrupts = true;
+        } else if (strcmp(argv[i], "-T") == 0 && i + 1 < argc) {
+            char *s = argv[++i];
+            for (nthreads = 0; nthreads < SMT_MAX_THREADS; nthreads++) {
+                char *end;
+                long pc = strtol(s, &end, 0);
+                if (end == s || pc < 0 || pc >= 1024) {
+                    usage(argv[0]);
+                }
+                thread_start[nthreads] = (uint16_t)pc;
+                s = end;
+                if (*s != ',') break;
+                s++;
+            }
+            if (*s != '\0') {
+                usage(argv[0]);
+            }
+            nthreads++;
+        } else if (strcmp(argv[i], "-F") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "rr") == 0) {
+                fetch_policy = SMT_ROUND_ROBIN;
+            } else if (strcmp(argv[i], "icount") == 0) {
+                fetch_policy = SMT_ICOUNT;
+            } else {
+                usage(argv[0]);
+            }
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+        } else {
+            program = argv[i];
+        }
+    }
+    if (mem_latency < 0 || mem_latency > 0xFFFF || nthreads == 1) {
+        usage(argv[0]);
+    }
 
-int main() {
     Processor cpu;
     proc_init(&cpu);
     mem_init(&cpu); 
-    mem_load_program(&cpu, "C:\\Users\\nourh\\OneDrive\\Documents\\GitHub\\ca-project\\ca-projectP3\\src\\program.txt");
+    cpu.mem_latency = (uint16_t)mem_latency;
+    cpu.counter_mmio = counter_mmio;
+    cpu.simd = simd;
+    cpu.irq.on = interrupts;
+    for (int i = 0; i < nraises; i++) {
+        if (irq_schedule(&cpu, raises[i].line, raises[i].cycle) != DBH_OK) {
+            usage(argv[0]);
+        }
+    }
+    for (int i = 0; i < nwatch; i++) {
+        if (watch_addr[i] < 0 || watch_addr[i] > 0xFFFF ||
+            mem_watch_add(&cpu, (uint16_t)watch_addr[i], 1, WATCH_READ | WATCH_WRITE) < 0) {
+            usage(argv[0]);
+        }
+    }
+    EnergyCosts costs;
+    energy_default_costs(&costs);
+    if (energy_costs && energy_load_costs(&cpu, energy_costs, &costs) != DBH_OK) {
+        fprintf(stderr, "%s\n", cpu.error_msg);
+        return EXIT_FAILURE;
+    }
+    if ((profile && profile_enable(&cpu) != DBH_OK) ||
+        (regstats && regstats_enable(&cpu) != DBH_OK) ||
+        (energy && energy_enable(&cpu, &costs) != DBH_OK)) {
+        fprintf(stderr, "%s\n", proc_strerror(DBH_ERR_NOMEM));
+        return EXIT_FAILURE;
+    }
+    if (mem_load_program(&cpu, program) != DBH_OK) {
+        fprintf(stderr, "%s\n", cpu.error_msg);
+        return EXIT_FAILURE;
+    }
+    if (nthreads && smt_enable(&cpu, nthreads, thread_start, fetch_policy) != DBH_OK) {
+        fprintf(stderr, "%s\n", cpu.error_msg);
+        return EXIT_FAILURE;
+    }
     printf("Instruction memory loaded.\n");
-    mem_print_instr(&cpu);
+    {
+        HOSTPROF_BEGIN(HP_PRINT);
+        mem_print_instr(&cpu);
+        HOSTPROF_END(HP_PRINT);
+    }
+
+    if (gdb) {
+        // reverse stepping is cheap enough to always offer to the debugger
+        tt_enable(&cpu);
+        if (gdb_listen_and_serve(&cpu, gdb) != DBH_OK) {
+            fprintf(stderr, "cannot serve GDB on %s\n", gdb);
+            return EXIT_FAILURE;
+        }
+        return 0;
+    }
 
     printf("===== Simulation Start =====\n");
 
     bool isrunning = true;
-    int cyclescounter = 0;
 
     while (isrunning) {
+        uint64_t skipped = proc_skip_idle(&cpu);
+        if (skipped) {
+            // the span ends at the next memory event or, if sooner, interrupt controller event
+            bool irq = cpu.irq.on && irq_next_event(&cpu) == cpu.cycle + 1;
+            printf("Clock Cycles %llu-%llu: %s\n", (unsigned long long)(cpu.cycle - skipped + 1),
+                   (unsigned long long)cpu.cycle, irq ? "idle until the next interrupt or timer tick" : "stalled on data memory");
+        }
+        bool draining = cpu.events.count > 0; // a writeback lands this cycle
         process_cycle(&cpu);
-        if(!cpu.EX_valid && !cpu.IF_ID.valid && !cpu.ID_EX.valid && cpu.PC>=1024 ){
+        if(!cpu.EX_valid && !cpu.IF_ID.valid && !cpu.ID_EX.valid && cpu.PC>=1024 && !draining &&
+           !(cpu.smt.nthreads && smt_alive(&cpu))){
             break;
         }
         else{
-              print_pipeline(&cpu, ++cyclescounter);
+              HOSTPROF_BEGIN(HP_TRACE);
+              print_pipeline(&cpu, (int)cpu.cycle);
+              HOSTPROF_END(HP_TRACE);
         }
-        isrunning = cpu.IF_ID.valid || cpu.ID_EX.valid || cpu.EX_valid || cpu.PC < 1024;
+        isrunning = proc_running(&cpu);
+    }
+    if (cpu.error) {
+        fprintf(stderr, "Simulation stopped: %s\n", cpu.error_msg);
     }
 
+    HOSTPROF_BEGIN(HP_PRINT);
+    if (cpu.smt.nthreads) {
+        smt_switch(&cpu, 0);
+    }
     printf("\n===== Final Registers =====\n");
     print_registers(&cpu);
     printf("PC: 0x%04X\n", cpu.PC);
     printf("SREG: 0x%02X\n", cpu.SREG);
+    // the same count as CTR_CYCLES, including the cycle that drains the pipeline
+    printf("Cycles: %llu\n", (unsigned long long)cpu.perf.cycles);
+
+    printf("\n===== Performance Counters =====\n");
+    print_counters(&cpu);
 
     printf("\n===== Final Instruction Memory =====\n");
     mem_print_instr(&cpu);
@@ -36,5 +200,35 @@ int main() {
     printf("\n===== Final Data Memory =====\n");
     mem_print_data(&cpu);
 
-    return 0;
+    if (cpu.prof) {
+        printf("\n===== Profile =====\n");
+        print_profile(&cpu);
+        profile_free(&cpu);
+    }
+
+    if (cpu.regstats) {
+        printf("\n===== Register Usage =====\n");
+        print_regstats(&cpu);
+        regstats_free(&cpu);
+    }
+
+    if (cpu.irq.on) {
+        printf("\n===== Interrupts =====\n");
+        print_irq(&cpu);
+    }
+
+    if (cpu.smt.nthreads) {
+        printf("\n===== Threads =====\n");
+        print_smt(&cpu);
+    }
+
+    if (cpu.energy) {
+        printf("\n===== Energy =====\n");
+        print_energy(&cpu);
+        energy_free(&cpu);
+    }
+    HOSTPROF_END(HP_PRINT);
+
+    HOSTPROF_REPORT();
+    return cpu.error ? EXIT_FAILURE : 0;
 }
@@ -1,119 +1,240 @@
 #include "processor.h"
+#include "hostprof.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
-
 void mem_init(Processor *p) {
     memset(p->instr_mem, 0, sizeof(p->instr_mem));
     memset(p->data_mem, 0, sizeof(p->data_mem));
+    memset(p->decoded, 0, sizeof(p->decoded));
+}
+
+// Assembles one source line. Returns 1 when an instruction was produced, 0 for
+// blank and comment lines, or a negative DBH_ERR_* code.
+int mem_assemble_line(const char *line, uint16_t *out) {
+    if (line[0] == '\n' || line[0] == '\r' || line[0] == '\0' || line[0] == ';' || line[0] == '#') return 0;
+
+    char op[16];
+    int r1 = 0;
+    int r2 = 0;
+    int value = 0;
+    uint16_t opcode = 0;
+    uint16_t rs = 0;
+    uint16_t rt = 0;
+    uint16_t imm = 0;
+    if (sscanf(line, "%15s R%d R%d", op, &r1, &r2) == 3) {
+        if (op[0] == 'V') return simd_assemble(op, r1, r2, false, out);
+        rs = (uint8_t)r1;
+        rt = (uint8_t)r2;
+
+        if      (strcmp(op, "ADD") == 0) opcode = 0;
+        else if (strcmp(op, "SUB") == 0) opcode = 1;
+        else if (strcmp(op, "MUL") == 0) opcode = 2;
+        else if (strcmp(op, "EOR") == 0) opcode = 6;
+        else if (strcmp(op, "BR")  == 0) opcode = 7;
+        else return DBH_ERR_OPCODE;
+        *out = (opcode << 12) | ((rs & 0x3F) << 6) | (rt & 0x3F);
+
+    } else if (sscanf(line, "%15s R%d %d", op, &r1, &value) == 3) {
+        if (op[0] == 'V') return simd_assemble(op, r1, value, true, out);
+        rs = (uint8_t)r1;
+        imm = (uint8_t)value;
+
+        if      (strcmp(op, "MOVI") == 0) opcode = 3;
+        else if (strcmp(op, "BEQZ") == 0) opcode = 4;
+        else if (strcmp(op, "ANDI") == 0) opcode = 5;
+        else if (strcmp(op, "SAL")  == 0) opcode = 8;
+        else if (strcmp(op, "SAR")  == 0) opcode = 9;
+        else if (strcmp(op, "LDR")  == 0) opcode = 10;
+        else if (strcmp(op, "STR")  == 0) opcode = 11;
+        else return DBH_ERR_OPCODE;
+        *out = (opcode << 12) | ((rs & 0x3F) << 6) | (imm & 0x3F);
+
+    } else if (sscanf(line, "%15s", op) == 1 && strcmp(op, "RETI") == 0) {
+        *out = 12 << 12;
+
+    } else {
+        return DBH_ERR_SYNTAX;
+    }
+    return 1;
+}
+
+static int load_line(Processor *p, const char *line, uint16_t *addr) {
+    uint16_t instruction = 0;
+    int status = mem_assemble_line(line, &instruction);
+    if (status < 0) {
+        size_t len = strcspn(line, "\r\n");
+        snprintf(p->error_msg, sizeof(p->error_msg), "%s: %.*s",
+                 status == DBH_ERR_OPCODE ? "Unknown opcode" : "Invalid instruction format", (int)len, line);
+        return p->error = status;
+    }
+    if (status == 1) {
+        if (!p->quiet) proc_printf(p, "Loaded: %04X at addr %d from line: %s", instruction, *addr, line);
+        p->instr_mem[*addr] = instruction;
+        proc_predecode(p, (*addr)++);
+    }
+    return DBH_OK;
 }
 
-void mem_load_program(Processor *p, const char *filename) {
+// A load replaces the whole program and clears an earlier error. Entries are
+// predecoded again rather than zeroed, so breakpoints stay set.
+static void clear_program(Processor *p) {
+    memset(p->instr_mem, 0, sizeof(p->instr_mem));
+    for (uint16_t a = 0; a < 1024; a++) {
+        proc_predecode(p, a);
+    }
+    p->error = DBH_OK;
+    p->error_msg[0] = '\0';
+}
+
+int mem_load_program(Processor *p, const char *filename) {
+    HOSTPROF_BEGIN(HP_LOAD);
     FILE *file = fopen(filename, "r");
     if (!file) {
-        perror("fopen");
-        exit(EXIT_FAILURE);
+        snprintf(p->error_msg, sizeof(p->error_msg), "cannot open %s", filename);
+        return p->error = DBH_ERR_OPEN;
     }
-    printf("Opening file: %s\n", filename);
+    if (!p->quiet) proc_printf(p, "Opening file: %s\n", filename);
+    clear_program(p);
 
     char line[128];
     uint16_t addr = 0; 
+    int status = DBH_OK;
 
     while (fgets(line, sizeof(line), file) && addr < 0x0400) {
-        if (line[0] == '\n' || line[0] == ';' || line[0] == '#') continue;
-
-        char op[16];
-        int r1 = 0;
-        int r2 = 0;
-        int value = 0;
-        uint16_t opcode = 0;
-        uint16_t rs = 0;
-        uint16_t rt = 0;
-        uint16_t imm = 0;
-        uint16_t instruction = 0;
-         if (sscanf(line, "%s R%d R%d", op, &r1, &r2) == 3) {
-            rs = (uint8_t)r1;
-            rt = (uint8_t)r2;
-            
-
-            if      (strcmp(op, "ADD") == 0) opcode = 0;
-            else if (strcmp(op, "SUB") == 0) opcode = 1;
-            else if (strcmp(op, "MUL") == 0) opcode = 2;
-            else if (strcmp(op, "EOR") == 0) opcode = 6;
-            else if (strcmp(op, "BR")  == 0) opcode = 7;
-            else {
-                fprintf(stderr, "Unknown opcode: %s\n", op);
-                exit(EXIT_FAILURE);
-            }
-            instruction = (opcode << 12) | ((rs & 0x3F) << 6) | (rt & 0x3F);
-            printf("Loaded: %04X at addr %d from line: %s", instruction, addr, line);
-            p->instr_mem[addr++] = instruction;
-
-        } else if (sscanf(line, "%s R%d %d", op, &r1, &value) == 3) {
-            rs = (uint8_t)r1;
-            imm = (uint8_t)value;
-
-            if      (strcmp(op, "MOVI") == 0) opcode = 3;
-            else if (strcmp(op, "BEQZ") == 0) opcode = 4;
-            else if (strcmp(op, "ANDI") == 0) opcode = 5;
-            else if (strcmp(op, "SAL")  == 0) opcode = 8;
-            else if (strcmp(op, "SAR")  == 0) opcode = 9;
-            else if (strcmp(op, "LDR")  == 0) opcode = 10;
-            else if (strcmp(op, "STR")  == 0) opcode = 11;
-            else {
-                fprintf(stderr, "Unknown opcode: %s\n", op);
-                exit(EXIT_FAILURE);
-            }
-
-            if (opcode == 3 || opcode == 4 || opcode == 5 || opcode == 10 || opcode == 11 ||opcode == 8 ||opcode == 9 ) {
-                instruction = (opcode << 12) | ((rs & 0x3F) << 6) | (imm & 0x3F);
-            } else {
-                instruction = (opcode << 12) | ((rs & 0x3F) << 6) | (rt & 0x3F);
-            }
-            printf("Loaded: %04X at addr %d from line: %s", instruction, addr, line);
-            p->instr_mem[addr++] = instruction;
-
-        } else {
-            fprintf(stderr, "Invalid instruction format: %s", line);
-            exit(EXIT_FAILURE);
-        }
+        status = load_line(p, line, &addr);
+        if (status != DBH_OK) break;
     }
 
-    printf("\nLoaded %d instructions\n", addr );
+    if (!p->quiet && status == DBH_OK) proc_printf(p, "\nLoaded %d instructions\n", addr );
     fclose(file);
+    HOSTPROF_END(HP_LOAD);
+    return status;
+}
 
+// Same as mem_load_program() but takes the program text from memory, so an
+// embedding host does not need to go through the file system.
+int mem_load_source(Processor *p, const char *source) {
+    char line[128];
+    uint16_t addr = 0;
+    clear_program(p);
+    while (*source && addr < 0x0400) {
+        size_t len = strcspn(source, "\n");
+        size_t n = len < sizeof(line) - 2 ? len : sizeof(line) - 2;
+        memcpy(line, source, n);
+        line[n] = '\n';
+        line[n + 1] = '\0';
+        source += len + (source[len] == '\n');
+
+        int status = load_line(p, line, &addr);
+        if (status != DBH_OK) return status;
+    }
+    if (!p->quiet) proc_printf(p, "\nLoaded %d instructions\n", addr );
+    return DBH_OK;
+}
+
+static bool is_counter_addr(const Processor *p, uint16_t addr) {
+    return p->counter_mmio && addr >= COUNTER_MMIO_BASE && addr < COUNTER_MMIO_BASE + COUNTER_MMIO_SIZE;
+}
+
+static bool is_irq_addr(const Processor *p, uint16_t addr) {
+    return p->irq.on && addr >= IRQ_MMIO_BASE && addr < IRQ_MMIO_BASE + IRQ_MMIO_SIZE;
+}
+
+static void rebuild_watch_pages(Processor *p) {
+    p->watch_pages = 0;
+    for (int i = 0; i < WATCH_MAX; i++) {
+        const Watchpoint *w = &p->watches[i];
+        if (!w->kind) continue;
+        for (int page = w->addr >> WATCH_PAGE_SHIFT; page <= (w->addr + w->len - 1) >> WATCH_PAGE_SHIFT; page++) {
+            p->watch_pages |= 1u << page;
+        }
+    }
+}
+
+// Watches data[addr .. addr+len-1] for the WATCH_* accesses in kind. Returns
+// the watchpoint id, or DBH_ERR_RANGE for a bad range or a full table.
+int mem_watch_add(Processor *p, uint16_t addr, uint16_t len, uint8_t kind) {
+    if (!len || !kind || addr >= 2048 || len > 2048 - addr) return DBH_ERR_RANGE;
+    for (int i = 0; i < WATCH_MAX; i++) {
+        if (!p->watches[i].kind) {
+            p->watches[i] = (Watchpoint){ addr, len, kind };
+            rebuild_watch_pages(p);
+            return i;
+        }
+    }
+    return DBH_ERR_RANGE;
+}
+
+void mem_watch_remove(Processor *p, int id) {
+    if (id < 0 || id >= WATCH_MAX) return;
+    p->watches[id].kind = 0;
+    rebuild_watch_pages(p);
+}
+
+// slow path, only reached for accesses to a watched page
+static void watch_access(Processor *p, uint16_t addr, uint8_t kind, uint8_t old_value, uint8_t new_value) {
+    if (kind == WATCH_WRITE && old_value != new_value) {
+        kind |= WATCH_CHANGE;
+    }
+    for (int i = 0; i < WATCH_MAX; i++) {
+        const Watchpoint *w = &p->watches[i];
+        uint8_t fired = w->kind & kind;
+        if (!fired || addr < w->addr || addr >= w->addr + w->len) continue;
+        WatchHit h = { p->cycle, p->ID_EX.pc, addr, fired & WATCH_CHANGE ? WATCH_CHANGE : fired, old_value, new_value };
+        p->watch_hit = h;
+        p->run_hits |= PD_WATCH;
+        proc_printf(p, "[WATCH] %s data[0x%04X] 0x%02X -> 0x%02X (cycle %llu, PC %d)\n",
+                    h.kind == WATCH_READ ? "read" : h.kind == WATCH_CHANGE ? "change" : "write",
+                    addr, old_value, new_value, (unsigned long long)h.cycle, h.pc);
+        return;
+    }
 }
 
 uint8_t mem_read_data(Processor *p, uint16_t addr) {
     if (addr >= 2048) return 0;
-    return p->data_mem[addr];
+    if (is_counter_addr(p, addr)) return proc_counter_mmio_read(p, addr);
+    if (is_irq_addr(p, addr)) return irq_mmio_read(p, addr);
+    uint8_t value = p->data_mem[addr];
+    if (p->watch_pages & (1u << (addr >> WATCH_PAGE_SHIFT))) {
+        watch_access(p, addr, WATCH_READ, value, value);
+    }
+    return value;
 }
 
 void mem_write_data(Processor *p, uint16_t addr, uint8_t data) {
-    if (addr >= 2048) return;
+    if (addr >= 2048 || is_counter_addr(p, addr)) return;
+    if (is_irq_addr(p, addr)) {
+        irq_mmio_write(p, addr, data);
+        return;
+    }
+    uint8_t old_value = p->data_mem[addr];
     p->data_mem[addr] = data;
-    printf("[EX] Memory[0x%04X] updated to 0x%02X\n", addr, data);
+    if (p->watch_pages & (1u << (addr >> WATCH_PAGE_SHIFT))) {
+        watch_access(p, addr, WATCH_WRITE, old_value, data);
+    }
+    if (!p->quiet) proc_printf(p, "[EX] Memory[0x%04X] updated to 0x%02X\n", addr, data);
 }
 
 void mem_print_instr(const Processor *p) {
-    printf("Instruction Memory:\n");
+    proc_printf(p, "Instruction Memory:\n");
     for (int i = 0; i < 1024; i++) {
         if (p->instr_mem[i]) {
             uint16_t instruction = p->instr_mem[i];
             uint8_t opcode = (instruction >> 12) & 0x0F;
             uint8_t rs = (instruction >> 6) & 0x3F;
             uint8_t rt = instruction & 0x3F;
-            printf("0x%04X: 0x%04X (opcode=%d, rs=%d, rt=%d)\n", i, instruction, opcode, rs, rt);
+            proc_printf(p, "0x%04X: 0x%04X (opcode=%d, rs=%d, rt=%d)\n", i, instruction, opcode, rs, rt);
         }
     }
 }
 
 void mem_print_data(const Processor *p) {
-    printf("Data Memory:\n");
+    proc_printf(p, "Data Memory:\n");
     for (int i = 0; i < 2048; i++) {
         if (p->data_mem[i])
-            printf("0x%04X: 0x%02X\n", i, p->data_mem[i]);
+            proc_printf(p, "0x%04X: 0x%02X\n", i, p->data_mem[i]);
     }
 }
 
@@ -0,0 +1,62 @@
+#include "processor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// optcheck: runs peephole_optimize() on small programs and compares the
+// rewritten instruction memory with the expected code, one case per rule
+// that depends on what the optimizer can prove about a register.
+
+typedef struct {
+    const char *name;
+    const char *source;
+    const char *expected;   // disassembly, one instruction per line
+} Case;
+
+static const Case cases[] = {
+    { "SUB Rx Rx then ADD of a known register",
+      "MOVI R11 7\nSUB R1 R1\nADD R1 R11\nSTR R1 5\n",
+      "MOVI R11 7\nMOVI R1 7\nSTR R1 5\n" },
+    { "EOR Rx Rx of an unknown register",
+      "LDR R1 3\nEOR R1 R1\nADD R1 R11\nSTR R1 5\n",
+      "MOVI R1 0\nADD R1 R11\nSTR R1 5\n" },
+};
+#define NUM_CASES (int)(sizeof(cases) / sizeof(cases[0]))
+
+// the program in p as disassembly, up to the first empty word
+static void listing(const Processor *p, char *out, size_t size) {
+    char text[32];
+    size_t len = 0;
+    out[0] = '\0';
+    for (int a = 0; a < 1024 && p->instr_mem[a] && len < size; a++) {
+        disassemble(p->instr_mem[a], text, sizeof(text));
+        len += (size_t)snprintf(out + len, size - len, "%s\n", text);
+    }
+}
+
+int main(void) {
+    Processor *p = proc_create();
+    if (!p) {
+        perror("proc_create");
+        return EXIT_FAILURE;
+    }
+    proc_set_quiet(p, true);
+    int failed = 0;
+    for (int i = 0; i < NUM_CASES; i++) {
+        const Case *c = &cases[i];
+        char got[1024];
+        PeepholeStats st;
+        mem_init(p);
+        int status = mem_load_source(p, c->source);
+        if (status == DBH_OK) status = peephole_optimize(p, &st);
+        listing(p, got, sizeof(got));
+        bool ok = status == DBH_OK && strcmp(got, c->expected) == 0;
+        printf("%-45s %s\n", c->name, ok ? "PASS" : "FAIL");
+        if (!ok) {
+            fprintf(stderr, "status %s\ngot:\n%sexpected:\n%s", proc_strerror(status), got, c->expected);
+            failed++;
+        }
+    }
+    proc_destroy(p);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
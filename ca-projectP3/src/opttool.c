@@ -0,0 +1,174 @@
+#include "processor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// dbhopt: runs the peephole optimizer and then the block scheduler over a
+// program (-P and -S leave either out), then checks the result by
+// co-simulation: the original and the optimized program run from the same
+// initial data memory (all zero, then a few pseudo-random fills) and must end
+// with the same registers, SREG and data memory. Runs in which the original
+// does not finish within the cycle budget prove nothing and are skipped.
+
+#define TRIALS 4
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-P] [-S] [-v] [-l latency] [-c max_cycles] [-o out.txt] program.txt\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+// fills data memory for trial t; trial 0 is the program's own zero state
+static void fill_data(Processor *p, int t) {
+    uint32_t x = 2463534242u * (uint32_t)t;
+    for (int a = 0; a < 2048; a++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        p->data_mem[a] = t ? (uint8_t)x : 0;
+    }
+}
+
+static int run_to_end(Processor *p, uint64_t max_cycles) {
+    StopCond c = { max_cycles, 0, -1, -1, 0, -1, false };
+    return proc_run(p, &c);
+}
+
+static int write_program(const Processor *p, const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) return DBH_ERR_OPEN;
+    int end = 1024;
+    while (end > 0 && !p->instr_mem[end - 1]) end--;
+    for (int a = 0; a < end; a++) {
+        char line[32];
+        disassemble(p->instr_mem[a], line, sizeof(line));
+        fprintf(f, "%s\n", line);
+    }
+    return fclose(f) ? DBH_ERR_OPEN : DBH_OK;
+}
+
+int main(int argc, char *argv[]) {
+    const char *program = NULL;
+    const char *out = NULL;
+    int latency = 0;
+    uint64_t max_cycles = 10000000;
+    bool peephole = true;
+    bool schedule = true;
+    bool simd = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-P") == 0) {
+            peephole = false;
+        } else if (strcmp(argv[i], "-S") == 0) {
+            schedule = false;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            simd = true;
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            latency = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            max_cycles = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out = argv[++i];
+        } else if (argv[i][0] == '-' || program) {
+            usage(argv[0]);
+        } else {
+            program = argv[i];
+        }
+    }
+    if (!program || latency < 0 || latency > 0xFFFF || max_cycles == 0) {
+        usage(argv[0]);
+    }
+
+    Processor *orig = proc_create();
+    Processor *opt = proc_create();
+    Processor *a = proc_create();
+    Processor *b = proc_create();
+    if (!orig || !opt || !a || !b) {
+        fprintf(stderr, "%s\n", proc_strerror(DBH_ERR_NOMEM));
+        return EXIT_FAILURE;
+    }
+    orig->quiet = true;
+    orig->mem_latency = (uint16_t)latency;
+    orig->simd = simd;
+    if (mem_load_program(orig, program) != DBH_OK) {
+        fprintf(stderr, "%s\n", orig->error_msg);
+        return EXIT_FAILURE;
+    }
+    *opt = *orig;
+    PeepholeStats st = { 0 };
+    SchedStats ss = { 0 };
+    int status = peephole ? peephole_optimize(opt, &st) : DBH_OK;
+    if (status == DBH_OK && schedule) {
+        status = sched_blocks(opt, &ss);
+    }
+    if (status != DBH_OK) {
+        fprintf(stderr, "%s: %s\n", program, status == DBH_ERR_RANGE ? opt->error_msg : proc_strerror(status));
+        return EXIT_FAILURE;
+    }
+
+    int checked = 0;
+    int mismatches = 0;
+    uint64_t cycles_before = 0;
+    uint64_t cycles_after = 0;
+    uint64_t stalls_before = 0;
+    uint64_t stalls_after = 0;
+    double energy_before = 0.0;
+    double energy_after = 0.0;
+    for (int t = 0; t < TRIALS; t++) {
+        *a = *orig;
+        *b = *opt;
+        fill_data(a, t);
+        fill_data(b, t);
+        if (t == 0 && (energy_enable(a, NULL) != DBH_OK || energy_enable(b, NULL) != DBH_OK)) {
+            fprintf(stderr, "%s\n", proc_strerror(DBH_ERR_NOMEM));
+            return EXIT_FAILURE;
+        }
+        bool done = run_to_end(a, max_cycles) == STOP_DONE;
+        int r = done ? run_to_end(b, max_cycles) : STOP_DONE;
+        if (t == 0) {
+            energy_before = energy_total(a);
+            energy_after = energy_total(b);
+            energy_free(a);
+            energy_free(b);
+        }
+        if (!done) continue;
+        checked++;
+        if (t == 0) {
+            cycles_before = a->perf.cycles;
+            cycles_after = b->perf.cycles;
+            stalls_before = a->perf.stall_cycles;
+            stalls_after = b->perf.stall_cycles;
+        }
+        if (r != STOP_DONE || a->SREG != b->SREG ||
+            memcmp(a->Register, b->Register, sizeof(a->Register)) ||
+            memcmp(a->data_mem, b->data_mem, sizeof(a->data_mem))) {
+            fprintf(stderr, "%s: optimized program differs on data fill %d\n", program, t);
+            mismatches++;
+        }
+    }
+
+    if (peephole) {
+        printf("%s: %d removed, %d rewritten, %d jumps added\n", program, st.removed, st.rewritten, st.pads);
+    }
+    if (schedule) {
+        printf("%s: %d blocks reordered, %d instructions moved, modeled stalls %llu -> %llu\n", program,
+               ss.blocks, ss.moved, (unsigned long long)ss.stalls_before, (unsigned long long)ss.stalls_after);
+    }
+    if (cycles_before) {
+        printf("cycles %llu -> %llu (%.1f%% fewer), stalls %llu -> %llu\n", (unsigned long long)cycles_before,
+               (unsigned long long)cycles_after, 100.0 * ((double)cycles_before - (double)cycles_after) / (double)cycles_before,
+               (unsigned long long)stalls_before, (unsigned long long)stalls_after);
+        printf("energy %.1f -> %.1f pJ (%.1f%% less, default costs)\n", energy_before, energy_after,
+               100.0 * (energy_before - energy_after) / energy_before);
+    }
+    printf("co-simulation: %d of %d runs checked, %s\n", checked, TRIALS, mismatches ? "MISMATCH" : "ok");
+
+    if (!mismatches && out && write_program(opt, out) != DBH_OK) {
+        fprintf(stderr, "cannot write %s\n", out);
+        return EXIT_FAILURE;
+    }
+    proc_destroy(orig);
+    proc_destroy(opt);
+    proc_destroy(a);
+    proc_destroy(b);
+    return mismatches ? 2 : 0;
+}
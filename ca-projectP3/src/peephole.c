@@ -0,0 +1,410 @@
+#include "processor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Peephole optimizer for instruction memory. Within each reachable basic
+// block it tracks register constants and which register holds each data
+// byte, and applies these rules:
+//
+//   - an instruction that leaves its register unchanged (ADD Rx R0, SAL Rx 0,
+//     MOVI of the value already there, LDR of a byte just stored from or
+//     loaded into the same register) only sets flags
+//   - an ALU instruction with a constant result 0-63 whose flags match MOVI's
+//     becomes that MOVI, so it no longer reads its register
+//     ("SUB R1 R1, ADD R1 R11" with R11 known: the SUB becomes dead)
+//   - a STR of the value the byte already holds, or one overwritten by a
+//     later STR in the block before any LDR of it, is dropped
+//   - BEQZ with offset 0, or on a register known to be non-zero, is dropped
+//
+// and then removes every instruction whose register result and flags are
+// dead, using liveness over the whole control-flow graph. Everything is live
+// when the program ends, so final registers, SREG and data memory are kept.
+//
+// Removing instructions moves code, and BR targets are built in registers,
+// so resolved BR targets (see cfg_build()) keep their addresses. The code
+// between two of them is compacted towards the first; the freed slots are
+// unreachable when the run ends in a BR, become the halting empty word when
+// it ends in one, and otherwise are skipped with "BEQZ R0 n" if that still
+// saves cycles. LDR/STR on the counter and interrupt controller windows are
+// never touched. With the SIMD extension on, vector instructions are kept;
+// their lanes and the bytes they access are simply not tracked.
+
+#define OP_MOVI 3
+#define OP_BEQZ 4
+#define OP_BR   7
+#define OP_LDR  10
+#define OP_STR  11
+
+enum {
+    KEEP,
+    SETS_FLAGS_ONLY,   // leaves its register unchanged
+    DROP               // no effect at all, or dead
+};
+
+static bool reads_rs(uint8_t op) {
+    return op != OP_MOVI && op != OP_LDR;
+}
+
+static bool reads_rt(uint8_t op) {
+    return op <= 2 || op == 6 || op == OP_BR;
+}
+
+static bool counter_addr(uint8_t addr) {
+    return (addr >= COUNTER_MMIO_BASE && addr < COUNTER_MMIO_BASE + COUNTER_MMIO_SIZE) ||
+           (addr >= IRQ_MMIO_BASE && addr < IRQ_MMIO_BASE + IRQ_MMIO_SIZE);
+}
+
+// the SREG execute() leaves, see update_flags()
+static uint8_t flags_for(uint8_t op, uint8_t result, uint8_t v1, uint8_t v2) {
+    uint8_t sreg = 0;
+    if (result == 0) sreg |= FLAG_Z;
+    if (result & 0x80) sreg |= FLAG_N;
+    if (op == 0 || op == 1) {
+        uint16_t temp = op == 0 ? (uint16_t)v1 + v2 : (uint16_t)((int8_t)v1 - (int8_t)v2);
+        if (temp & 0x100) sreg |= FLAG_C;
+        if (((v1 ^ result) & (v2 ^ result)) >> 7) sreg |= FLAG_V;
+        if (((sreg & FLAG_N) >> 1) ^ (sreg & FLAG_V)) sreg |= FLAG_S;
+    }
+    return sreg;
+}
+
+// result of an ALU instruction with known operands, or -1
+static int alu(uint8_t op, uint8_t a, uint8_t b) {
+    switch (op) {
+        case 0: return (uint8_t)(a + b);
+        case 1: return (uint8_t)(a - b);
+        case 2: return (uint8_t)(a * b);
+        case 3: return b;
+        case 5: return a & b;
+        case 6: return a ^ b;
+        case 8: return b < 8 ? (uint8_t)(a << b) : -1;
+        case 9: return b < 8 ? (uint8_t)((int8_t)a >> b) : -1;
+    }
+    return -1;
+}
+
+typedef struct {
+    Cfg      cfg;
+    uint16_t word[1024];     // the program being rewritten
+    uint8_t  action[1024];   // KEEP, SETS_FLAGS_ONLY or DROP
+    uint64_t live_in[1024];  // per block; bit 0 stands for SREG (R0 is never live)
+    bool     frozen[1024];   // per block: left as it is
+    bool     simd;           // opcodes 13-15 are vector instructions
+} Peephole;
+
+// a VSTR, or a VLDR of a counter or interrupt controller register
+static bool simd_side_effect(uint16_t w) {
+    SimdOp v;
+    simd_decode(w, &v);
+    if (w >> 12 == 15) return v.lanes != 0;
+    for (int i = 0; w >> 12 == 14 && i < v.lanes; i++) {
+        if (counter_addr((uint8_t)(v.addr + i))) return true;
+    }
+    return false;
+}
+
+static void decode_word(uint16_t w, uint8_t *op, uint8_t *rs, uint8_t *rt) {
+    *op = w >> 12;
+    *rs = (w >> 6) & 0x3F;
+    *rt = w & 0x3F;
+}
+
+// Local rules, forward through one block. Facts do not cross block edges.
+static void simplify_block(Peephole *pp, const CfgBlock *b) {
+    int value[64];       // known register values, -1 if unknown
+    int holder[64];      // register equal to data[a], -1 if none
+    int last_store[64];  // address of the STR that wrote data[a] with no LDR since, -1
+    for (int i = 0; i < 64; i++) {
+        value[i] = i ? -1 : 0;
+        holder[i] = -1;
+        last_store[i] = -1;
+    }
+
+    for (int pc = b->start; pc <= b->end; pc++) {
+        uint8_t op, rs, rt;
+        decode_word(pp->word[pc], &op, &rs, &rt);
+        uint8_t imm = rt;
+        if (pp->action[pc] == DROP) continue;
+
+        if (op >= 13 && pp->simd) {
+            SimdOp v;
+            simd_decode(pp->word[pc], &v);
+            uint64_t lanes = simd_writes(pp->word[pc]);
+            for (int r = 1; r < 64; r++) {
+                if (!(lanes >> r & 1)) continue;
+                value[r] = -1;
+                for (int a = 0; a < 64; a++) {
+                    if (holder[a] == r) holder[a] = -1;
+                }
+            }
+            for (int i = 0; op != 13 && i < v.lanes && v.addr + i < 64; i++) {
+                last_store[v.addr + i] = -1;
+                if (op == 15) holder[v.addr + i] = -1;
+            }
+            continue;
+        }
+
+        if ((op == OP_STR || op == OP_LDR) && !counter_addr(imm)) {
+            if (op == OP_STR) {
+                if (holder[imm] == rs) {
+                    pp->action[pc] = DROP;
+                    continue;
+                }
+                if (last_store[imm] >= 0) pp->action[last_store[imm]] = DROP;
+                last_store[imm] = pc;
+                holder[imm] = rs;
+                continue;
+            }
+            last_store[imm] = -1;
+            if (rs != 0 && holder[imm] == rs) {
+                pp->action[pc] = SETS_FLAGS_ONLY;
+                continue;
+            }
+        } else if (op == OP_STR) {
+            continue;
+        } else if (op == OP_BEQZ) {
+            if (imm == 0 || value[rs] > 0) pp->action[pc] = DROP;
+            continue;
+        } else if (op == OP_BR) {
+            continue;
+        }
+
+        int v1 = value[rs];
+        int v2 = reads_rt(op) ? value[rt] : imm;
+        if ((op == 1 || op == 6) && rt == rs) {
+            v1 = v2 = 0;   // SUB Rx Rx and EOR Rx Rx give 0 and the same flags whatever Rx holds
+        }
+        int result = op == OP_MOVI ? imm :
+                     (op != OP_LDR && v1 >= 0 && v2 >= 0) ? alu(op, (uint8_t)v1, (uint8_t)v2) : -1;
+        bool same = (reads_rt(op) && rt == 0 && (op == 0 || op == 1 || op == 6)) ||
+                    ((op == 8 || op == 9) && imm == 0) ||
+                    (result >= 0 && result == value[rs]);
+        if (rs == 0) {
+            // writes to R0 are discarded, only the flags (and an LDR's access) remain
+            pp->action[pc] = SETS_FLAGS_ONLY;
+            continue;
+        }
+        if (same) {
+            pp->action[pc] = SETS_FLAGS_ONLY;
+            continue;
+        }
+        if (op != OP_MOVI && op != OP_LDR && result >= 0 && result <= 63 &&
+            flags_for(op, (uint8_t)result, (uint8_t)v1, (uint8_t)v2) == flags_for(OP_MOVI, (uint8_t)result, 0, 0)) {
+            pp->word[pc] = (uint16_t)(OP_MOVI << 12 | rs << 6 | result);
+        }
+        value[rs] = result;
+        for (int a = 0; a < 64; a++) {
+            if (holder[a] == rs) holder[a] = -1;
+        }
+        if (op == OP_LDR && !counter_addr(imm)) holder[imm] = rs;
+    }
+}
+
+// registers (bit n) and SREG (bit 0) the instruction at pc reads and writes
+static void effects(const Peephole *pp, int pc, uint64_t *use, uint64_t *def) {
+    uint8_t op, rs, rt;
+    decode_word(pp->word[pc], &op, &rs, &rt);
+    *use = *def = 0;
+    if (pp->action[pc] == DROP) return;
+    if (op >= 13 && pp->simd) {
+        SimdOp v;
+        simd_decode(pp->word[pc], &v);
+        *use = simd_reads(pp->word[pc]);
+        *def = simd_writes(pp->word[pc]) | (op != 15 && v.lanes);
+        return;
+    }
+    if (reads_rs(op) && rs) *use |= 1ULL << rs;
+    if (reads_rt(op) && rt) *use |= 1ULL << rt;
+    if (op_writes_rs(op)) {
+        *def = 1;
+        if (rs && pp->action[pc] == KEEP) *def |= 1ULL << rs;
+    }
+}
+
+// Global liveness, then drops instructions that have no effect but a dead
+// register write and dead flags. Returns the number dropped.
+static int remove_dead(Peephole *pp) {
+    const Cfg *g = &pp->cfg;
+    for (int i = 0; i < g->nblocks; i++) pp->live_in[i] = ~0ULL;
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (int i = g->nblocks - 1; i >= 0; i--) {
+            const CfgBlock *b = &g->blocks[i];
+            uint64_t live = b->exits || !b->reachable ? ~0ULL : 0;
+            for (int k = 0; k < b->nsucc; k++) live |= pp->live_in[g->succs[b->succ + k]];
+            for (int pc = b->end; pc >= b->start; pc--) {
+                uint64_t use, def;
+                effects(pp, pc, &use, &def);
+                live = (live & ~def) | use;
+            }
+            if (live != pp->live_in[i]) {
+                pp->live_in[i] = live;
+                changed = true;
+            }
+        }
+    }
+
+    int dropped = 0;
+    for (int i = 0; i < g->nblocks; i++) {
+        const CfgBlock *b = &g->blocks[i];
+        if (!b->reachable || pp->frozen[i]) continue;
+        uint64_t live = b->exits ? ~0ULL : 0;
+        for (int k = 0; k < b->nsucc; k++) live |= pp->live_in[g->succs[b->succ + k]];
+        for (int pc = b->end; pc >= b->start; pc--) {
+            uint8_t op, rs, rt;
+            decode_word(pp->word[pc], &op, &rs, &rt);
+            uint64_t use, def;
+            effects(pp, pc, &use, &def);
+            bool side = op == OP_STR || op == OP_BEQZ || op == OP_BR || (op == OP_LDR && counter_addr(rt)) ||
+                        (op >= 13 && pp->simd && simd_side_effect(pp->word[pc]));
+            if (pp->action[pc] != DROP && !side && !(def & live)) {
+                pp->action[pc] = DROP;
+                dropped++;
+                continue;
+            }
+            live = (live & ~def) | use;
+        }
+    }
+    return dropped;
+}
+
+// Lays the kept instructions out again. Returns false if a BEQZ can no
+// longer reach its target; *bad is then a segment whose removals to undo.
+static bool relocate(const Peephole *pp, const bool *anchor, uint16_t *out, int *bad, int *pads) {
+    uint16_t where[1024];   // new address of each old address
+    memset(out, 0, 1024 * sizeof(uint16_t));
+    *pads = 0;
+
+    for (int s = 0; s < 1024; ) {
+        if (!pp->word[s]) {
+            where[s] = (uint16_t)s;
+            s++;
+            continue;
+        }
+        int e = s + 1;
+        while (e < 1024 && pp->word[e] && !anchor[e]) e++;
+        int n = s;
+        for (int a = s; a < e; a++) {
+            where[a] = (uint16_t)n;
+            if (pp->action[a] != DROP) n++;
+        }
+        bool into_anchor = e < 1024 && pp->word[e];
+        // removed instructions at the end lead to whatever follows the segment
+        for (int a = e - 1; a >= s && pp->action[a] == DROP; a--) where[a] = (uint16_t)(into_anchor ? e : n);
+        if (n < e && into_anchor) {
+            // the gap before the next anchor must be unreachable or jumped over,
+            // and a jump (one cycle plus the flush) has to pay for itself
+            int last = e - 1;
+            while (last >= s && pp->action[last] == DROP) last--;
+            bool ends_in_br = last >= s && (pp->word[last] >> 12) == OP_BR;
+            if (!ends_in_br && e - n < 3) {
+                *bad = s;
+                return false;
+            }
+        }
+        s = e;
+    }
+
+    for (int s = 0; s < 1024; ) {
+        if (!pp->word[s]) {
+            s++;
+            continue;
+        }
+        int e = s + 1;
+        while (e < 1024 && pp->word[e] && !anchor[e]) e++;
+        int n = s;
+        uint16_t last_word = 0;
+        for (int a = s; a < e; a++) {
+            if (pp->action[a] == DROP) continue;
+            uint16_t w = pp->word[a];
+            if ((w >> 12) == OP_BEQZ) {
+                // a target past the end of memory keeps its offset if still past it
+                int target = a + 1 + (w & 0x3F);
+                int off = target >= 1024 ? (w & 0x3F) : where[target] - (n + 1);
+                if (off < 0 || off > 63 || (target >= 1024 && n + 1 + off < 1024)) {
+                    *bad = s;
+                    return false;
+                }
+                w = (uint16_t)((w & 0xFFC0) | off);
+            }
+            out[n++] = last_word = w;
+        }
+        if (n < e && e < 1024 && pp->word[e]) {
+            bool ends_in_br = (last_word >> 12) == OP_BR;
+            for (int a = n; a < e; a++) {
+                out[a] = ends_in_br ? last_word : (uint16_t)(OP_BEQZ << 12 | (e - a - 1));
+            }
+            *pads += ends_in_br ? 0 : 1;
+        }
+        s = e;
+    }
+    return true;
+}
+
+// one round of the rules and dead-code removal on the original program
+static void simplify(Peephole *pp, const Processor *p) {
+    const Cfg *g = &pp->cfg;
+    memcpy(pp->word, p->instr_mem, sizeof(pp->word));
+    memset(pp->action, KEEP, sizeof(pp->action));
+    for (int i = 0; i < g->nblocks; i++) {
+        if (g->blocks[i].reachable && !pp->frozen[i]) simplify_block(pp, &g->blocks[i]);
+    }
+    while (remove_dead(pp)) {
+    }
+}
+
+// Optimizes the program in p's instruction memory in place and reports what
+// changed. Breakpoints do not follow moved instructions, so set them after.
+// Fails with DBH_ERR_RANGE if a reachable BR has unknown targets, since code
+// could then not be moved safely, or if the program has an interrupt handler.
+int peephole_optimize(Processor *p, PeepholeStats *st) {
+    memset(st, 0, sizeof(*st));
+    Peephole *pp = calloc(1, sizeof(Peephole));
+    if (!pp) return DBH_ERR_NOMEM;
+    pp->simd = p->simd;
+    int status = cfg_build(p, &pp->cfg);
+    if (status == DBH_OK && pp->cfg.handler) {
+        snprintf(p->error_msg, sizeof(p->error_msg), "the program has an interrupt handler");
+        status = DBH_ERR_RANGE;
+    } else if (status == DBH_OK && pp->cfg.nunresolved) {
+        snprintf(p->error_msg, sizeof(p->error_msg), "a BR has unknown targets, code cannot be moved");
+        status = DBH_ERR_RANGE;
+    }
+    if (status != DBH_OK) {
+        free(pp);
+        return status;
+    }
+
+    const Cfg *g = &pp->cfg;
+    bool anchor[1024] = { true };
+    for (int i = 0; i < g->nblocks; i++) {
+        const CfgBlock *b = &g->blocks[i];
+        if (!b->reachable || (p->instr_mem[b->end] >> 12) != OP_BR) continue;
+        for (int k = 0; k < b->nsucc; k++) anchor[g->blocks[g->succs[b->succ + k]].start] = true;
+    }
+
+    // A segment that cannot be laid out again is left alone. Its removals
+    // may be what made code elsewhere dead, so everything is redone.
+    uint16_t out[1024];
+    int bad = 0;
+    simplify(pp, p);
+    while (!relocate(pp, anchor, out, &bad, &st->pads)) {
+        for (int a = bad; a < 1024 && p->instr_mem[a] && (a == bad || !anchor[a]); a++) {
+            pp->frozen[g->block_of[a]] = true;
+        }
+        simplify(pp, p);
+    }
+
+    for (int a = 0; a < 1024; a++) {
+        if (!p->instr_mem[a]) continue;
+        if (pp->action[a] == DROP) st->removed++;
+        else if (pp->word[a] != p->instr_mem[a]) st->rewritten++;
+    }
+    memcpy(p->instr_mem, out, sizeof(out));
+    for (uint16_t a = 0; a < 1024; a++) {
+        proc_predecode(p, a);
+    }
+    free(pp);
+    return DBH_OK;
+}
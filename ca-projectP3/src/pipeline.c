@@ -1,4 +1,5 @@
 #include "processor.h"
+#include "hostprof.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -38,7 +39,76 @@ static void update_flags(Processor *p, uint8_t result, uint8_t val1, uint8_t val
 //sign ADD and SUB instruction.
 //zero ADD, SUB, MUL, ANDI, EOR, SAL, and SAR 
 
-void fetch(Processor *p) {
+// true when the instruction at pc, waiting in IF/ID, cannot be decoded at the
+// given cycle: it touches a register with an LDR still in flight (pending), or
+// it is a memory access and the data memory port will still be busy when it
+// reaches EX
+static bool blocked(const Processor *p, uint16_t pc, uint64_t pending, uint64_t cycle) {
+    const Predecoded *d = &p->decoded[pc];
+    uint64_t used = 1ULL << d->rs;
+    if (!op_imm_format(d->opcode)) {
+        used |= 1ULL << d->rt;
+    }
+    bool mem = d->opcode == 10 || d->opcode == 11;
+    if (d->opcode >= 13 && p->simd) {
+        used = simd_reads(p->instr_mem[pc]) | simd_writes(p->instr_mem[pc]);
+        mem = d->opcode != 13;
+    }
+    if (pending & used) {
+        return true;
+    }
+    return mem && p->mem_busy_until > cycle + 1;
+}
+
+static bool decode_blocked(const Processor *p, uint64_t cycle) {
+    return blocked(p, p->IF_ID.pc, p->pending_regs, cycle);
+}
+
+// state of hardware thread t, in the Processor's fields or parked in SmtState
+static uint16_t thread_pc(const Processor *p, int t) {
+    return t == p->smt.cur ? p->PC : p->smt.pc[t];
+}
+
+static const IF_ID_Reg *thread_fetched(const Processor *p, int t) {
+    return t == p->smt.cur ? &p->IF_ID : &p->smt.fetched[t];
+}
+
+static uint64_t thread_pending(const Processor *p, int t) {
+    return t == p->smt.cur ? p->pending_regs : p->smt.pending[t];
+}
+
+static bool thread_blocked(const Processor *p, int t, uint64_t cycle) {
+    return blocked(p, thread_fetched(p, t)->pc, thread_pending(p, t), cycle);
+}
+
+// an instruction of any thread is waiting in IF/ID
+static bool any_fetched(const Processor *p) {
+    for (int t = 0; t < p->smt.nthreads; t++) {
+        if (thread_fetched(p, t)->valid) return true;
+    }
+    return p->IF_ID.valid;
+}
+
+// Refreshes the predecoded copy of instr_mem[addr]; call it after writing
+// instr_mem directly. The entry's PD_* flags are kept.
+void proc_predecode(Processor *p, uint16_t addr) {
+    uint16_t instruction = p->instr_mem[addr];
+    Predecoded *d = &p->decoded[addr];
+    d->opcode = (instruction >> 12) & 0x0F;
+    d->rs     = (instruction >> 6) & 0x3F;
+    if (op_imm_format(d->opcode)) {
+        d->imm = (int8_t)(instruction & 0x3F);
+        d->rt  = 0;
+    } else {
+        d->imm = 0;
+        d->rt  = instruction & 0x3F;
+    }
+}
+
+static void fetch(Processor *p) {
+  if (p->IF_ID.valid) {
+      return; // decode is stalled, hold the fetched instruction
+  }
   if (p->PC < 1024) {
       uint16_t instruction = p->instr_mem[p->PC];
       if (instruction == 0) {
@@ -52,24 +122,24 @@ void fetch(Processor *p) {
   }
 }
 
-void decode(Processor *p) {
+static void decode(Processor *p) {
     if (!p->IF_ID.valid) {
         return;
     }
-    uint16_t instruction = p->IF_ID.instr;
+    if (decode_blocked(p, p->cycle)) {
+        p->perf.stall_cycles++;
+        return;
+    }
+    const Predecoded *d = &p->decoded[p->IF_ID.pc];
     ID_EX_Reg E = {0};
-    E.instr   = instruction;
+    E.instr   = p->IF_ID.instr;
     E.pc      = p->IF_ID.pc;
-    E.opcode  = (instruction >> 12) & 0x0F;
-    E.rs      = (instruction >> 6) & 0x3F;
- 
-    if (E.opcode == 3 || E.opcode == 4 || E.opcode == 5 || E.opcode == 10 || E.opcode == 11 ||E.opcode == 8 ||E.opcode == 9) {
-        E.imm = (int16_t)((int8_t)(instruction & 0x3F));
-        E.rt=0;
-    } else {
-        E.imm=0;
-        E.rt = (int16_t)((int8_t)(instruction & 0x3F));
-    }
+    E.opcode  = d->opcode;
+    E.rs      = d->rs;
+    E.rt      = d->rt;
+    E.imm     = d->imm;
+    E.thread  = p->smt.cur;
+    p->run_hits |= d->flags & (PD_STOP_PC | PD_BREAK);
     E.valueRS = p->Register[E.rs];
     E.valueRT = p->Register[E.rt];
     E.valid   = true;
@@ -77,7 +147,7 @@ void decode(Processor *p) {
     p->IF_ID.valid = false;
 }
 
-void execute(Processor *p) {
+static void execute(Processor *p) {
   if (!p->ID_EX.valid) {
     return;
   }
@@ -92,6 +162,15 @@ void execute(Processor *p) {
 
   bool flag = false;
 
+  p->perf.instret++;
+  p->perf.op_count[opcode]++;
+  if (p->regstats) {
+      regstats_record(p, opcode, rs, rt);
+  }
+  if (p->energy) {
+      energy_record(p, opcode, rs);
+  }
+
   switch (opcode) {
       case 0b0000: result = val1 + val2; break;               // ADD R1 R2
       case 0b0001: result = val1 - val2; break;               // SUB R1 R2
@@ -101,18 +180,27 @@ void execute(Processor *p) {
       case 0b0110: result = val1 ^ val2; break;               // EOR R1  R2
       case 0b1000: result = val1 << val2; break;              // SAL R1 R2
       case 0b1001: result = ((int8_t)val1) >> val2; break;    // SAR R1 R2
-      case 0b1010: result = mem_read_data(p, immediate); break; // LDR R1 IMM
+      case 0b1010:  // LDR R1 IMM
+          result = mem_read_data(p, immediate);
+          p->perf.loads++;
+          break;
 
       case 0b1011:  // STR R1 IMM
+          p->perf.stores++;
           mem_write_data(p, immediate, p->Register[rs]);
+          p->run_hits |= p->decoded[p->ID_EX.pc].flags & PD_STOP_WRITE;
           flag = true;
           break;
 
       case 0b0100:  // BEQZ R1 IMM
           if (p->Register[rs] == 0) {
               p->PC = p->ID_EX.pc + 1 + immediate;
+              if (p->prof) profile_flush(p, p->ID_EX.pc, p->PC);
+              if (p->energy) energy_flush(p, p->ID_EX.pc);
               p->IF_ID.valid = false;
               p->ID_EX.valid = false;
+              p->perf.taken_branches++;
+              p->perf.flushes++;
               return;
           }
           flag = true;
@@ -120,18 +208,57 @@ void execute(Processor *p) {
 
       case 0b0111:  // BR R1 R2
           p->PC = ((uint16_t)p->Register[rs] << 8) | p->Register[rt];
+          if (p->prof) profile_flush(p, p->ID_EX.pc, p->PC);
+          if (p->energy) energy_flush(p, p->ID_EX.pc);
           p->IF_ID.valid = false;
           p->ID_EX.valid = false;
+          p->perf.taken_branches++;
+          p->perf.flushes++;
           return;
 
+      case 0b1100:  // RETI
+          if (irq_return(p)) {
+              if (p->energy) energy_flush(p, p->ID_EX.pc);
+              p->IF_ID.valid = false;
+              p->ID_EX.valid = false;
+              p->perf.flushes++;
+              return;
+          }
+          flag = true;
+          break;
+
+      case 0b1101:  // VADD VSUB VEOR VDOT
+      case 0b1110:  // VLDR
+      case 0b1111:  // VSTR
+          if (p->simd) simd_execute(p);
+          flag = true;
+          break;
+
       default:
           flag = true;
           break;
   }
 
+  if ((opcode == 0b1010 || opcode == 0b1011) && p->mem_latency) {
+      p->mem_busy_until = p->cycle + p->mem_latency;
+      p->mem_op_pc = p->ID_EX.pc;
+  }
+
   if (!flag) {
-      if (rs != 0) {
+      if (opcode == 0b1010 && p->mem_latency) {
+          // the loaded value arrives mem_latency cycles later; flags are set now
+          if (rs != 0) {
+              Event e = { p->cycle + p->mem_latency, EV_MEM_WRITEBACK, rs, result, p->ID_EX.pc, p->ID_EX.thread };
+              if (!evq_push(&p->events, e)) {
+                  snprintf(p->error_msg, sizeof(p->error_msg), "event queue overflow at cycle %llu",
+                           (unsigned long long)p->cycle);
+                  p->error = DBH_ERR_EVENTS;
+              }
+              p->pending_regs |= 1ULL << rs;
+          }
+      } else if (rs != 0) {
           p->Register[rs] = result;
+          p->run_hits |= p->decoded[p->ID_EX.pc].flags & PD_STOP_REG;
       }
       update_flags(p, result, val1, val2, opcode);
   }// 34an mayekteb4 f R0
@@ -140,34 +267,360 @@ void execute(Processor *p) {
 }
 
 
-void process_cycle(Processor *p) {
-   
-    p->EX_instr = p->ID_EX.instr;
-    p->EX_pc    = p->ID_EX.pc;
-    p->EX_valid = p->ID_EX.valid;
+static void retire_events(Processor *p) {
+    while (p->events.count && p->events.heap[0].cycle <= p->cycle) {
+        Event e = evq_pop(&p->events);
+        if (e.kind == EV_MEM_WRITEBACK) {
+            if (e.thread == p->smt.cur) {
+                p->Register[e.reg] = e.value;
+                p->pending_regs &= ~(1ULL << e.reg);
+            } else {
+                p->smt.regs[e.thread][e.reg] = e.value;
+                p->smt.pending[e.thread] &= ~(1ULL << e.reg);
+            }
+            p->run_hits |= p->decoded[e.pc].flags & PD_STOP_REG;
+        }
+    }
+}
+
+// One cycle of the stages shared by the SMT threads: EX for the thread in
+// ID/EX, decode for the next thread in turn whose instruction is ready, and
+// fetch for the thread the fetch policy picks. ICOUNT counts a thread's
+// instruction in ID/EX and its loads in flight; its IF/ID slot is empty.
+static void smt_stages(Processor *p) {
+    SmtState *s = &p->smt;
+    int n = s->nthreads;
+
+    if (p->ID_EX.valid) {
+        smt_switch(p, p->ID_EX.thread);
+    }
+    p->EX_instr  = p->ID_EX.instr;
+    p->EX_pc     = p->ID_EX.pc;
+    p->EX_thread = p->ID_EX.thread;
+    p->EX_valid  = p->ID_EX.valid;
+    HOSTPROF_BEGIN(HP_EXECUTE);
     execute(p);
-    decode(p);
-    if (p->PC < 1024) {
+    HOSTPROF_END(HP_EXECUTE);
+    if (p->EX_valid) {
+        s->instret[p->EX_thread]++;
+    }
+
+    HOSTPROF_BEGIN(HP_DECODE);
+    int pick = -1;
+    int waiting = -1;
+    for (int k = 0; k < n; k++) {
+        int t = (s->next_decode + k) % n;
+        if (!thread_fetched(p, t)->valid) continue;
+        if (waiting < 0) waiting = t;
+        if (!thread_blocked(p, t, p->cycle)) {
+            pick = t;
+            break;
+        }
+    }
+    if (pick < 0) {
+        pick = waiting;   // nothing is ready: decode() counts the stall
+    }
+    if (pick >= 0) {
+        smt_switch(p, pick);
+        decode(p);
+        if (!p->IF_ID.valid) s->next_decode = (uint8_t)((pick + 1) % n);
+        for (int t = 0; t < n; t++) {
+            if (thread_fetched(p, t)->valid) s->waits[t]++;
+        }
+    }
+    HOSTPROF_END(HP_DECODE);
+
+    HOSTPROF_BEGIN(HP_FETCH);
+    int f = -1;
+    int best = 0;
+    for (int k = 0; k < n; k++) {
+        int t = (s->next_fetch + k) % n;
+        if (thread_pc(p, t) >= 1024 || thread_fetched(p, t)->valid) continue;
+        if (s->policy == SMT_ROUND_ROBIN) {
+            f = t;
+            break;
+        }
+        int count = (p->ID_EX.valid && p->ID_EX.thread == t) + __builtin_popcountll(thread_pending(p, t));
+        if (f < 0 || count < best) {
+            f = t;
+            best = count;
+        }
+    }
+    if (f >= 0) {
+        smt_switch(p, f);
         fetch(p);
-    } 
+        s->fetches[f] += p->IF_ID.valid;
+        s->next_fetch = (uint8_t)((f + 1) % n);
+    }
+    HOSTPROF_END(HP_FETCH);
+
+    for (int t = 0; t < n; t++) {
+        if (!s->done_cycle[t] && thread_pc(p, t) >= 1024 && !thread_fetched(p, t)->valid &&
+            !(p->ID_EX.valid && p->ID_EX.thread == t) && !thread_pending(p, t)) {
+            s->done_cycle[t] = p->cycle;
+        }
+    }
+}
+
+void process_cycle(Processor *p) {
+    p->cycle++;
+    p->perf.cycles++;
+    HOSTPROF_BEGIN(HP_EVENTS);
+    retire_events(p);
+    HOSTPROF_END(HP_EVENTS);
+    if (p->irq.on) {
+        irq_cycle(p);
+    }
+
+    if (p->smt.nthreads) {
+        smt_stages(p);
+    } else {
+        p->EX_instr = p->ID_EX.instr;
+        p->EX_pc    = p->ID_EX.pc;
+        p->EX_valid = p->ID_EX.valid;
+        HOSTPROF_BEGIN(HP_EXECUTE);
+        execute(p);
+        HOSTPROF_END(HP_EXECUTE);
+        HOSTPROF_BEGIN(HP_DECODE);
+        decode(p);
+        HOSTPROF_END(HP_DECODE);
+        if (p->PC < 1024) {
+            HOSTPROF_BEGIN(HP_FETCH);
+            fetch(p);
+            HOSTPROF_END(HP_FETCH);
+        }
+    }
+    if (p->prof) {
+        profile_cycle(p);
+    }
+    if (p->irq.entering && p->EX_valid) {
+        irq_entered(p);
+    }
+    if (p->irq.returning && p->EX_valid && p->EX_pc == p->irq.epc) {
+        p->irq.returning = false;
+    }
+    if (p->energy) {
+        energy_cycle(p);
+    }
+    if (p->tt) {
+        tt_cycle(p);
+    }
+}
+
+// true while anything is left in flight: a stage, the fetch stream or a
+// delayed writeback, and no error has stopped the run
+bool proc_running(const Processor *p) {
+    if (p->error) {
+        return false;
+    }
+    return p->IF_ID.valid || p->ID_EX.valid || p->EX_valid || p->PC < 1024 || p->events.count ||
+           (p->smt.nthreads && smt_alive(p));
+}
+
+// Nothing can move until the next timing event (or the memory port frees up)
+// when EX is empty and decode is stalled, or only writebacks are left.
+bool proc_is_idle(const Processor *p) {
+    if (p->ID_EX.valid) {
+        return false;
+    }
+    if (p->smt.nthreads) {
+        // idle when no thread can decode or fetch
+        bool waiting = false;
+        for (int t = 0; t < p->smt.nthreads; t++) {
+            if (thread_fetched(p, t)->valid) {
+                if (!thread_blocked(p, t, p->cycle + 1)) return false;
+                waiting = true;
+            } else if (thread_pc(p, t) < 1024) {
+                return false;
+            }
+        }
+        return waiting || p->events.count > 0;
+    }
+    if (p->IF_ID.valid) {
+        return decode_blocked(p, p->cycle + 1);
+    }
+    return p->PC >= 1024 && p->events.count > 0;
+}
+
+// Jumps the cycle counter to just before the next cycle in which the pipeline
+// can make progress, but no further than limit - 1. Returns the number of idle
+// cycles skipped; the following process_cycle() then lands exactly where
+// stepping would have.
+static uint64_t skip_idle(Processor *p, uint64_t limit) {
+    HOSTPROF_BEGIN(HP_EVENTS);
+    if (!proc_is_idle(p)) {
+        HOSTPROF_END(HP_EVENTS);
+        return 0;
+    }
+    uint64_t next = UINT64_MAX;
+    bool fetched = any_fetched(p);
+    if (p->events.count) {
+        next = p->events.heap[0].cycle;
+    }
+    if (fetched && p->mem_busy_until > p->cycle + 1 && p->mem_busy_until - 1 < next) {
+        next = p->mem_busy_until - 1;
+    }
+    if (p->irq.on && irq_next_event(p) < next) {
+        next = irq_next_event(p);
+    }
+    if (next > limit) {
+        next = limit;
+    }
+    if (next == UINT64_MAX || next <= p->cycle + 1) {
+        HOSTPROF_END(HP_EVENTS);
+        return 0;
+    }
+    uint64_t skipped = next - p->cycle - 1;
+    p->cycle = next - 1;
+    p->perf.cycles += skipped;
+    if (fetched) {
+        p->perf.stall_cycles += skipped;
+    }
+    for (int t = 0; t < p->smt.nthreads; t++) {
+        if (thread_fetched(p, t)->valid) p->smt.waits[t] += skipped;
+    }
+    if (p->prof) {
+        profile_skip(p, skipped);
+    }
+    if (p->energy) {
+        energy_skip(p, skipped);
+    }
+    HOSTPROF_END(HP_EVENTS);
+    return skipped;
+}
+
+uint64_t proc_skip_idle(Processor *p) {
+    return skip_idle(p, UINT64_MAX);
+}
+
+// Compiles the PC, register and store conditions into PD_STOP_* flags on the
+// predecoded instructions that can trigger them, or removes them again. Hits
+// are looked up here when the instruction executes or its load retires, so
+// an instruction already in flight when a run ends cannot report it later.
+static void arm_stop(Processor *p, const StopCond *c, bool on) {
+    if (c->pc >= 0 && c->pc < 1024) {
+        if (on) p->decoded[c->pc].flags |= PD_STOP_PC;
+        else    p->decoded[c->pc].flags &= ~PD_STOP_PC;
+    }
+    bool reg = c->reg > 0 && c->reg < 64;  // R0 never changes
+    if (!reg && c->write_addr < 0) {
+        return;
+    }
+    for (int i = 0; i < 1024; i++) {
+        Predecoded *d = &p->decoded[i];
+        uint8_t mark = 0;
+        if (reg && op_writes_rs(d->opcode) && d->rs == c->reg) {
+            mark |= PD_STOP_REG;
+        }
+        if (d->opcode == 11 && d->imm == c->write_addr) {
+            mark |= PD_STOP_WRITE;
+        }
+        if (d->opcode >= 13 && p->simd) {
+            SimdOp v;
+            simd_decode(p->instr_mem[i], &v);
+            if (reg && (simd_writes(p->instr_mem[i]) >> c->reg & 1)) {
+                mark |= PD_STOP_REG;
+            }
+            if (d->opcode == 15 && c->write_addr >= v.addr && c->write_addr < v.addr + v.lanes) {
+                mark |= PD_STOP_WRITE;
+            }
+        }
+        if (on) d->flags |= mark;
+        else    d->flags &= ~mark;
+    }
+}
+
+// Breakpoints live in the predecoded entry, so setting or clearing one touches
+// only that instruction and runs without breakpoints pay nothing for them.
+// They survive proc_predecode() and reloading a program, but not mem_init().
+void proc_set_breakpoint(Processor *p, uint16_t addr) {
+    if (addr < 1024) p->decoded[addr].flags |= PD_BREAK;
+}
+
+void proc_clear_breakpoint(Processor *p, uint16_t addr) {
+    if (addr < 1024) p->decoded[addr].flags &= ~PD_BREAK;
+}
+
+bool proc_has_breakpoint(const Processor *p, uint16_t addr) {
+    return addr < 1024 && (p->decoded[addr].flags & PD_BREAK);
+}
+
+// Runs until the program finishes, an error stops it, a breakpoint is reached
+// or a condition in cond (NULL for none) is met, and returns the STOP_* reason. Budgets are compared
+// once per cycle; everything else only costs time when a flagged instruction
+// passes through the pipeline. On STOP_PC the instruction sits in ID/EX and
+// executes first thing when the run is resumed.
+int proc_run(Processor *p, const StopCond *cond) {
+    static const StopCond none = { 0, 0, -1, -1, 0, -1, false };
+    if (!cond) {
+        cond = &none;
+    }
+    uint64_t end_cycle = cond->max_cycles ? p->cycle + cond->max_cycles : UINT64_MAX;
+    uint64_t end_instret = cond->max_instructions ? p->perf.instret + cond->max_instructions : UINT64_MAX;
+    bool reg = cond->reg > 0 && cond->reg < 64;
+    arm_stop(p, cond, true);
+    p->run_hits = 0;
+
+    int reason = STOP_DONE;
+    while (proc_running(p)) {
+        if (p->cycle >= end_cycle) {
+            reason = STOP_CYCLES;
+            break;
+        }
+        skip_idle(p, end_cycle);
+        process_cycle(p);
+        if (p->run_hits) {
+            uint8_t hits = p->run_hits;
+            p->run_hits = 0;
+            if (hits & PD_WATCH) {
+                reason = STOP_WATCH;
+                break;
+            }
+            if (hits & PD_STOP_WRITE) {
+                reason = STOP_WRITE;
+                break;
+            }
+            if ((hits & PD_STOP_REG) && reg && (cond->reg_written || p->Register[cond->reg] == cond->reg_value)) {
+                reason = STOP_REG;
+                break;
+            }
+            if (hits & PD_BREAK) {
+                reason = STOP_BREAK;
+                break;
+            }
+            if (hits & PD_STOP_PC) {
+                reason = STOP_PC;
+                break;
+            }
+        }
+        if (p->perf.instret >= end_instret) {
+            reason = STOP_INSTRUCTIONS;
+            break;
+        }
+    }
+    if (p->error) {
+        reason = STOP_ERROR;
+    }
+    arm_stop(p, cond, false);
+    return reason;
 }
 
 void print_registers(const Processor *p) {
-    printf("Registers:\n");
+    proc_printf(p, "Registers:\n");
     int m = 0;
     for (int i = 0; i < 64; i++) {
-        printf("R%02d: 0x%02X  ", i, p->Register[i]);
+        proc_printf(p, "R%02d: 0x%02X  ", i, p->Register[i]);
         if (p->Register[i] && i != 0) {
             m = 1;
         }
         if ((i & 7) == 7) {
-            printf("\n");
+            proc_printf(p, "\n");
         }
     }
     if (!m) {
-        printf("(all zero except R0)\n");
+        proc_printf(p, "(all zero except R0)\n");
     }
-    printf("SREG: [%c%c%c%c%c]\n",
+    proc_printf(p, "SREG: [%c%c%c%c%c]\n",
            (p->SREG & FLAG_C) ? 'C' : '-',
            (p->SREG & FLAG_V) ? 'V' : '-',
            (p->SREG & FLAG_N) ? 'N' : '-',
@@ -176,31 +629,36 @@ void print_registers(const Processor *p) {
 }
 
 void print_pipeline(const Processor *p, int cycle) {
-    static char if_buffer[64], id_buffer[128], ex_buffer[128];
-    printf("Clock Cycle %d\n", cycle);
+    char if_buffer[64], id_buffer[128], ex_buffer[128];
+    proc_printf(p, "Clock Cycle %d\n", cycle);
    
     if (p->IF_ID.valid)
-        sprintf(if_buffer, "Instruction %d (PC=%d)", p->IF_ID.pc + 1, p->IF_ID.pc);
+        snprintf(if_buffer, sizeof(if_buffer), "Instruction %d (PC=%d)", p->IF_ID.pc + 1, p->IF_ID.pc);
     else
-        sprintf(if_buffer, "-");
+        snprintf(if_buffer, sizeof(if_buffer), "-");
  
     if (p->ID_EX.valid){
-        if ( p->ID_EX.opcode == 3 ||  p->ID_EX.opcode == 4 ||  p->ID_EX.opcode == 5 ||  p->ID_EX.opcode == 10 ||  p->ID_EX.opcode == 11 || p->ID_EX.opcode == 8 || p->ID_EX.opcode == 9) {
-          sprintf(id_buffer, "Instruction %d (opcode=%d, rs=R%d=%d, , imm=%d)", 
+        if (op_imm_format(p->ID_EX.opcode)) {
+          snprintf(id_buffer, sizeof(id_buffer), "Instruction %d (opcode=%d, rs=R%d=%d, , imm=%d)", 
             p->ID_EX.pc + 1, p->ID_EX.opcode, p->ID_EX.rs, p->ID_EX.valueRS, p->ID_EX.imm);
     } else {
-         sprintf(id_buffer, "Instruction %d (opcode=%d, rs=R%d=%d, rt=R%d=%d)", 
+         snprintf(id_buffer, sizeof(id_buffer), "Instruction %d (opcode=%d, rs=R%d=%d, rt=R%d=%d)", 
             p->ID_EX.pc + 1, p->ID_EX.opcode, p->ID_EX.rs, p->ID_EX.valueRS, p->ID_EX.rt, p->ID_EX.valueRT);
         
             }
         }
     else
-        sprintf(id_buffer, "-");
+        snprintf(id_buffer, sizeof(id_buffer), "-");
   
     if (p->EX_valid)
-        sprintf(ex_buffer, "Instruction %d (PC=%d)", p->EX_pc + 1, p->EX_pc);
+        snprintf(ex_buffer, sizeof(ex_buffer), "Instruction %d (PC=%d)", p->EX_pc + 1, p->EX_pc);
     else
-        sprintf(ex_buffer, "-");
-    printf("| %-30s | %-60s | %-30s |\n", if_buffer, id_buffer, ex_buffer);
+        snprintf(ex_buffer, sizeof(ex_buffer), "-");
+    if (p->smt.nthreads) {
+        proc_printf(p, "| T%d %-27s | T%d %-57s | T%d %-27s |\n", p->smt.cur, if_buffer,
+                    p->ID_EX.thread, id_buffer, p->EX_thread, ex_buffer);
+        return;
+    }
+    proc_printf(p, "| %-30s | %-60s | %-30s |\n", if_buffer, id_buffer, ex_buffer);
 }
 
@@ -0,0 +1,180 @@
+#include "processor.h"
+#include <string.h>
+
+// Partial evaluation of a program's input-independent prefix. Programs often
+// start by building constants and tables with MOVI/SAL/ADD/STR chains that
+// do not depend on their input, and a batch of runs over different inputs
+// repeats that work every time. prefix_run() finds how far execution gets
+// before the first instruction that reads an input and runs the machine up
+// to that point; the result is a checkpoint that prefix_set_input() turns
+// into the state of any run over a given input, as if it had started at
+// cycle 0.
+//
+// The prefix is found with a functional model (values only, no pipeline)
+// that knows which registers and data bytes still hold input. It stops
+// before an instruction that reads one, touches the counter or interrupt
+// controller window, or shifts by a count the model does not evaluate;
+// packed SIMD instructions are evaluated lane by lane. The checkpoint itself
+// is made by the real pipeline, so cycles, counters and in-flight loads are
+// exact.
+
+// instructions that use Register[rs] as an operand
+static bool reads_rs(uint8_t opcode) {
+    return opcode != 3 && opcode != 10;
+}
+
+static bool reads_rt(uint8_t opcode) {
+    return opcode <= 2 || opcode == 6 || opcode == 7;
+}
+
+static bool in_counter_window(const Processor *p, uint16_t addr) {
+    return (p->counter_mmio && addr >= COUNTER_MMIO_BASE && addr < COUNTER_MMIO_BASE + COUNTER_MMIO_SIZE) ||
+           (p->irq.on && addr >= IRQ_MMIO_BASE && addr < IRQ_MMIO_BASE + IRQ_MMIO_SIZE);
+}
+
+// a packed SIMD instruction, evaluated like the others; false if it depends
+// on an input or touches a window
+static bool simd_step(const Processor *p, uint16_t pc, uint8_t *R, uint64_t *regs_known,
+                      uint8_t *data, uint8_t *data_known, Prefix *out) {
+    uint16_t w = p->instr_mem[pc];
+    uint8_t op = w >> 12;
+    SimdOp v;
+    simd_decode(w, &v);
+    if (simd_reads(w) & ~*regs_known) return false;
+    for (int i = 0; op != 13 && i < v.lanes; i++) {
+        uint8_t a = (uint8_t)(v.addr + i);
+        if (in_counter_window(p, a)) return false;
+        if (op == 14 && !(data_known[a >> 3] >> (a & 7) & 1)) return false;
+    }
+    if (op == 13) {
+        simd_alu(w, R, 0);
+    }
+    for (int i = 0; op != 13 && i < v.lanes; i++) {
+        uint8_t a = (uint8_t)(v.addr + i);
+        if (op == 14 && v.vd + i != 0) {
+            R[v.vd + i] = data[a];
+        } else if (op == 15) {
+            data[a] = R[v.vd + i];
+            data_known[a >> 3] |= 1 << (a & 7);
+            out->data_written[a >> 3] |= 1 << (a & 7);
+        }
+    }
+    *regs_known |= simd_writes(w);
+    out->regs_written |= simd_writes(w);
+    return true;
+}
+
+// Number of instructions executed from p's current PC before one depends on
+// an input, at most limit. Fills in what they write.
+static uint64_t independent_length(const Processor *p, uint8_t inputs, uint64_t limit, Prefix *out) {
+    uint8_t R[64];
+    uint8_t data[2048];
+    uint8_t data_known[2048 / 8];
+    uint64_t regs_known = (inputs & PREFIX_INPUT_REGS) ? 1 : ~0ULL;   // R0 is always 0
+    memcpy(R, p->Register, sizeof(R));
+    memcpy(data, p->data_mem, sizeof(data));
+    memset(data_known, (inputs & PREFIX_INPUT_DATA) ? 0x00 : 0xFF, sizeof(data_known));
+
+    uint16_t pc = p->PC;
+    uint64_t n = 0;
+    while (n < limit && pc < 1024 && p->instr_mem[pc]) {
+        const Predecoded *d = &p->decoded[pc];
+        uint8_t op = d->opcode, rs = d->rs, rt = d->rt;
+        uint8_t imm = (uint8_t)d->imm;
+        if (op >= 13 && p->simd) {
+            if (!simd_step(p, pc, R, &regs_known, data, data_known, out)) break;
+            n++;
+            pc++;
+            continue;
+        }
+        if ((reads_rs(op) && !(regs_known >> rs & 1)) || (reads_rt(op) && !(regs_known >> rt & 1))) break;
+        if ((op == 10 || op == 11) && in_counter_window(p, imm)) break;
+        if (op == 10 && !(data_known[imm >> 3] >> (imm & 7) & 1)) break;
+        if ((op == 8 || op == 9) && imm >= 8) break;
+        n++;
+
+        uint8_t a = R[rs], b = reads_rt(op) ? R[rt] : imm, result = 0;
+        switch (op) {
+            case 0:  result = a + b; break;
+            case 1:  result = a - b; break;
+            case 2:  result = a * b; break;
+            case 3:  result = imm; break;
+            case 5:  result = a & b; break;
+            case 6:  result = a ^ b; break;
+            case 8:  result = a << b; break;
+            case 9:  result = (uint8_t)((int8_t)a >> b); break;
+            case 10: result = data[imm]; break;
+            case 11:
+                data[imm] = a;
+                data_known[imm >> 3] |= 1 << (imm & 7);
+                out->data_written[imm >> 3] |= 1 << (imm & 7);
+                break;
+            case 4:
+                if (a == 0) {
+                    pc = pc + 1 + imm;
+                    continue;
+                }
+                break;
+            case 7:
+                pc = (uint16_t)(a << 8 | b);
+                continue;
+        }
+        if (op_writes_rs(op) && rs != 0) {
+            R[rs] = result;
+            regs_known |= 1ULL << rs;
+            out->regs_written |= 1ULL << rs;
+        }
+        pc++;
+    }
+    return n;
+}
+
+// Runs the input-independent prefix of the program loaded in p (which must
+// not have started yet) for at most limit instructions. inputs says which
+// parts of the initial state vary between runs (PREFIX_INPUT_* bits); their
+// current contents in p are ignored. Afterwards p is the checkpoint and out
+// describes it. Returns DBH_OK or the error that stopped the prefix, and
+// DBH_ERR_RANGE when external interrupts are scheduled (see irq_schedule())
+// or several threads run (see smt_enable()).
+int prefix_run(Processor *p, uint8_t inputs, uint64_t limit, Prefix *out) {
+    memset(out, 0, sizeof(*out));
+    out->inputs = inputs;
+    if (p->cycle != 0 || p->irq.nsched || p->smt.nthreads) return DBH_ERR_RANGE;
+    uint64_t n = independent_length(p, inputs, limit, out);
+    if (n) {
+        StopCond c = { 0, n, -1, -1, 0, -1, false };
+        while (p->perf.instret < n) {
+            c.max_instructions = n - p->perf.instret;
+            int r = proc_run(p, &c);
+            if (r == STOP_DONE || r == STOP_ERROR) break;
+        }
+    }
+    out->instructions = p->perf.instret;
+    out->cycles = p->cycle;
+    return p->error;
+}
+
+// Turns a copy of the checkpoint into the state of a run whose initial data
+// memory starts with data[0 .. len-1] (the rest zero) and, when regs is not
+// NULL, whose registers start as regs. Bytes and registers the prefix wrote
+// keep their prefix values, exactly as in a full run.
+int prefix_set_input(Processor *p, const Prefix *pre, const uint8_t *data, size_t len, const uint8_t *regs) {
+    if (len > 2048 || (len && !(pre->inputs & PREFIX_INPUT_DATA)) ||
+        (regs && !(pre->inputs & PREFIX_INPUT_REGS))) {
+        return DBH_ERR_RANGE;
+    }
+    for (size_t a = 0; a < len; a++) {
+        if (!(pre->data_written[a >> 3] >> (a & 7) & 1)) p->data_mem[a] = data[a];
+    }
+    if (regs) {
+        for (int r = 1; r < 64; r++) {
+            if (!(pre->regs_written >> r & 1)) p->Register[r] = regs[r];
+        }
+        // the instruction after the prefix may already have read its operands
+        if (p->ID_EX.valid) {
+            p->ID_EX.valueRS = p->Register[p->ID_EX.rs];
+            p->ID_EX.valueRT = p->Register[p->ID_EX.rt];
+        }
+    }
+    return DBH_OK;
+}
@@ -1,15 +1,247 @@
 #include "processor.h"
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+static void stdout_sink(void *ctx, const char *text) {
+    (void)ctx;
+    fputs(text, stdout);
+}
 
 void proc_init(Processor *p) {
     memset(p, 0, sizeof(Processor));
     p->PC = 0; 
     p->IF_ID.valid = false;
     p->ID_EX.valid = false;
+    p->output = stdout_sink;
+}
+
+// heap-allocated, initialised Processor for hosts that embed the simulator
+Processor *proc_create(void) {
+    Processor *p = malloc(sizeof(Processor));
+    if (p) {
+        proc_init(p);
+        mem_init(p);
+    }
+    return p;
+}
+
+void proc_destroy(Processor *p) {
+    if (!p) return;
+    profile_free(p);
+    regstats_free(p);
+    energy_free(p);
+    tt_free(p);
+    free(p);
+}
+
+void proc_set_output(Processor *p, OutputSink sink, void *ctx) {
+    p->output = sink;
+    p->output_ctx = ctx;
+}
+
+// For checkpoints such as prefix_run()'s. The profile, register statistics,
+// energy model and reverse-execution history stay with src; dst must not
+// own any of them.
+void proc_copy(Processor *dst, const Processor *src) {
+    *dst = *src;
+    dst->prof = NULL;
+    dst->regstats = NULL;
+    dst->energy = NULL;
+    dst->tt = NULL;
+}
+
+// Back to cycle 0 of the loaded program: registers, SREG, data memory,
+// pipeline, counters, interrupt controller state and the error are cleared,
+// and the profile, register statistics and energy model start over. The
+// program, configuration, breakpoints, watchpoints and output sink stay, SMT
+// threads restart at their start addresses and the reverse-execution history
+// restarts from here.
+void proc_reset(Processor *p) {
+    memset(p->Register, 0, sizeof(p->Register));
+    p->SREG = 0;
+    p->PC = 0;
+    memset(p->data_mem, 0, sizeof(p->data_mem));
+    memset(&p->IF_ID, 0, sizeof(p->IF_ID));
+    memset(&p->ID_EX, 0, sizeof(p->ID_EX));
+    p->EX_instr = 0;
+    p->EX_pc = 0;
+    p->EX_thread = 0;
+    p->EX_valid = false;
+    p->cycle = 0;
+    p->pending_regs = 0;
+    p->mem_busy_until = 0;
+    p->events.count = 0;
+    proc_reset_counters(p);
+    p->mem_op_pc = 0;
+    bool irq_on = p->irq.on;
+    memset(&p->irq, 0, sizeof(p->irq));
+    p->irq.on = irq_on;
+    if (p->smt.nthreads) {
+        SmtState s = p->smt;
+        smt_enable(p, s.nthreads, s.start, s.policy);
+    }
+    if (p->prof) profile_reset(p);
+    if (p->regstats) regstats_reset(p);
+    if (p->energy) energy_reset(p);
+    p->error = DBH_OK;
+    p->error_msg[0] = '\0';
+    p->run_hits = 0;
+    memset(&p->watch_hit, 0, sizeof(p->watch_hit));
+    tt_reset(p);
+}
+
+void proc_set_quiet(Processor *p, bool quiet) {
+    p->quiet = quiet;
+}
+
+void proc_set_mem_latency(Processor *p, uint16_t cycles) {
+    p->mem_latency = cycles;
+}
+
+// map the performance counters at COUNTER_MMIO_BASE (sim -m)
+void proc_set_counter_mmio(Processor *p, bool on) {
+    p->counter_mmio = on;
+}
+
+// map the interrupt controller at IRQ_MMIO_BASE (sim -i)
+void proc_set_interrupts(Processor *p, bool on) {
+    p->irq.on = on;
+}
+
+// execute opcodes 13-15 as packed-SIMD instructions (sim -v)
+void proc_set_simd(Processor *p, bool on) {
+    p->simd = on;
+}
+
+int proc_error(const Processor *p) {
+    return p->error;
+}
+
+const char *proc_error_msg(const Processor *p) {
+    return p->error_msg;
 }
 
+// Stores one instruction word and predecodes it. Returns DBH_ERR_RANGE for an
+// address past instruction memory.
+int proc_write_instr(Processor *p, uint16_t addr, uint16_t word) {
+    if (addr >= 1024) return DBH_ERR_RANGE;
+    p->instr_mem[addr] = word;
+    proc_predecode(p, addr);
+    return DBH_OK;
+}
+
+const WatchHit *proc_watch_hit(const Processor *p) {
+    return &p->watch_hit;
+}
+
+// R0-R63; 0 for any other number
+uint8_t proc_get_register(const Processor *p, int reg) {
+    return reg >= 0 && reg < 64 ? p->Register[reg] : 0;
+}
+
+uint8_t proc_get_sreg(const Processor *p) {
+    return p->SREG;
+}
+
+uint16_t proc_get_pc(const Processor *p) {
+    return p->PC;
+}
+
+// the stored byte, without the side effects of a simulated load
+uint8_t proc_get_data(const Processor *p, uint16_t addr) {
+    return addr < sizeof(p->data_mem) ? p->data_mem[addr] : 0;
+}
+
+// R1-R63; R0 is a constant and cannot be written
+int proc_set_register(Processor *p, int reg, uint8_t value) {
+    if (reg < 1 || reg > 63) return DBH_ERR_RANGE;
+    p->Register[reg] = value;
+    return DBH_OK;
+}
 
+// stores the byte without the side effects of a simulated store
+int proc_set_data(Processor *p, uint16_t addr, uint8_t value) {
+    if (addr >= sizeof(p->data_mem)) return DBH_ERR_RANGE;
+    p->data_mem[addr] = value;
+    return DBH_OK;
+}
+
+void proc_printf(const Processor *p, const char *fmt, ...) {
+    if (!p->output) return;
+    char buf[512];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    p->output(p->output_ctx, buf);
+}
 
+const char *proc_strerror(int status) {
+    switch (status) {
+        case DBH_OK:         return "success";
+        case DBH_ERR_OPEN:   return "cannot open program file";
+        case DBH_ERR_SYNTAX: return "invalid instruction format";
+        case DBH_ERR_OPCODE: return "unknown opcode";
+        case DBH_ERR_NOMEM:  return "out of memory";
+        case DBH_ERR_EVENTS: return "timing event queue overflow";
+        case DBH_ERR_RANGE:  return "argument out of range";
+        default:             return "unknown error";
+    }
+}
 
+uint64_t proc_read_counter(const Processor *p, int counter) {
+    switch (counter) {
+        case CTR_CYCLES:         return p->perf.cycles;
+        case CTR_INSTRET:        return p->perf.instret;
+        case CTR_TAKEN_BRANCHES: return p->perf.taken_branches;
+        case CTR_FLUSHES:        return p->perf.flushes;
+        case CTR_LOADS:          return p->perf.loads;
+        case CTR_STORES:         return p->perf.stores;
+        case CTR_STALLS:         return p->perf.stall_cycles;
+        default:                 return 0;
+    }
+}
+
+uint64_t proc_read_opcode_count(const Processor *p, uint8_t opcode) {
+    return p->perf.op_count[opcode & 0x0F];
+}
 
+void proc_reset_counters(Processor *p) {
+    memset(&p->perf, 0, sizeof(p->perf));
+    memset(p->counter_latch, 0, sizeof(p->counter_latch));
+}
+
+// byte offset of each counter inside the mmio window, and its width
+static const uint8_t mmio_offset[CTR_MMIO_COUNT] = { 0, 4, 8, 10, 12, 14 };
+static const uint8_t mmio_width[CTR_MMIO_COUNT]  = { 4, 4, 2, 2, 2, 2 };
+
+uint8_t proc_counter_mmio_read(Processor *p, uint16_t addr) {
+    uint16_t off = addr - COUNTER_MMIO_BASE;
+    for (int i = 0; i < CTR_MMIO_COUNT; i++) {
+        if (off >= mmio_offset[i] && off < mmio_offset[i] + mmio_width[i]) {
+            int byte = off - mmio_offset[i];
+            if (byte == 0) {
+                p->counter_latch[i] = (uint32_t)proc_read_counter(p, i);
+            }
+            return (uint8_t)(p->counter_latch[i] >> (8 * byte));
+        }
+    }
+    return 0;
+}
+
+void print_counters(const Processor *p) {
+    proc_printf(p, "Performance Counters:\n");
+    proc_printf(p, "Cycles:         %llu\n", (unsigned long long)p->perf.cycles);
+    proc_printf(p, "Instructions:   %llu\n", (unsigned long long)p->perf.instret);
+    proc_printf(p, "Taken branches: %llu\n", (unsigned long long)p->perf.taken_branches);
+    proc_printf(p, "Flushes:        %llu\n", (unsigned long long)p->perf.flushes);
+    proc_printf(p, "Loads:          %llu\n", (unsigned long long)p->perf.loads);
+    proc_printf(p, "Stores:         %llu\n", (unsigned long long)p->perf.stores);
+    proc_printf(p, "Stall cycles:   %llu\n", (unsigned long long)p->perf.stall_cycles);
+    for (int i = 0; i < 16; i++) {
+        if (p->perf.op_count[i])
+            proc_printf(p, "  %-5s %llu\n", opcode_name(i), (unsigned long long)p->perf.op_count[i]);
+    }
+}
@@ -1,8 +1,9 @@
 #ifndef PROCESSOR_H
 #define PROCESSOR_H
 
-#include <stdint.h>
-#include <stdbool.h>
+// Internal header of the simulator core and the tools built with it; the
+// public interface is dbhsim.h.
+#include "dbhsim.h"
 
 #define FLAG_C 0x08  // carry flag
 #define FLAG_V 0x04  // overflow
@@ -10,6 +11,114 @@
 #define FLAG_S 0x01  // sign
 #define FLAG_Z 0x10  // zero
 
+#define EVQ_SIZE 64   // max outstanding timing events
+
+enum {
+    EV_MEM_WRITEBACK   // a delayed LDR result reaches the register file
+};
+
+typedef struct {
+    uint64_t cycle;   // cycle at which the event takes effect
+    uint8_t  kind;
+    uint8_t  reg;
+    uint8_t  value;
+    uint16_t pc;      // instruction that queued it
+    uint8_t  thread;  // hardware thread whose register it writes
+} Event;
+
+// binary min-heap ordered by cycle
+typedef struct {
+    Event    heap[EVQ_SIZE];
+    int      count;
+} EventQueue;
+
+// Memory-mapped counter window (read-only, only when counter_mmio is set).
+// Each counter appears little-endian; reading its lowest byte latches the
+// whole value so the remaining bytes can be read consistently.
+#define COUNTER_MMIO_BASE 0x30
+#define COUNTER_MMIO_SIZE 16
+
+#define CTR_MMIO_COUNT CTR_STALLS   // the CTR_* numbers are in dbhsim.h
+
+// Interrupt controller, see irq.c. While irq.on is set its registers replace
+// data memory at IRQ_MMIO_BASE. Line 0 is the timer, lines 1-7 are external.
+#define IRQ_MMIO_BASE 0x28
+#define IRQ_MMIO_SIZE 8
+#define IRQ_LINES     8
+#define IRQ_SCHED_MAX 16   // external raises queued by irq_schedule()
+#define IRQ_TIMER     0
+
+enum {
+    IRQ_REG_ENABLE,      // 0x28 bit n enables line n
+    IRQ_REG_PENDING,     // 0x29 pending lines; writing clears the lines whose bits are set
+    IRQ_REG_CAUSE,       // 0x2A line of the interrupt being handled (read only)
+    IRQ_REG_PERIOD_LO,   // 0x2B timer period in cycles, 0 stops the timer;
+    IRQ_REG_PERIOD_HI,   // 0x2C   writing the high byte (re)starts it
+    IRQ_REG_VECTOR_HI,   // 0x2D handler address
+    IRQ_REG_VECTOR_LO,   // 0x2E
+    IRQ_REG_RAISE        // 0x2F writing raises the lines whose bits are set
+};
+
+typedef struct {
+    uint64_t cycle;
+    uint8_t  line;
+} IrqRaise;
+
+typedef struct {
+    bool     on;                   // controller present, interrupts can be taken
+    uint8_t  enable;
+    uint8_t  pending;
+    uint8_t  cause;
+    uint16_t period;
+    uint16_t vector;
+    uint64_t timer_next;           // cycle the timer fires next, 0 when stopped
+    bool     in_handler;           // taken and not yet returned from (no nesting)
+    uint16_t epc;                  // where RETI resumes
+    uint8_t  esreg;                // SREG RETI restores
+    bool     entering;             // taken, handler's first instruction not executed yet
+    bool     returning;            // RETI done, the instruction at epc not executed yet
+    uint64_t entry_raised;         // raise cycle of the interrupt being entered
+    uint64_t raised_at[IRQ_LINES]; // cycle each pending line was raised
+    IrqRaise sched[IRQ_SCHED_MAX]; // ordered by cycle
+    int      nsched;
+    uint64_t raised[IRQ_LINES];
+    uint64_t taken[IRQ_LINES];
+    uint64_t lost[IRQ_LINES];      // raised again while still pending
+    uint64_t latency_total[IRQ_LINES];
+    uint64_t latency_min[IRQ_LINES];
+    uint64_t latency_max[IRQ_LINES];
+} IrqState;
+
+typedef struct {
+    uint64_t cycles;
+    uint64_t instret;
+    uint64_t taken_branches;
+    uint64_t flushes;
+    uint64_t loads;
+    uint64_t stores;
+    uint64_t stall_cycles;   // cycles decode was held by a memory interlock
+    uint64_t op_count[16];
+} PerfCounters;
+
+// Instruction memory decoded once at load time, so decode and the run-until
+// machinery never re-parse instruction words. flags marks entries that need
+// attention when they pass through the pipeline (PD_* bits).
+enum {
+    PD_STOP_PC    = 0x01,  // proc_run() stops before this instruction executes
+    PD_STOP_REG   = 0x02,  // writes the register proc_run() is watching
+    PD_STOP_WRITE = 0x04,  // stores to the address proc_run() is watching
+    PD_BREAK      = 0x08,  // breakpoint, see proc_set_breakpoint()
+    PD_WATCH      = 0x10   // only in run_hits: a data watchpoint fired
+};
+
+typedef struct {
+    uint8_t  opcode;
+    uint8_t  rs;
+    uint8_t  rt;
+    int8_t   imm;
+    uint8_t  flags;
+} Predecoded;
+
 typedef struct {
     uint16_t instr;
     uint16_t pc;
@@ -25,32 +134,265 @@ typedef struct {
     int16_t  imm;
     uint8_t  valueRS;
     uint8_t  valueRT;
+    uint8_t  thread;    // hardware thread it belongs to, see SmtState
     bool     valid;
 } ID_EX_Reg;
 
+// Data watchpoints. Watched pages are kept in a bitmap so accesses to
+// unwatched memory cost a single bit test.
+#define WATCH_MAX        8
+#define WATCH_PAGE_SHIFT 6   // 64-byte pages, 32 of them
+
+typedef struct {
+    uint16_t addr;
+    uint16_t len;
+    uint8_t  kind;    // WATCH_* bits, 0 = free slot
+} Watchpoint;
+
+
+// Static control-flow graph of instruction memory, see cfg_build(). Blocks
+// are numbered in address order, so the block holding address 0 (the entry)
+// is block 0 whenever that address holds an instruction.
+#define CFG_NONE      0xFFFF
+#define CFG_MAX_LOOPS 256
+#define CFG_MAX_EDGES 4096
+
+typedef struct {
+    uint16_t start;        // first and last instruction address
+    uint16_t end;
+    uint16_t succ;         // successor blocks are succs[succ .. succ + nsucc)
+    uint16_t nsucc;
+    uint16_t loop_depth;   // number of loops containing the block
+    bool     reachable;    // executed on some path from address 0
+    bool     exits;        // can end the program (empty word or PC past 1023)
+    bool     unresolved;   // ends in a BR whose targets are unknown
+} CfgBlock;
+
+typedef struct {
+    uint16_t header;       // block every iteration enters through
+    uint16_t latch;        // block of the last branch back to the header
+    uint16_t nblocks;
+    uint16_t ninstr;
+} CfgLoop;
+
+typedef struct {
+    CfgBlock blocks[1024];
+    uint16_t block_of[1024];   // block containing each address, CFG_NONE for empty words
+    uint16_t succs[CFG_MAX_EDGES];
+    CfgLoop  loops[CFG_MAX_LOOPS];
+    int      nblocks;
+    int      nedges;
+    int      nloops;
+    int      nunresolved;      // reachable BRs with unknown targets
+    bool     irreducible;      // a cycle can be entered at more than one block
+    bool     handler;          // a block ends in RETI: interrupts can run code anywhere
+    bool     terminates;       // the end of the program is reachable from the entry
+} Cfg;
+
+// what peephole_optimize() changed
+typedef struct {
+    int removed;     // instructions deleted
+    int rewritten;   // instructions replaced by a cheaper equivalent
+    int pads;        // "BEQZ R0 n" jumps added to skip freed slots
+} PeepholeStats;
+
+// what sched_blocks() changed; stalls are modeled for one pass through every
+// reachable block
+typedef struct {
+    int      blocks;          // blocks reordered
+    int      moved;           // instructions now at another address
+    uint64_t stalls_before;
+    uint64_t stalls_after;
+} SchedStats;
+
+// Energy per event in picojoules for energy_enable(); op[] is indexed by the
+// opcode class of an executed instruction.
+enum { EN_ALU, EN_MUL, EN_BRANCH, EN_MEM, EN_CLASSES };
+
+typedef struct {
+    double op[EN_CLASSES];
+    double reg_read;       // per register operand read
+    double reg_write;      // per register written (R0 excluded)
+    double mem_access;     // per data_mem read or write
+    double latch_toggle;   // per IF/ID or ID/EX pipeline register bit that changes
+    double flush;          // per taken branch squashing the fetched instruction
+    double cycle;          // clock tree and leakage, every cycle
+    double clock_mhz;      // clock frequency for average power, > 0
+} EnergyCosts;
+
+// Simultaneous multithreading, see smt_enable(). The threads share the
+// memories, the stages and ID/EX; each has its own PC, registers, SREG, load
+// scoreboard and IF/ID slot. The thread a stage is working for (cur) keeps
+// its state in the Processor's own fields, so execute() and decode() are
+// the same as without SMT; the others' state waits in these arrays.
+#define SMT_MAX_THREADS 4
+
+enum {
+    SMT_ROUND_ROBIN,   // fetch for the next thread in turn
+    SMT_ICOUNT         // fetch for the thread with the fewest instructions and loads in flight
+};
+
+typedef struct {
+    uint8_t   nthreads;        // 0 when SMT is off
+    uint8_t   cur;
+    uint8_t   policy;
+    uint8_t   next_fetch;      // round-robin positions
+    uint8_t   next_decode;
+    uint16_t  pc[SMT_MAX_THREADS];
+    uint8_t   sreg[SMT_MAX_THREADS];
+    IF_ID_Reg fetched[SMT_MAX_THREADS];
+    uint64_t  pending[SMT_MAX_THREADS];
+    uint8_t   regs[SMT_MAX_THREADS][64];
+    uint16_t  start[SMT_MAX_THREADS];
+    uint64_t  instret[SMT_MAX_THREADS];
+    uint64_t  fetches[SMT_MAX_THREADS];
+    uint64_t  waits[SMT_MAX_THREADS];        // cycles its IF/ID instruction was not decoded
+    uint64_t  done_cycle[SMT_MAX_THREADS];   // cycle it finished, 0 while running
+} SmtState;
+
+// Packed-SIMD extension, see simd.c. Opcode 13 is a packed ALU operation on
+// register quads or pairs, 14 and 15 load and store one; they do nothing
+// unless p->simd is set.
+enum {
+    SIMD_VADD,
+    SIMD_VSUB,
+    SIMD_VEOR,
+    SIMD_VDOT          // sum of products into the first two lanes, little-endian
+};
+
 typedef struct {
+    uint8_t func;      // SIMD_* (opcode 13)
+    uint8_t vd;        // first register of the lanes written (VLDR, VSTR: loaded or stored)
+    uint8_t vs;        // first register of the second operand's lanes (opcode 13)
+    uint8_t lanes;     // 4, 2, or 0 for the reserved lane selection
+    uint8_t addr;      // first data byte (VLDR, VSTR)
+} SimdOp;
+
+struct Processor {
     uint8_t      Register[64];
     uint8_t      SREG;
     uint16_t     PC;
 
     uint16_t     instr_mem[1024];
+    Predecoded   decoded[1024];  // mirrors instr_mem, see proc_predecode()
     uint8_t      data_mem[2048];
 
     IF_ID_Reg    IF_ID;
     ID_EX_Reg    ID_EX;
     uint16_t     EX_instr;
     uint16_t     EX_pc;
+    uint8_t      EX_thread;
     bool         EX_valid;
-} Processor;
+
+    uint64_t     cycle;          // cycles simulated so far
+    uint16_t     mem_latency;    // extra cycles per data memory access (0 = ideal)
+    uint64_t     pending_regs;   // bit i set while an LDR into Ri is in flight
+    uint64_t     mem_busy_until; // first cycle the memory port is free again
+    EventQueue   events;
+
+    PerfCounters perf;
+    bool         counter_mmio;   // expose counters at COUNTER_MMIO_BASE
+    bool         simd;           // packed-SIMD extension, opcodes 13-15
+    uint32_t     counter_latch[CTR_MMIO_COUNT];
+    uint16_t     mem_op_pc;      // last LDR/STR issued with latency (stall cause)
+    IrqState     irq;
+    SmtState     smt;
+
+    struct Profile *prof;        // per-PC profile, NULL when profiling is off
+    struct RegStats *regstats;   // register dataflow statistics, NULL when off
+    struct Energy *energy;       // energy model, NULL when off
+    struct TimeTravel *tt;       // snapshot history for reverse execution, NULL when off
+    bool         quiet;          // suppress loader and memory write logging
+    OutputSink   output;         // defaults to stdout
+    void        *output_ctx;
+    int          error;          // first DBH_ERR_* hit, stops the run
+    uint8_t      run_hits;       // PD_* flags seen since proc_run() last looked
+    uint32_t     watch_pages;    // bit n set while a watchpoint covers page n
+    Watchpoint   watches[WATCH_MAX];
+    WatchHit     watch_hit;      // most recent watchpoint hit
+    char         error_msg[128];
+};
 
 void proc_init(Processor *p);
+void proc_printf(const Processor *p, const char *fmt, ...);
+uint64_t proc_read_opcode_count(const Processor *p, uint8_t opcode);
+uint8_t proc_counter_mmio_read(Processor *p, uint16_t addr);
+void print_counters(const Processor *p);
 void mem_init(Processor *p);
-void mem_load_program(Processor *p, const char *filename);
+int mem_assemble_line(const char *line, uint16_t *out);
 uint8_t mem_read_data(Processor *p, uint16_t addr);
 void mem_write_data(Processor *p, uint16_t addr, uint8_t data);
 void mem_print_instr(const Processor *p);
 void mem_print_data(const Processor *p);
-void process_cycle(Processor *p);
+bool proc_is_idle(const Processor *p);
+void proc_predecode(Processor *p, uint16_t addr);
+bool evq_push(EventQueue *q, Event e);
+Event evq_pop(EventQueue *q);
 void print_registers(const Processor *p);
 void print_pipeline(const Processor *p, int cycle);
+
+const char *opcode_name(uint8_t opcode);
+bool op_imm_format(uint8_t opcode);
+bool op_writes_rs(uint8_t opcode);
+void disassemble(uint16_t instruction, char *buf, size_t size);
+
+int profile_enable(Processor *p);
+void profile_free(Processor *p);
+void profile_reset(Processor *p);
+size_t profile_state_size(void);
+void profile_cycle(Processor *p);
+void profile_skip(Processor *p, uint64_t cycles);
+void profile_flush(Processor *p, uint16_t pc, uint16_t target);
+void print_profile(const Processor *p);
+
+int regstats_enable(Processor *p);
+void regstats_free(Processor *p);
+void regstats_reset(Processor *p);
+size_t regstats_state_size(void);
+void regstats_record(Processor *p, uint8_t opcode, uint8_t rs, uint8_t rt);
+void print_regstats(Processor *p);
+
+void energy_default_costs(EnergyCosts *c);
+int energy_load_costs(Processor *p, const char *path, EnergyCosts *c);
+int energy_enable(Processor *p, const EnergyCosts *costs);
+void energy_free(Processor *p);
+void energy_reset(Processor *p);
+size_t energy_state_size(void);
+void energy_record(Processor *p, uint8_t opcode, uint8_t rs);
+void energy_flush(Processor *p, uint16_t pc);
+void energy_cycle(Processor *p);
+void energy_skip(Processor *p, uint64_t cycles);
+double energy_total(const Processor *p);
+void print_energy(const Processor *p);
+
+int cfg_build(const Processor *p, Cfg *cfg);
+void print_cfg(const Processor *p, const Cfg *cfg);
+
+
+int peephole_optimize(Processor *p, PeepholeStats *st);
+int sched_blocks(Processor *p, SchedStats *st);
+
+void irq_cycle(Processor *p);
+void irq_entered(Processor *p);
+bool irq_return(Processor *p);
+uint64_t irq_next_event(const Processor *p);
+uint8_t irq_mmio_read(Processor *p, uint16_t addr);
+void irq_mmio_write(Processor *p, uint16_t addr, uint8_t data);
+void print_irq(const Processor *p);
+
+int simd_assemble(const char *op, int r1, int r2, bool imm, uint16_t *out);
+bool simd_disassemble(uint16_t instruction, char *buf, size_t size);
+void simd_decode(uint16_t instruction, SimdOp *v);
+uint64_t simd_reads(uint16_t instruction);
+uint64_t simd_writes(uint16_t instruction);
+uint8_t simd_alu(uint16_t instruction, uint8_t *regs, uint8_t sreg);
+void simd_execute(Processor *p);
+
+int smt_enable(Processor *p, int nthreads, const uint16_t *start, int policy);
+void smt_switch(Processor *p, int thread);
+bool smt_alive(const Processor *p);
+void print_smt(const Processor *p);
+
+void tt_reset(Processor *p);
+void tt_cycle(Processor *p);
 #endif
@@ -0,0 +1,167 @@
+#include "processor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Flat per-PC profile. Every simulated cycle is charged to one instruction:
+// the one in EX, the branch whose flush left EX empty, or the memory access
+// whose latency stalled decode. Cycles that fit none of these (pipeline fill
+// and drain) are counted separately.
+
+#define PROF_MAX_LOOPS 64
+#define PROF_HOT_SPOTS 20
+#define FLUSH_SHADOW   1   // empty EX cycles following a taken branch
+
+typedef struct {
+    uint16_t src;     // the BEQZ/BR jumping backwards
+    uint16_t dst;     // loop header
+    uint64_t taken;
+} BackEdge;
+
+struct Profile {
+    uint64_t exec[1024];
+    uint64_t cycles[1024];
+    uint64_t stall[1024];
+    uint64_t flush[1024];
+    uint64_t fill_cycles;
+    uint64_t last_flush_cycle;
+    uint16_t last_flush_pc;
+    bool     prev_stalled;
+    uint64_t seen_stalls;
+    BackEdge loops[PROF_MAX_LOOPS];
+    int      nloops;
+};
+
+int profile_enable(Processor *p) {
+    if (p->prof) return DBH_OK;
+    p->prof = calloc(1, sizeof(struct Profile));
+    return p->prof ? DBH_OK : DBH_ERR_NOMEM;
+}
+
+void profile_free(Processor *p) {
+    free(p->prof);
+    p->prof = NULL;
+}
+
+void profile_reset(Processor *p) {
+    memset(p->prof, 0, sizeof(struct Profile));
+}
+
+// bytes behind p->prof, which reverse-execution snapshots copy
+size_t profile_state_size(void) {
+    return sizeof(struct Profile);
+}
+
+void profile_flush(Processor *p, uint16_t pc, uint16_t target) {
+    struct Profile *pr = p->prof;
+    pr->last_flush_cycle = p->cycle;
+    pr->last_flush_pc = pc;
+    if (target > pc) return;
+
+    for (int i = 0; i < pr->nloops; i++) {
+        if (pr->loops[i].src == pc && pr->loops[i].dst == target) {
+            pr->loops[i].taken++;
+            return;
+        }
+    }
+    if (pr->nloops < PROF_MAX_LOOPS) {
+        BackEdge e = { pc, target, 1 };
+        pr->loops[pr->nloops++] = e;
+    }
+}
+
+static void charge_stall(struct Profile *pr, uint16_t pc, uint64_t cycles) {
+    pr->stall[pc & 0x3FF] += cycles;
+    pr->cycles[pc & 0x3FF] += cycles;
+}
+
+void profile_cycle(Processor *p) {
+    struct Profile *pr = p->prof;
+    // EX is empty this cycle because decode was held in the previous one
+    bool stalled_before = pr->prev_stalled;
+    pr->prev_stalled = p->perf.stall_cycles != pr->seen_stalls;
+    pr->seen_stalls = p->perf.stall_cycles;
+
+    if (p->EX_valid) {
+        pr->exec[p->EX_pc & 0x3FF]++;
+        pr->cycles[p->EX_pc & 0x3FF]++;
+    } else if (pr->last_flush_cycle && p->cycle - pr->last_flush_cycle <= FLUSH_SHADOW) {
+        pr->flush[pr->last_flush_pc]++;
+        pr->cycles[pr->last_flush_pc]++;
+    } else if (stalled_before) {
+        charge_stall(pr, p->mem_op_pc, 1);
+    } else {
+        pr->fill_cycles++;
+    }
+}
+
+void profile_skip(Processor *p, uint64_t cycles) {
+    struct Profile *pr = p->prof;
+    if (p->IF_ID.valid) {
+        charge_stall(pr, p->mem_op_pc, cycles);
+        pr->prev_stalled = true;
+        pr->seen_stalls = p->perf.stall_cycles;
+    } else {
+        pr->fill_cycles += cycles;
+    }
+}
+
+typedef struct {
+    uint16_t pc;
+    uint64_t cycles;
+} HotSpot;
+
+static int by_cycles_desc(const void *a, const void *b) {
+    const HotSpot *x = a, *y = b;
+    if (x->cycles != y->cycles) return x->cycles < y->cycles ? 1 : -1;
+    return x->pc - y->pc;
+}
+
+void print_profile(const Processor *p) {
+    const struct Profile *pr = p->prof;
+    if (!pr) return;
+
+    HotSpot order[1024];
+    int n = 0;
+    uint64_t total = pr->fill_cycles;
+    for (int i = 0; i < 1024; i++) {
+        if (pr->cycles[i]) {
+            order[n].pc = (uint16_t)i;
+            order[n++].cycles = pr->cycles[i];
+            total += pr->cycles[i];
+        }
+    }
+    qsort(order, n, sizeof(order[0]), by_cycles_desc);
+
+    char text[32];
+    proc_printf(p, "Hot Spots (%llu cycles, %llu in pipeline fill/drain):\n",
+           (unsigned long long)total, (unsigned long long)pr->fill_cycles);
+    proc_printf(p, "%-8s %-16s %10s %10s %8s %8s %7s\n", "PC", "Instruction", "Executed", "Cycles", "Stall", "Flush", "%");
+    for (int i = 0; i < n && i < PROF_HOT_SPOTS; i++) {
+        uint16_t pc = order[i].pc;
+        disassemble(p->instr_mem[pc], text, sizeof(text));
+        proc_printf(p, "0x%04X   %-16s %10llu %10llu %8llu %8llu %6.2f%%\n", pc, text,
+               (unsigned long long)pr->exec[pc], (unsigned long long)pr->cycles[pc],
+               (unsigned long long)pr->stall[pc], (unsigned long long)pr->flush[pc],
+               total ? 100.0 * pr->cycles[pc] / total : 0.0);
+    }
+
+    if (!pr->nloops) {
+        proc_printf(p, "No loops detected.\n");
+        return;
+    }
+    proc_printf(p, "Loops (back-edges):\n");
+    proc_printf(p, "%-8s %-8s %10s %8s %10s %10s\n", "Header", "Branch", "Iterations", "Entries", "Avg trip", "Cycles");
+    for (int i = 0; i < pr->nloops; i++) {
+        const BackEdge *e = &pr->loops[i];
+        uint64_t header = pr->exec[e->dst & 0x3FF];
+        uint64_t entries = header > e->taken ? header - e->taken : 1;
+        uint64_t body = 0;
+        for (int pc = e->dst; pc <= e->src; pc++) {
+            body += pr->cycles[pc];
+        }
+        proc_printf(p, "0x%04X   0x%04X   %10llu %8llu %10.1f %10llu\n", e->dst, e->src,
+               (unsigned long long)e->taken, (unsigned long long)entries,
+               (double)header / entries, (unsigned long long)body);
+    }
+}
@@ -0,0 +1,191 @@
+#include "processor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Register dataflow statistics, gathered for every instruction that reaches
+// EX (so flushed wrong-path instructions are not counted). Time is measured
+// in retired instructions: a dependency distance of 1 means the consumer
+// immediately follows its producer, which is where load-use stalls come from.
+// Under SMT each hardware thread has its own registers, so the live values
+// and the instruction count distances are measured in are kept per thread;
+// the totals cover all threads.
+
+#define DIST_BUCKETS 17   // distances 1..16, last bucket is "more than 16"
+
+// the values live in one thread's registers
+typedef struct {
+    uint64_t last_write[64];       // instruction index of the live value's def, 0 = none
+    uint64_t last_read[64];
+    bool     from_load[64];        // live value was produced by LDR
+    uint64_t index;                // instructions the thread has executed
+} LiveRegs;
+
+struct RegStats {
+    uint64_t reads[64];
+    uint64_t writes[64];
+    uint64_t dead_writes[64];      // overwritten (or never read) before any read
+    uint64_t uninit_reads[64];     // read before the program ever wrote it
+    uint64_t ranges[64];           // completed live ranges
+    uint64_t range_total[64];
+    uint64_t range_max[64];
+    LiveRegs live[SMT_MAX_THREADS];
+    uint64_t dist[DIST_BUCKETS];
+    uint64_t load_dist[DIST_BUCKETS];
+    uint64_t index;                // instructions seen so far, all threads
+    bool     finished;
+};
+
+int regstats_enable(Processor *p) {
+    if (p->regstats) return DBH_OK;
+    p->regstats = calloc(1, sizeof(struct RegStats));
+    return p->regstats ? DBH_OK : DBH_ERR_NOMEM;
+}
+
+void regstats_free(Processor *p) {
+    free(p->regstats);
+    p->regstats = NULL;
+}
+
+void regstats_reset(Processor *p) {
+    memset(p->regstats, 0, sizeof(struct RegStats));
+}
+
+// bytes behind p->regstats, which reverse-execution snapshots copy
+size_t regstats_state_size(void) {
+    return sizeof(struct RegStats);
+}
+
+static void record_read(struct RegStats *rs, LiveRegs *lv, uint8_t r) {
+    if (r == 0) return;   // R0 is a constant, not a dependency
+    rs->reads[r]++;
+    if (!lv->last_write[r]) {
+        rs->uninit_reads[r]++;
+        return;
+    }
+    uint64_t d = lv->index - lv->last_write[r];
+    int bucket = d > DIST_BUCKETS - 1 ? DIST_BUCKETS - 1 : (int)d - 1;
+    rs->dist[bucket]++;
+    if (lv->from_load[r]) rs->load_dist[bucket]++;
+    lv->last_read[r] = lv->index;
+}
+
+// closes the live range of the value currently held in r
+static void end_range(struct RegStats *rs, LiveRegs *lv, uint8_t r) {
+    if (!lv->last_write[r]) return;
+    if (lv->last_read[r] > lv->last_write[r]) {
+        uint64_t len = lv->last_read[r] - lv->last_write[r];
+        rs->ranges[r]++;
+        rs->range_total[r] += len;
+        if (len > rs->range_max[r]) rs->range_max[r] = len;
+    } else {
+        rs->dead_writes[r]++;
+    }
+}
+
+static void record_write(struct RegStats *rs, LiveRegs *lv, uint8_t r, bool load) {
+    if (r == 0) return;
+    end_range(rs, lv, r);
+    rs->writes[r]++;
+    lv->last_write[r] = lv->index;
+    lv->last_read[r] = 0;
+    lv->from_load[r] = load;
+}
+
+void regstats_record(Processor *p, uint8_t opcode, uint8_t rs, uint8_t rt) {
+    struct RegStats *st = p->regstats;
+    LiveRegs *lv = &st->live[p->ID_EX.thread];
+    st->index++;
+    lv->index++;
+    if (opcode >= 13 && p->simd) {
+        // every lane is a register of its own
+        uint64_t reads = simd_reads(p->ID_EX.instr);
+        uint64_t writes = simd_writes(p->ID_EX.instr);
+        for (uint8_t r = 1; r < 64; r++) {
+            if (reads >> r & 1) record_read(st, lv, r);
+        }
+        for (uint8_t r = 1; r < 64; r++) {
+            if (writes >> r & 1) record_write(st, lv, r, opcode == 14);
+        }
+        return;
+    }
+    switch (opcode) {
+        case 0: case 1: case 2: case 6:          // ADD SUB MUL EOR
+            record_read(st, lv, rs);
+            record_read(st, lv, rt);
+            record_write(st, lv, rs, false);
+            break;
+        case 5: case 8: case 9:                  // ANDI SAL SAR
+            record_read(st, lv, rs);
+            record_write(st, lv, rs, false);
+            break;
+        case 3:                                  // MOVI
+            record_write(st, lv, rs, false);
+            break;
+        case 10:                                 // LDR
+            record_write(st, lv, rs, true);
+            break;
+        case 4: case 11:                         // BEQZ STR
+            record_read(st, lv, rs);
+            break;
+        case 7:                                  // BR
+            record_read(st, lv, rs);
+            record_read(st, lv, rt);
+            break;
+        default:
+            break;
+    }
+}
+
+static void print_histogram(const Processor *p, const char *title, const uint64_t *dist) {
+    uint64_t total = 0;
+    for (int i = 0; i < DIST_BUCKETS; i++) total += dist[i];
+    proc_printf(p, "%s (%llu reads):\n", title, (unsigned long long)total);
+    if (!total) return;
+    for (int i = 0; i < DIST_BUCKETS; i++) {
+        if (!dist[i]) continue;
+        if (i == DIST_BUCKETS - 1)
+            proc_printf(p, "  >%-3d %10llu %6.2f%%\n", DIST_BUCKETS - 1, (unsigned long long)dist[i], 100.0 * dist[i] / total);
+        else
+            proc_printf(p, "  %-4d %10llu %6.2f%%\n", i + 1, (unsigned long long)dist[i], 100.0 * dist[i] / total);
+    }
+}
+
+void print_regstats(Processor *p) {
+    struct RegStats *st = p->regstats;
+    if (!st) return;
+    if (!st->finished) {
+        // values still live at exit end their range here
+        for (int t = 0; t < SMT_MAX_THREADS; t++) {
+            for (int r = 1; r < 64; r++) end_range(st, &st->live[t], (uint8_t)r);
+        }
+        st->finished = true;
+    }
+
+    proc_printf(p, "%-5s %10s %10s %8s %8s %10s %8s\n", "Reg", "Reads", "Writes", "Dead", "Uninit", "Avg range", "Max");
+    uint64_t dead = 0;
+    for (int r = 1; r < 64; r++) {
+        if (!st->reads[r] && !st->writes[r]) continue;
+        dead += st->dead_writes[r];
+        proc_printf(p, "R%-4d %10llu %10llu %8llu %8llu %10.1f %8llu\n", r,
+               (unsigned long long)st->reads[r], (unsigned long long)st->writes[r],
+               (unsigned long long)st->dead_writes[r], (unsigned long long)st->uninit_reads[r],
+               st->ranges[r] ? (double)st->range_total[r] / st->ranges[r] : 0.0,
+               (unsigned long long)st->range_max[r]);
+    }
+    proc_printf(p, "Dead writes (value never read): %llu of %llu instructions\n",
+           (unsigned long long)dead, (unsigned long long)st->index);
+
+    int unused = 0;
+    proc_printf(p, "Written but never read:");
+    for (int r = 1; r < 64; r++) {
+        if (st->writes[r] && !st->reads[r]) {
+            proc_printf(p, " R%d", r);
+            unused++;
+        }
+    }
+    proc_printf(p, "%s\n", unused ? "" : " none");
+
+    print_histogram(p, "Dependency distance", st->dist);
+    print_histogram(p, "Dependency distance from LDR (distances up to mem_latency stall)", st->load_dist);
+}
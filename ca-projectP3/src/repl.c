@@ -0,0 +1,364 @@
+#include "processor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// dbhrepl: type an instruction and it is assembled into the next free
+// instruction memory slot and executed right away. Stepping, running and undo
+// all go through proc_run() and the snapshot history (timetravel.c); every
+// edit is pinned with tt_checkpoint(), so undo is a restore plus at most one
+// snapshot interval of replay, however long the session has been.
+
+#define RUN_LIMIT  10000000   // cycles one command may run (a typed instruction may branch into a loop)
+#define UNDO_DEPTH 1024
+
+enum {
+    UNDO_MOVE,    // step/run/back: go back to cycle
+    UNDO_INSTR,   // typed instruction: clear slot a, restore pc
+    UNDO_REG,     // set: restore register a
+    UNDO_MEM      // poke: restore data[a]
+};
+
+typedef struct {
+    uint8_t  kind;
+    uint64_t cycle;   // UNDO_MOVE: where to go back to; otherwise the cycle of the edit
+    uint16_t a;
+    uint16_t old;
+} Undo;
+
+typedef struct {
+    Processor *p;
+    Undo       undo[UNDO_DEPTH];   // ring
+    int        undo_top;
+    int        undo_count;
+} Repl;
+
+static void push_undo(Repl *r, uint8_t kind, uint64_t cycle, uint16_t a, uint16_t old) {
+    r->undo[r->undo_top] = (Undo){ kind, cycle, a, old };
+    r->undo_top = (r->undo_top + 1) % UNDO_DEPTH;
+    if (r->undo_count < UNDO_DEPTH) r->undo_count++;
+}
+
+static uint16_t next_slot(const Processor *p) {
+    uint16_t a = 0;
+    while (a < 1024 && p->instr_mem[a]) a++;
+    return a;
+}
+
+static bool finished(const Processor *p) {
+    return !p->IF_ID.valid && !p->ID_EX.valid && p->PC >= 1024 && !p->events.count;
+}
+
+static void print_sreg(uint8_t sreg) {
+    printf("[%c%c%c%c%c]",
+           (sreg & FLAG_C) ? 'C' : '-', (sreg & FLAG_V) ? 'V' : '-', (sreg & FLAG_N) ? 'N' : '-',
+           (sreg & FLAG_S) ? 'S' : '-', (sreg & FLAG_Z) ? 'Z' : '-');
+}
+
+static void print_pc(const Processor *p) {
+    if (p->ID_EX.valid)      printf("next PC %d", p->ID_EX.pc);
+    else if (p->IF_ID.valid) printf("next PC %d", p->IF_ID.pc);
+    else if (p->PC < 1024)   printf("next PC %d", p->PC);
+    else                     printf("done");
+}
+
+// what a command changed: registers, flags, cycles and where execution is
+static void report(const Processor *p, const uint8_t *regs, uint8_t sreg, uint64_t cycle) {
+    for (int i = 0; i < 64; i++) {
+        if (p->Register[i] != regs[i]) {
+            printf("  R%d: 0x%02X -> 0x%02X\n", i, regs[i], p->Register[i]);
+        }
+    }
+    if (p->SREG != sreg) {
+        printf("  SREG: ");
+        print_sreg(sreg);
+        printf(" -> ");
+        print_sreg(p->SREG);
+        printf("\n");
+    }
+    printf("  cycle %llu (%+lld), ", (unsigned long long)p->cycle, (long long)(p->cycle - cycle));
+    print_pc(p);
+    printf("\n");
+}
+
+static void print_stop(int reason) {
+    static const char *names[] = {
+        [STOP_ERROR] = "error", [STOP_CYCLES] = "cycle limit", [STOP_PC] = "pc",
+        [STOP_REG] = "register", [STOP_WRITE] = "store", [STOP_BREAK] = "breakpoint",
+        [STOP_WATCH] = "watchpoint",
+    };
+    if (reason != STOP_DONE && reason != STOP_INSTRUCTIONS) {
+        printf("  stopped: %s\n", names[reason]);
+    }
+}
+
+static void enter_instruction(Repl *r, const char *line) {
+    Processor *p = r->p;
+    uint16_t word;
+    int status = mem_assemble_line(line, &word);
+    if (status < 0) {
+        printf("%s\n", proc_strerror(status));
+        return;
+    }
+    if (status == 0) return;
+    uint16_t slot = next_slot(p);
+    if (word == 0) {
+        printf("ADD R0 R0 encodes as 0, which ends the program\n");
+        return;
+    }
+    if (slot >= 1024) {
+        printf("instruction memory is full\n");
+        return;
+    }
+    bool run = finished(p);
+    p->instr_mem[slot] = word;
+    proc_predecode(p, slot);
+    uint16_t old_pc = p->PC;
+    if (run) p->PC = slot;
+    tt_checkpoint(p);
+    push_undo(r, UNDO_INSTR, p->cycle, slot, old_pc);
+    if (!run) {
+        printf("  [%d] appended; the program is still running, use step or run\n", slot);
+        return;
+    }
+
+    uint8_t regs[64], sreg = p->SREG;
+    uint64_t cycle = p->cycle;
+    memcpy(regs, p->Register, sizeof(regs));
+    StopCond c = { RUN_LIMIT, 0, -1, -1, 0, -1, false };
+    int reason = proc_run(p, &c);
+    char text[32];
+    disassemble(word, text, sizeof(text));
+    printf("  [%d] %s\n", slot, text);
+    print_stop(reason);
+    report(p, regs, sreg, cycle);
+}
+
+static void undo(Repl *r) {
+    Processor *p = r->p;
+    if (!r->undo_count) {
+        printf("nothing to undo\n");
+        return;
+    }
+    r->undo_top = (r->undo_top + UNDO_DEPTH - 1) % UNDO_DEPTH;
+    r->undo_count--;
+    Undo u = r->undo[r->undo_top];
+    uint8_t regs[64], sreg = p->SREG;
+    uint64_t cycle = p->cycle;
+    memcpy(regs, p->Register, sizeof(regs));
+    if (tt_goto_cycle(p, u.cycle) != DBH_OK) {
+        printf("history does not reach back that far\n");
+        r->undo_count = 0;
+        return;
+    }
+    switch (u.kind) {
+        case UNDO_INSTR:
+            p->instr_mem[u.a] = 0;
+            proc_predecode(p, u.a);
+            p->PC = u.old;
+            tt_checkpoint(p);
+            break;
+        case UNDO_REG:
+            p->Register[u.a] = (uint8_t)u.old;
+            p->ID_EX.valueRS = p->Register[p->ID_EX.rs];
+            p->ID_EX.valueRT = p->Register[p->ID_EX.rt];
+            tt_checkpoint(p);
+            break;
+        case UNDO_MEM:
+            p->data_mem[u.a] = (uint8_t)u.old;
+            tt_checkpoint(p);
+            break;
+    }
+    report(p, regs, sreg, cycle);
+}
+
+static void run(Repl *r, uint64_t instructions) {
+    Processor *p = r->p;
+    uint8_t regs[64], sreg = p->SREG;
+    uint64_t cycle = p->cycle;
+    memcpy(regs, p->Register, sizeof(regs));
+    StopCond c = { RUN_LIMIT, instructions, -1, -1, 0, -1, false };
+    int reason = proc_run(p, &c);
+    push_undo(r, UNDO_MOVE, cycle, 0, 0);
+    print_stop(reason);
+    report(p, regs, sreg, cycle);
+}
+
+static void back(Repl *r, long n) {
+    Processor *p = r->p;
+    uint8_t regs[64], sreg = p->SREG;
+    uint64_t cycle = p->cycle;
+    memcpy(regs, p->Register, sizeof(regs));
+    while (n-- > 0 && tt_step_back(p) == DBH_OK) {}
+    push_undo(r, UNDO_MOVE, cycle, 0, 0);
+    report(p, regs, sreg, cycle);
+}
+
+static void print_state(const Processor *p) {
+    for (int i = 0; i < 64; i++) {
+        printf("R%02d=%02X%s", i, p->Register[i], (i & 15) == 15 ? "\n" : " ");
+    }
+    printf("SREG ");
+    print_sreg(p->SREG);
+    printf("  cycle %llu  instructions %llu  ", (unsigned long long)p->cycle, (unsigned long long)p->perf.instret);
+    print_pc(p);
+    printf("\n");
+}
+
+static void list_program(const Processor *p) {
+    uint16_t end = next_slot(p);
+    for (uint16_t a = 0; a < end; a++) {
+        char text[32];
+        disassemble(p->instr_mem[a], text, sizeof(text));
+        printf("%c%c%4d  %s\n", proc_has_breakpoint(p, a) ? '*' : ' ',
+               p->ID_EX.valid && p->ID_EX.pc == a ? '>' : ' ', a, text);
+    }
+}
+
+// the program as loadable source, plus the machine state in the .golden format
+static void save(const Processor *p, const char *path) {
+    char golden[256];
+    const char *dot = strrchr(path, '.');
+    int stem = dot ? (int)(dot - path) : (int)strlen(path);
+    snprintf(golden, sizeof(golden), "%.*s.golden", stem, path);
+    FILE *src = fopen(path, "w");
+    FILE *state = fopen(golden, "w");
+    if (!src || !state) {
+        printf("cannot write %s\n", src ? golden : path);
+        if (src) fclose(src);
+        if (state) fclose(state);
+        return;
+    }
+    uint16_t end = next_slot(p);
+    fprintf(src, "; saved from dbhrepl\n");
+    for (uint16_t a = 0; a < end; a++) {
+        char text[32];
+        disassemble(p->instr_mem[a], text, sizeof(text));
+        fprintf(src, "%s\n", text);
+    }
+    fprintf(state, "; state saved from dbhrepl at cycle %llu\n", (unsigned long long)p->cycle);
+    for (int i = 0; i < 64; i++) {
+        if (p->Register[i]) fprintf(state, "R%d 0x%02X\n", i, p->Register[i]);
+    }
+    fprintf(state, "SREG 0x%02X\n", p->SREG);
+    for (int i = 0; i < 2048; i++) {
+        if (p->data_mem[i]) fprintf(state, "MEM 0x%04X 0x%02X\n", i, p->data_mem[i]);
+    }
+    fclose(src);
+    fclose(state);
+    printf("wrote %s and %s\n", path, golden);
+}
+
+static void reset(Repl *r, const char *path) {
+    Processor *p = r->p;
+    tt_free(p);   // proc_init() would drop the pointer to the old history
+    proc_init(p);
+    mem_init(p);
+    p->quiet = true;
+    if (path && mem_load_program(p, path) != DBH_OK) {
+        printf("%s\n", p->error_msg);
+        mem_init(p);
+        p->error = 0;
+    }
+    p->quiet = false;
+    if (!path) p->PC = 1024;   // empty machine: the first typed instruction starts it
+    r->undo_count = 0;
+    if (tt_enable(p) != DBH_OK) {
+        printf("%s\n", proc_strerror(DBH_ERR_NOMEM));
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void help(void) {
+    printf("OP Rn Rm / OP Rn imm   assemble into the next slot and execute it\n"
+           "step [n]               execute n instructions (default 1)\n"
+           "run                    run until the program ends, a breakpoint or 10M cycles\n"
+           "back [n]               undo the last n executed instructions\n"
+           "undo                   revert the last command\n"
+           "regs                   registers, flags, cycle and PC\n"
+           "mem addr [len]         dump data memory\n"
+           "set Rn value           write a register\n"
+           "poke addr value        write a data memory byte\n"
+           "break addr / delete addr\n"
+           "list                   show the program\n"
+           "load file              load a program (clears the history)\n"
+           "save file              write the program and a .golden state file\n"
+           "reset                  start over with empty memory\n"
+           "quit\n");
+}
+
+int main(int argc, char *argv[]) {
+    Repl *r = calloc(1, sizeof(Repl));
+    if (!r || !(r->p = proc_create())) {
+        perror("calloc");
+        return EXIT_FAILURE;
+    }
+    Processor *p = r->p;
+    reset(r, argc > 1 ? argv[1] : NULL);
+    printf("dbhrepl - type an instruction, or help\n");
+
+    char line[256];
+    for (;;) {
+        printf("dbh> ");
+        fflush(stdout);
+        if (!fgets(line, sizeof(line), stdin)) break;
+        char cmd[32] = "";
+        char arg[200] = "";
+        long a = 0, b = 0;
+        int n = sscanf(line, "%31s %199s", cmd, arg);
+        if (n < 1) continue;
+
+        if (cmd[0] >= 'A' && cmd[0] <= 'Z') {
+            enter_instruction(r, line);
+        } else if (strcmp(cmd, "step") == 0 || strcmp(cmd, "s") == 0) {
+            a = n > 1 ? strtol(arg, NULL, 0) : 1;
+            if (a > 0) run(r, (uint64_t)a);
+        } else if (strcmp(cmd, "run") == 0 || strcmp(cmd, "r") == 0) {
+            run(r, 0);
+        } else if (strcmp(cmd, "back") == 0 || strcmp(cmd, "b") == 0) {
+            back(r, n > 1 ? strtol(arg, NULL, 0) : 1);
+        } else if (strcmp(cmd, "undo") == 0 || strcmp(cmd, "u") == 0) {
+            undo(r);
+        } else if (strcmp(cmd, "regs") == 0) {
+            print_state(p);
+        } else if (strcmp(cmd, "mem") == 0 && sscanf(line, "%*s %li %li", &a, &b) >= 1 && a >= 0 && a < 2048) {
+            if (b <= 0) b = 16;
+            if (b > 2048 - a) b = 2048 - a;
+            for (long i = a; i < a + b; i++) {
+                if (i == a || i % 16 == 0) printf("%s0x%04lX:", i == a ? "" : "\n", i);
+                printf(" %02X", p->data_mem[i]);
+            }
+            printf("\n");
+        } else if (strcmp(cmd, "set") == 0 && sscanf(line, "%*s R%li %li", &a, &b) == 2 && a > 0 && a < 64) {
+            push_undo(r, UNDO_REG, p->cycle, (uint16_t)a, p->Register[a]);
+            p->Register[a] = (uint8_t)b;
+            p->ID_EX.valueRS = p->Register[p->ID_EX.rs];
+            p->ID_EX.valueRT = p->Register[p->ID_EX.rt];
+            tt_checkpoint(p);
+        } else if (strcmp(cmd, "poke") == 0 && sscanf(line, "%*s %li %li", &a, &b) == 2 && a >= 0 && a < 2048) {
+            push_undo(r, UNDO_MEM, p->cycle, (uint16_t)a, p->data_mem[a]);
+            p->data_mem[a] = (uint8_t)b;
+            tt_checkpoint(p);
+        } else if (strcmp(cmd, "break") == 0 && sscanf(line, "%*s %li", &a) == 1 && a >= 0 && a < 1024) {
+            proc_set_breakpoint(p, (uint16_t)a);
+        } else if (strcmp(cmd, "delete") == 0 && sscanf(line, "%*s %li", &a) == 1 && a >= 0 && a < 1024) {
+            proc_clear_breakpoint(p, (uint16_t)a);
+        } else if (strcmp(cmd, "list") == 0) {
+            list_program(p);
+        } else if (strcmp(cmd, "load") == 0 && n > 1) {
+            reset(r, arg);
+            printf("loaded %d instructions\n", next_slot(p));
+        } else if (strcmp(cmd, "save") == 0 && n > 1) {
+            save(p, arg);
+        } else if (strcmp(cmd, "reset") == 0) {
+            reset(r, NULL);
+        } else if (strcmp(cmd, "quit") == 0 || strcmp(cmd, "q") == 0) {
+            break;
+        } else {
+            help();
+        }
+    }
+    proc_destroy(p);
+    free(r);
+    return 0;
+}
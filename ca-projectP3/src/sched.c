@@ -0,0 +1,263 @@
+#include "processor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// List scheduler for basic blocks. With mem_latency set, decode holds an
+// instruction that touches a register an LDR has not written back yet, and
+// a memory access while the data port is still busy (see decode_blocked());
+// ALU results are forwarded and never stall. Within each reachable block the
+// instructions are reordered so independent work fills those gaps.
+//
+// A block keeps its address range, and a BEQZ or BR ending it stays last, so
+// no branch offset or target changes. The order is constrained by register
+// dependences, by LDR/STR pairs on the same address, by counter and interrupt
+// controller window accesses (kept in place relative to every other
+// instruction) and by the last flag-setting instruction, which keeps its
+// place after all others so the SREG a block leaves is unchanged; nothing
+// else reads SREG. With the SIMD extension on, VLDR and VSTR are memory
+// accesses to their whole byte range and every lane is a register.
+
+#define OP_BEQZ 4
+#define OP_BR   7
+#define OP_LDR  10
+#define OP_STR  11
+
+typedef struct {
+    uint8_t  op, rs, rt;
+    bool     rtype;
+    bool     load, store;
+    bool     flags;           // replaces SREG
+    uint8_t  addr, bytes;     // data bytes a load or store accesses
+    uint64_t reads, writes;   // registers, R0 excluded
+    uint64_t touches;         // registers decode_blocked() looks at
+} Insn;
+
+typedef struct {
+    Cfg      cfg;
+    Insn     insn[1024];
+    uint16_t npred[1024];
+    uint64_t height[1024];
+    uint8_t  dep[1024][1024 / 8];   // dep[j] has bit i when i must precede j
+} Sched;
+
+static void decode_insn(const Processor *p, uint16_t w, Insn *in) {
+    in->op = w >> 12;
+    in->rs = (w >> 6) & 0x3F;
+    in->rt = w & 0x3F;
+    in->rtype = !op_imm_format(in->op);
+    if (in->op >= 13 && p->simd) {
+        SimdOp v;
+        simd_decode(w, &v);
+        in->load = in->op == 14 && v.lanes;
+        in->store = in->op == 15 && v.lanes;
+        in->flags = in->op != 15 && v.lanes;
+        in->addr = v.addr;
+        in->bytes = in->op == 13 ? 0 : v.lanes;
+        in->reads = simd_reads(w);
+        in->writes = simd_writes(w);
+        in->touches = in->reads | in->writes;
+        return;
+    }
+    in->load = in->op == OP_LDR;
+    in->store = in->op == OP_STR;
+    in->flags = op_writes_rs(in->op);
+    in->addr = in->rt;
+    in->bytes = in->load || in->store;
+    in->reads = in->writes = 0;
+    if (in->op != 3 && in->op != OP_LDR) in->reads |= 1ULL << in->rs;
+    if (in->rtype) in->reads |= 1ULL << in->rt;
+    if (op_writes_rs(in->op)) in->writes |= 1ULL << in->rs;
+    in->reads &= ~1ULL;
+    in->writes &= ~1ULL;
+    in->touches = (1ULL << in->rs | (in->rtype ? 1ULL << in->rt : 0)) & ~1ULL;
+}
+
+static bool is_mem(const Insn *in) {
+    return in->load || in->store;
+}
+
+static bool in_counter_window(const Processor *p, const Insn *in) {
+    for (int a = in->addr; a < in->addr + in->bytes; a++) {
+        if ((p->counter_mmio && a >= COUNTER_MMIO_BASE && a < COUNTER_MMIO_BASE + COUNTER_MMIO_SIZE) ||
+            (p->irq.on && a >= IRQ_MMIO_BASE && a < IRQ_MMIO_BASE + IRQ_MMIO_SIZE)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool overlap(const Insn *x, const Insn *y) {
+    return x->addr < y->addr + y->bytes && y->addr < x->addr + x->bytes;
+}
+
+// a load's registers become usable mem_latency + 1 cycles after it executes
+static void issue(const Processor *p, const Insn *in, uint64_t e, uint64_t *ready_at, uint64_t *port_free) {
+    if (!is_mem(in) || !p->mem_latency) return;
+    *port_free = e + p->mem_latency;
+    for (int r = 1; in->load && r < 64; r++) {
+        if (in->writes >> r & 1) ready_at[r] = e + p->mem_latency + 1;
+    }
+}
+
+static bool has_dep(const Sched *s, int i, int j) {
+    return s->dep[j][i >> 3] >> (i & 7) & 1;
+}
+
+// Execute cycles (relative to the block) of the instructions in the given
+// order, issued in order as the pipeline does; returns the stall cycles.
+static uint64_t stalls_of(const Processor *p, const Sched *s, const uint16_t *order, int n) {
+    uint64_t ready_at[64] = { 0 };   // first execute cycle that may touch a register
+    uint64_t port_free = 0;          // first execute cycle for the next memory access
+    uint64_t t = 0;
+    for (int k = 0; k < n; k++) {
+        const Insn *in = &s->insn[order[k]];
+        uint64_t e = t;
+        for (int r = 1; r < 64; r++) {
+            if ((in->touches >> r & 1) && ready_at[r] > e) e = ready_at[r];
+        }
+        if (is_mem(in) && port_free > e) e = port_free;
+        issue(p, in, e, ready_at, &port_free);
+        t = e + 1;
+    }
+    return t - (uint64_t)n;
+}
+
+static void add_dep(Sched *s, int i, int j) {
+    if (!has_dep(s, i, j)) {
+        s->dep[j][i >> 3] |= (uint8_t)(1 << (i & 7));
+        s->npred[j]++;
+    }
+}
+
+// Builds the dependences of block [a, a + n) on block-relative indices.
+static void build_deps(const Processor *p, Sched *s, int a, int n) {
+    memset(s->npred, 0, (size_t)n * sizeof(s->npred[0]));
+    for (int j = 0; j < n; j++) memset(s->dep[j], 0, sizeof(s->dep[j]));
+    int last_flags = -1;
+    for (int i = 0; i < n; i++) {
+        decode_insn(p, p->instr_mem[a + i], &s->insn[i]);
+        if (s->insn[i].flags) last_flags = i;
+    }
+    bool ends_in_branch = s->insn[n - 1].op == OP_BEQZ || s->insn[n - 1].op == OP_BR;
+
+    for (int j = 0; j < n; j++) {
+        const Insn *b = &s->insn[j];
+        bool b_fixed = in_counter_window(p, b);
+        for (int i = 0; i < j; i++) {
+            const Insn *x = &s->insn[i];
+            bool x_fixed = in_counter_window(p, x);
+            bool dep = (x->writes & (b->reads | b->writes)) || (x->reads & b->writes) ||
+                       b_fixed || x_fixed ||
+                       (overlap(x, b) && (x->store || b->store)) ||
+                       (j == last_flags && x->flags) ||
+                       (j == n - 1 && ends_in_branch);
+            if (dep) add_dep(s, i, j);
+        }
+    }
+
+    // critical path, counting an LDR's result latency
+    for (int i = n - 1; i >= 0; i--) {
+        uint64_t h = 1;
+        for (int j = i + 1; j < n; j++) {
+            if (!has_dep(s, i, j)) continue;
+            uint64_t lat = s->insn[i].load && (s->insn[i].writes & s->insn[j].touches) ? p->mem_latency + 1u : 1u;
+            if (lat + s->height[j] > h) h = lat + s->height[j];
+        }
+        s->height[i] = h;
+    }
+}
+
+// Greedy list scheduling: of the instructions whose predecessors are placed,
+// the one that can execute soonest goes next; among those the one with the
+// longest path to the end of the block, then the earliest in program order.
+static void list_schedule(const Processor *p, Sched *s, int n, uint16_t *order) {
+    uint64_t ready_at[64] = { 0 };
+    uint64_t port_free = 0;
+    bool placed[1024] = { false };
+    uint64_t t = 0;
+    for (int k = 0; k < n; ) {
+        int best = -1;
+        uint64_t best_at = UINT64_MAX;
+        for (int j = 0; j < n; j++) {
+            if (placed[j] || s->npred[j]) continue;
+            const Insn *in = &s->insn[j];
+            uint64_t e = t;
+            for (int r = 1; r < 64; r++) {
+                if ((in->touches >> r & 1) && ready_at[r] > e) e = ready_at[r];
+            }
+            if (is_mem(in) && port_free > e) e = port_free;
+            if (e < best_at || (e == best_at && s->height[j] > s->height[best])) {
+                best = j;
+                best_at = e;
+            }
+        }
+        uint64_t e = best_at;
+        issue(p, &s->insn[best], e, ready_at, &port_free);
+        placed[best] = true;
+        order[k++] = (uint16_t)best;
+        for (int j = best + 1; j < n; j++) {
+            if (has_dep(s, best, j)) s->npred[j]--;
+        }
+        t = e + 1;
+    }
+}
+
+// Reorders the instructions of every reachable basic block of the program in
+// p to reduce stalls under p->mem_latency, and reports the modeled stalls of
+// one pass through each block before and after. Breakpoints do not follow
+// moved instructions. Fails with DBH_ERR_RANGE if a reachable BR has unknown
+// targets, since any address could then start a block, or if the program has
+// an interrupt handler.
+int sched_blocks(Processor *p, SchedStats *st) {
+    memset(st, 0, sizeof(*st));
+    Sched *s = malloc(sizeof(Sched));
+    if (!s) return DBH_ERR_NOMEM;
+    int status = cfg_build(p, &s->cfg);
+    if (status == DBH_OK && s->cfg.handler) {
+        snprintf(p->error_msg, sizeof(p->error_msg), "the program has an interrupt handler");
+        status = DBH_ERR_RANGE;
+    } else if (status == DBH_OK && s->cfg.nunresolved) {
+        snprintf(p->error_msg, sizeof(p->error_msg), "a BR has unknown targets, blocks are not known");
+        status = DBH_ERR_RANGE;
+    }
+    if (status != DBH_OK) {
+        free(s);
+        return status;
+    }
+
+    uint16_t identity[1024];
+    uint16_t order[1024];
+    uint16_t words[1024];
+    for (int i = 0; i < 1024; i++) identity[i] = (uint16_t)i;
+    for (int b = 0; b < s->cfg.nblocks; b++) {
+        const CfgBlock *blk = &s->cfg.blocks[b];
+        if (!blk->reachable) continue;
+        int a = blk->start;
+        int n = blk->end - blk->start + 1;
+        build_deps(p, s, a, n);
+        uint64_t before = stalls_of(p, s, identity, n);
+        uint64_t after = before;
+        if (before) {
+            list_schedule(p, s, n, order);
+            after = stalls_of(p, s, order, n);
+        }
+        st->stalls_before += before;
+        if (after >= before) {
+            st->stalls_after += before;
+            continue;
+        }
+        st->stalls_after += after;
+        st->blocks++;
+        for (int k = 0; k < n; k++) {
+            words[k] = p->instr_mem[a + order[k]];
+            if (order[k] != k) st->moved++;
+        }
+        for (int k = 0; k < n; k++) {
+            p->instr_mem[a + k] = words[k];
+            proc_predecode(p, (uint16_t)(a + k));
+        }
+    }
+    free(s);
+    return DBH_OK;
+}
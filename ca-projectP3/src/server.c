@@ -0,0 +1,509 @@
+#define _DEFAULT_SOURCE
+#include "processor.h"
+#include "dbhproto.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// dbhserver: runs simulation jobs for many clients on a fixed pool of worker
+// threads, each owning one preallocated Processor that is reset per job.
+//
+// Job slots are preallocated too. A connection's reader thread reads a
+// request header, and only once it is valid takes a free slot and receives
+// the rest of the request straight into it; when every slot is queued or
+// running, or the connection already has its share of jobs in flight, it
+// waits, stops reading its socket, and the client's writes block once the
+// socket buffer is full. That is the backpressure. An idle client holds no
+// slot, and one that stalls in the middle of a request body is dropped.
+//
+// Workers never write to a socket. A finished result is copied into its
+// connection's result ring, which has room for every job the connection may
+// have in flight, and the connection's writer thread sends it. A job counts
+// as in flight until its result is sent, so a client that does not read its
+// results stops having requests read; if it accepts no bytes for
+// RESULT_TIMEOUT_MS the connection is dropped and its pending results are
+// discarded.
+
+#define DEFAULT_QUEUE 64
+#define DEFAULT_PER_CONN 16
+#define BODY_TIMEOUT_MS 5000      // longest pause allowed inside a request body
+#define RESULT_TIMEOUT_MS 5000    // longest a client may leave its results unread
+#define ACCEPT_BACKOFF_US 100000  // out of descriptors: wait for one to close
+
+// a result as it goes on the wire: header, registers, then data if wanted
+typedef struct {
+    JobResult hdr;
+    uint8_t   regs[64];
+    uint8_t   data[2048];
+    size_t    len;
+} Result;
+
+typedef struct {
+    int             fd;
+    int             refs;        // the reader and the writer
+    int             inflight;    // jobs taken and not yet sent or discarded
+    bool            eof;         // the reader has stopped
+    bool            dead;        // a write failed or timed out; results are discarded
+    pthread_mutex_t lock;        // guards everything below fd
+    pthread_cond_t  done_cond;   // a job left flight
+    pthread_cond_t  out_cond;    // a result was queued, or the reader stopped
+    Result         *out;         // ring of per_conn results waiting to be sent
+    int             out_head;
+    int             out_count;
+    int             out_size;
+} Conn;
+
+typedef struct {
+    Conn      *conn;
+    JobRequest req;
+    uint16_t   instr[1024];
+    uint8_t    data[2048];
+    uint8_t    regs[64];
+} Job;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t  ready_cond;  // a job was queued
+    pthread_cond_t  free_cond;   // a slot was released
+    Job            *slots;
+    Job           **free_list;
+    int             nfree;
+    Job           **ready;       // ring of queued jobs
+    int             head;
+    int             count;
+    int             size;
+    int             per_conn;    // jobs one connection may have in flight
+} Server;
+
+typedef struct {
+    Server *server;
+    Conn   *conn;
+} Reader;
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-j workers] [-q queue_slots] [-c jobs_per_connection] socket_path\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+// timeout_ms < 0 waits as long as it takes, otherwise it bounds each pause
+static bool read_full(int fd, void *buf, size_t len, int timeout_ms) {
+    uint8_t *b = buf;
+    while (len) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if (timeout_ms >= 0 && poll(&pfd, 1, timeout_ms) <= 0) return false;
+        ssize_t n = recv(fd, b, len, 0);
+        if (n <= 0) return false;
+        b += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static void conn_release(Conn *c) {
+    pthread_mutex_lock(&c->lock);
+    int refs = --c->refs;
+    pthread_mutex_unlock(&c->lock);
+    if (!refs) {
+        close(c->fd);
+        pthread_cond_destroy(&c->out_cond);
+        pthread_cond_destroy(&c->done_cond);
+        pthread_mutex_destroy(&c->lock);
+        free(c->out);
+        free(c);
+    }
+}
+
+// Queues a result for the writer; never blocks on the client. r->len bytes
+// of r go on the wire.
+static void post_result(Conn *c, const Result *r) {
+    pthread_mutex_lock(&c->lock);
+    if (c->dead) {
+        // the writer may be waiting for the last job to leave flight
+        if (!--c->inflight) pthread_cond_signal(&c->out_cond);
+        pthread_cond_signal(&c->done_cond);
+    } else {
+        Result *slot = &c->out[(c->out_head + c->out_count++) % c->out_size];
+        memcpy(slot, r, r->len);
+        slot->len = r->len;
+        pthread_cond_signal(&c->out_cond);
+    }
+    pthread_mutex_unlock(&c->lock);
+}
+
+static Job *take_slot(Server *s) {
+    pthread_mutex_lock(&s->lock);
+    while (!s->nfree) {
+        pthread_cond_wait(&s->free_cond, &s->lock);
+    }
+    Job *j = s->free_list[--s->nfree];
+    pthread_mutex_unlock(&s->lock);
+    return j;
+}
+
+static void release_slot(Server *s, Job *j) {
+    pthread_mutex_lock(&s->lock);
+    s->free_list[s->nfree++] = j;
+    pthread_cond_signal(&s->free_cond);
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void enqueue(Server *s, Job *j) {
+    pthread_mutex_lock(&s->lock);
+    s->ready[(s->head + s->count++) % s->size] = j;
+    pthread_cond_signal(&s->ready_cond);
+    pthread_mutex_unlock(&s->lock);
+}
+
+static Job *dequeue(Server *s) {
+    pthread_mutex_lock(&s->lock);
+    while (!s->count) {
+        pthread_cond_wait(&s->ready_cond, &s->lock);
+    }
+    Job *j = s->ready[s->head];
+    s->head = (s->head + 1) % s->size;
+    s->count--;
+    pthread_mutex_unlock(&s->lock);
+    return j;
+}
+
+// false if the client hung up or accepted nothing for RESULT_TIMEOUT_MS
+static bool write_full(int fd, const void *buf, size_t len) {
+    const uint8_t *b = buf;
+    while (len) {
+        struct pollfd pfd = { fd, POLLOUT, 0 };
+        if (poll(&pfd, 1, RESULT_TIMEOUT_MS) <= 0) return false;
+        ssize_t n = send(fd, b, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+        if (n <= 0) return false;
+        b += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// Sends queued results until the reader has stopped and no job is left in
+// flight. After a failed write the connection is shut down, which also ends
+// the reader, and later results are dropped.
+static void *writer(void *arg) {
+    Conn *c = arg;
+    pthread_mutex_lock(&c->lock);
+    for (;;) {
+        while (!c->out_count && !(c->eof && !c->inflight)) {
+            pthread_cond_wait(&c->out_cond, &c->lock);
+        }
+        if (!c->out_count) break;
+        Result *r = &c->out[c->out_head];
+        bool dead = c->dead;
+        pthread_mutex_unlock(&c->lock);
+        bool ok = dead || write_full(c->fd, r, r->len);
+        pthread_mutex_lock(&c->lock);
+        if (!ok) {
+            c->dead = true;
+            shutdown(c->fd, SHUT_RDWR);
+        }
+        c->out_head = (c->out_head + 1) % c->out_size;
+        c->out_count--;
+        c->inflight--;
+        pthread_cond_signal(&c->done_cond);
+    }
+    pthread_mutex_unlock(&c->lock);
+    conn_release(c);
+    return NULL;
+}
+
+// A sweep sends one program with many inputs, so each worker keeps a
+// checkpoint after the input-independent prefix of the last program it ran
+// (see prefix_run()) and starts later jobs of that program from there. The
+// checkpoint is only built when a program comes up twice in a row, so mixed
+// job streams do not pay for it.
+#define PREFIX_LIMIT (1u << 20)   // instructions
+
+typedef struct {
+    Processor *base;
+    Prefix     prefix;
+    bool       seen;              // base->instr_mem and the fields below are set
+    bool       built;             // prefix_run() was tried on base
+    bool       valid;             // base holds a usable checkpoint
+    uint16_t   ninstr;
+    uint16_t   mem_latency;
+    uint8_t    flags;             // the JOB_REGS, JOB_MMIO and JOB_SIMD bits
+} PrefixCache;
+
+static void load_job(Processor *p, const Job *j) {
+    proc_init(p);
+    proc_set_output(p, NULL, NULL);
+    p->quiet = true;
+    p->mem_latency = j->req.mem_latency;
+    p->counter_mmio = (j->req.flags & JOB_MMIO) != 0;
+    p->simd = (j->req.flags & JOB_SIMD) != 0;
+    memcpy(p->instr_mem, j->instr, j->req.ninstr * sizeof(uint16_t));
+    for (uint16_t a = 0; a < j->req.ninstr; a++) {
+        proc_predecode(p, a);
+    }
+}
+
+static bool cache_matches(const PrefixCache *c, const Job *j) {
+    return c->seen && c->ninstr == j->req.ninstr && c->mem_latency == j->req.mem_latency &&
+           c->flags == (j->req.flags & (JOB_REGS | JOB_MMIO | JOB_SIMD)) &&
+           memcmp(c->base->instr_mem, j->instr, j->req.ninstr * sizeof(uint16_t)) == 0;
+}
+
+static void cache_remember(PrefixCache *c, const Job *j) {
+    memcpy(c->base->instr_mem, j->instr, j->req.ninstr * sizeof(uint16_t));
+    c->seen = true;
+    c->built = false;
+    c->valid = false;
+    c->ninstr = j->req.ninstr;
+    c->mem_latency = j->req.mem_latency;
+    c->flags = j->req.flags & (JOB_REGS | JOB_MMIO | JOB_SIMD);
+}
+
+static void cache_fill(PrefixCache *c, const Job *j) {
+    // a prefix longer than the job's budget would be wasted on this job
+    uint64_t limit = PREFIX_LIMIT;
+    if (j->req.max_cycles && j->req.max_cycles < limit) limit = j->req.max_cycles;
+    if (j->req.max_instructions && j->req.max_instructions < limit) limit = j->req.max_instructions;
+
+    load_job(c->base, j);
+    uint8_t inputs = PREFIX_INPUT_DATA | ((j->req.flags & JOB_REGS) ? PREFIX_INPUT_REGS : 0);
+    c->built = true;
+    c->valid = prefix_run(c->base, inputs, limit, &c->prefix) == DBH_OK;
+}
+
+static void run_job(Processor *p, PrefixCache *c, const Job *j, Result *r) {
+    StopCond cond = { j->req.max_cycles, j->req.max_instructions, -1, -1, 0, -1, false };
+    const uint8_t *regs = (j->req.flags & JOB_REGS) ? j->regs : NULL;
+    if (!cache_matches(c, j)) {
+        cache_remember(c, j);
+    } else if (!c->built) {
+        cache_fill(c, j);
+    }
+    const Prefix *pre = &c->prefix;
+    if (c->valid && (!cond.max_cycles || cond.max_cycles > pre->cycles) &&
+        (!cond.max_instructions || cond.max_instructions > pre->instructions)) {
+        proc_copy(p, c->base);
+        prefix_set_input(p, pre, j->data, j->req.ndata, regs);
+        // budgets count from cycle 0 of the job
+        if (cond.max_cycles) cond.max_cycles -= pre->cycles;
+        if (cond.max_instructions) cond.max_instructions -= pre->instructions;
+    } else {
+        load_job(p, j);
+        memcpy(p->data_mem, j->data, j->req.ndata);
+        if (regs) {
+            memcpy(p->Register, regs, sizeof(p->Register));
+            p->Register[0] = 0;
+        }
+    }
+
+    int stop = proc_run(p, &cond);
+    r->hdr = (JobResult){
+        JOB_RESULT_MAGIC, j->req.job_id, p->error, stop,
+        p->perf.cycles, p->perf.instret, p->PC, p->SREG, j->req.flags & JOB_WANT_DATA, 0
+    };
+    memcpy(r->regs, p->Register, sizeof(r->regs));
+    r->len = offsetof(Result, data);
+    if (j->req.flags & JOB_WANT_DATA) {
+        memcpy(r->data, p->data_mem, sizeof(r->data));
+        r->len += sizeof(r->data);
+    }
+}
+
+static void *worker(void *arg) {
+    Server *s = arg;
+    Processor *p = proc_create();
+    PrefixCache cache = { .base = proc_create() };
+    Result *r = malloc(sizeof(Result));
+    if (!p || !cache.base || !r) {
+        perror("proc_create");
+        exit(EXIT_FAILURE);
+    }
+    for (;;) {
+        Job *j = dequeue(s);
+        Conn *c = j->conn;
+        run_job(p, &cache, j, r);
+        release_slot(s, j);
+        post_result(c, r);
+    }
+    return NULL;
+}
+
+// Waits until the connection may have another job in flight and counts it.
+// False once the writer has given up on the client.
+static bool take_turn(Server *s, Conn *c) {
+    pthread_mutex_lock(&c->lock);
+    while (c->inflight >= s->per_conn && !c->dead) {
+        pthread_cond_wait(&c->done_cond, &c->lock);
+    }
+    bool ok = !c->dead;
+    if (ok) c->inflight++;
+    pthread_mutex_unlock(&c->lock);
+    return ok;
+}
+
+static void reject(Server *s, Conn *c, uint32_t job_id, int status) {
+    if (!take_turn(s, c)) return;
+    Result r = { .hdr = { JOB_RESULT_MAGIC, job_id, status, STOP_ERROR, 0, 0, 0, 0, 0, 0 }, .len = sizeof(JobResult) };
+    post_result(c, &r);
+}
+
+static void *reader(void *arg) {
+    Reader rd = *(Reader *)arg;
+    free(arg);
+    Server *s = rd.server;
+    Conn *c = rd.conn;
+    for (;;) {
+        JobRequest hdr;
+        if (!read_full(c->fd, &hdr, sizeof(hdr), -1)) break;
+        if (hdr.magic != JOB_REQUEST_MAGIC || hdr.ninstr > 1024 || hdr.ndata > 2048) {
+            // the stream cannot be resynchronized after a bad header
+            reject(s, c, hdr.job_id, hdr.magic != JOB_REQUEST_MAGIC ? DBH_ERR_SYNTAX : DBH_ERR_RANGE);
+            break;
+        }
+        if (!take_turn(s, c)) break;
+
+        Job *j = take_slot(s);
+        JobRequest *q = &j->req;
+        *q = hdr;
+        if (!read_full(c->fd, j->instr, q->ninstr * sizeof(uint16_t), BODY_TIMEOUT_MS) ||
+            !read_full(c->fd, j->data, q->ndata, BODY_TIMEOUT_MS) ||
+            ((q->flags & JOB_REGS) && !read_full(c->fd, j->regs, sizeof(j->regs), BODY_TIMEOUT_MS))) {
+            release_slot(s, j);
+            pthread_mutex_lock(&c->lock);
+            c->inflight--;
+            pthread_mutex_unlock(&c->lock);
+            break;
+        }
+        j->conn = c;
+        enqueue(s, j);
+    }
+    shutdown(c->fd, SHUT_RD);
+    pthread_mutex_lock(&c->lock);
+    c->eof = true;
+    pthread_cond_signal(&c->out_cond);
+    pthread_mutex_unlock(&c->lock);
+    conn_release(c);
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    long workers = sysconf(_SC_NPROCESSORS_ONLN);
+    int queue = DEFAULT_QUEUE;
+    int per_conn = DEFAULT_PER_CONN;
+    const char *path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-q") == 0 && i + 1 < argc) {
+            queue = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            per_conn = atoi(argv[++i]);
+        } else if (argv[i][0] == '-' || path) {
+            usage(argv[0]);
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path || workers < 1 || queue < 1 || per_conn < 1) {
+        usage(argv[0]);
+    }
+    if (per_conn > queue) per_conn = queue;
+    signal(SIGPIPE, SIG_IGN);
+
+    Server s = { .size = queue, .nfree = queue, .per_conn = per_conn };
+    s.slots = malloc(queue * sizeof(Job));
+    s.free_list = malloc(queue * sizeof(Job *));
+    s.ready = malloc(queue * sizeof(Job *));
+    if (!s.slots || !s.free_list || !s.ready) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < queue; i++) {
+        s.free_list[i] = &s.slots[i];
+    }
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.ready_cond, NULL);
+    pthread_cond_init(&s.free_cond, NULL);
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un sa = {0};
+    if (server < 0 || strlen(path) >= sizeof(sa.sun_path)) {
+        fprintf(stderr, "cannot create socket %s\n", path);
+        return EXIT_FAILURE;
+    }
+    sa.sun_family = AF_UNIX;
+    strcpy(sa.sun_path, path);
+    unlink(path);
+    if (bind(server, (struct sockaddr *)&sa, sizeof(sa)) < 0 || listen(server, 16) < 0) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+
+    for (long i = 0; i < workers; i++) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, worker, &s) != 0) {
+            perror("pthread_create");
+            return EXIT_FAILURE;
+        }
+        pthread_detach(t);
+    }
+    printf("dbhserver: %ld workers, %d job slots (%d per connection), listening on %s\n", workers, queue, per_conn,
+           path);
+    fflush(stdout);
+
+    for (;;) {
+        int fd = accept(server, NULL, NULL);
+        if (fd < 0) {
+            // retrying at once would spin until some connection closes
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                usleep(ACCEPT_BACKOFF_US);
+            }
+            continue;
+        }
+        Conn *c = calloc(1, sizeof(Conn));
+        Reader *rd = malloc(sizeof(Reader));
+        Result *out = malloc(per_conn * sizeof(Result));
+        pthread_t t;
+        if (!c || !rd || !out) {
+            close(fd);
+            free(c);
+            free(rd);
+            free(out);
+            continue;
+        }
+        c->fd = fd;
+        c->refs = 2;
+        c->out = out;
+        c->out_size = per_conn;
+        pthread_mutex_init(&c->lock, NULL);
+        pthread_cond_init(&c->done_cond, NULL);
+        pthread_cond_init(&c->out_cond, NULL);
+        rd->server = &s;
+        rd->conn = c;
+        if (pthread_create(&t, NULL, writer, c) != 0) {
+            c->refs = 1;
+            conn_release(c);
+            free(rd);
+            continue;
+        }
+        pthread_detach(t);
+        if (pthread_create(&t, NULL, reader, rd) != 0) {
+            pthread_mutex_lock(&c->lock);
+            c->eof = true;
+            pthread_cond_signal(&c->out_cond);
+            pthread_mutex_unlock(&c->lock);
+            conn_release(c);
+            free(rd);
+            continue;
+        }
+        pthread_detach(t);
+    }
+}
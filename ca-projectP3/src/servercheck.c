@@ -0,0 +1,116 @@
+#define _DEFAULT_SOURCE
+#include "dbhproto.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+// servercheck: starts dbhserver with one worker, lets several clients send a
+// batch of jobs each and hang up before any result arrives, then checks that
+// once the jobs have drained the server is back to the threads and
+// descriptors it had before the first connection.
+
+#define CLIENTS 5
+#define JOBS 6
+#define JOB_CYCLES 2000000      // long enough that most jobs end after the hang-up
+#define DRAIN_TIMEOUT_S 60
+
+static int count_entries(pid_t pid, const char *what) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/%s", (int)pid, what);
+    DIR *d = opendir(path);
+    if (!d) return -1;
+    int n = 0;
+    struct dirent *e;
+    while ((e = readdir(d))) {
+        if (e->d_name[0] != '.') n++;
+    }
+    closedir(d);
+    return n;
+}
+
+static int connect_to(const char *path) {
+    struct sockaddr_un sa = {0};
+    sa.sun_family = AF_UNIX;
+    strncpy(sa.sun_path, path, sizeof(sa.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr *)&sa, sizeof(sa)) == 0) return fd;
+    if (fd >= 0) close(fd);
+    return -1;
+}
+
+// sends JOBS jobs that spin on BR R0 R0 and hangs up without reading
+static int send_batch(const char *path) {
+    int fd = connect_to(path);
+    if (fd < 0) return -1;
+    for (uint32_t i = 0; i < JOBS; i++) {
+        JobRequest req = { JOB_REQUEST_MAGIC, i, 1, 0, 1, JOB_WANT_DATA, 0, JOB_CYCLES, 0 };
+        uint16_t loop = 0x7000;
+        if (send(fd, &req, sizeof(req), MSG_NOSIGNAL) != sizeof(req) ||
+            send(fd, &loop, sizeof(loop), MSG_NOSIGNAL) != sizeof(loop)) {
+            close(fd);
+            return -1;
+        }
+    }
+    close(fd);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *server = argc > 1 ? argv[1] : "./dbhserver";
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/dbhservercheck.%d", (int)getpid());
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return EXIT_FAILURE;
+    }
+    if (!pid) {
+        if (!freopen("/dev/null", "w", stdout)) _exit(EXIT_FAILURE);
+        execl(server, server, "-j", "1", path, (char *)NULL);
+        perror(server);
+        _exit(EXIT_FAILURE);
+    }
+
+    int fd = -1;
+    for (int tries = 0; tries < 100 && fd < 0; tries++) {
+        usleep(20000);
+        fd = connect_to(path);
+    }
+    int ok = fd >= 0;
+    if (fd >= 0) close(fd);
+    usleep(100000);   // let the probe connection's threads finish
+    int threads = count_entries(pid, "task");
+    int fds = count_entries(pid, "fd");
+
+    for (int c = 0; ok && c < CLIENTS; c++) {
+        ok = send_batch(path) == 0;
+    }
+    int t = threads + 1, f = fds + 1;
+    for (int s = 0; ok && s < DRAIN_TIMEOUT_S * 10 && (t != threads || f != fds); s++) {
+        usleep(100000);
+        t = count_entries(pid, "task");
+        f = count_entries(pid, "fd");
+    }
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    unlink(path);
+    if (!ok) {
+        fprintf(stderr, "servercheck: could not talk to %s\n", server);
+        return EXIT_FAILURE;
+    }
+    printf("threads %d -> %d, descriptors %d -> %d\n", threads, t, fds, f);
+    if (t != threads || f != fds) {
+        fprintf(stderr, "servercheck: connections were not torn down after their clients hung up\n");
+        return EXIT_FAILURE;
+    }
+    printf("servercheck: ok\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,207 @@
+#include "processor.h"
+#include <stdio.h>
+#include <string.h>
+
+// Packed-SIMD extension. A register quad R4k..R4k+3, or one of its pairs
+// R4k..R4k+1 and R4k+2..R4k+3, holds a vector of unsigned bytes; lane i is
+// the i-th register. The three opcodes are
+//
+//   13  VADD/VSUB/VEOR/VDOT  rs = vd<<2 | func, rt = vs<<2 | sel
+//   14  VLDR                 rs = vq<<2 | sel,  imm = address
+//   15  VSTR                 rs = vq<<2 | sel,  imm = address
+//
+// where vd, vs and vq number quads and sel picks the lanes: 0 the quad, 1 its
+// low pair, 2 its high pair (3 is reserved and does nothing). Both operands
+// of opcode 13 use the same lanes. VADD, VSUB and VEOR work lane by lane,
+// wrapping; VDOT writes the sum of the lane products to the first two lanes,
+// low byte first. VLDR and VSTR move data[address + i] to or from lane i with
+// a single memory port access, so they cost what LDR and STR cost.
+//
+// Flags: Z when every result lane is zero, N when any has its top bit set
+// (for VDOT: the 16-bit sum and its bit 15), C when any lane of VADD carries
+// or of VSUB borrows, or VDOT's sum does not fit 16 bits; V and S are
+// cleared. VSTR leaves SREG alone. Writes to R0 are discarded as usual.
+
+static const char *const alu_names[] = { "VADD", "VSUB", "VEOR", "VDOT" };
+
+// Assembles a vector mnemonic, with ".2" for a pair: registers for opcode 13,
+// a register and an address for VLDR/VSTR when imm is set. Registers must
+// start a quad, or for a pair be even, and both operands must use the same
+// half of their quads. Returns 1, DBH_ERR_OPCODE or DBH_ERR_SYNTAX, like
+// mem_assemble_line().
+int simd_assemble(const char *op, int r1, int r2, bool imm, uint16_t *out) {
+    size_t len = strcspn(op, ".");
+    bool pair = strcmp(op + len, ".2") == 0;
+    if ((op[len] && !pair) || len != 4) return DBH_ERR_OPCODE;
+
+    int opcode = -1;
+    int func = 0;
+    if (imm) {
+        if (strncmp(op, "VLDR", 4) == 0) opcode = 14;
+        if (strncmp(op, "VSTR", 4) == 0) opcode = 15;
+    } else {
+        for (func = 0; func < 4 && strncmp(op, alu_names[func], 4) != 0; func++) {
+        }
+        if (func < 4) opcode = 13;
+    }
+    if (opcode < 0) return DBH_ERR_OPCODE;
+
+    int align = pair ? 2 : 4;
+    if (r1 < 0 || r1 > 63 || r1 % align || (!imm && (r2 < 0 || r2 > 63 || r2 % 4 != r1 % 4))) {
+        return DBH_ERR_SYNTAX;
+    }
+    int sel = !pair ? 0 : r1 % 4 ? 2 : 1;
+    if (imm) {
+        *out = (uint16_t)(opcode << 12 | (r1 / 4) << 8 | sel << 6 | (r2 & 0x3F));
+    } else {
+        *out = (uint16_t)(opcode << 12 | (r1 / 4) << 8 | func << 6 | (r2 / 4) << 2 | sel);
+    }
+    return 1;
+}
+
+// instruction must have opcode 13-15
+void simd_decode(uint16_t instruction, SimdOp *v) {
+    uint8_t opcode = instruction >> 12;
+    uint8_t sel = opcode == 13 ? instruction & 3 : (instruction >> 6) & 3;
+    uint8_t half = sel == 2 ? 2 : 0;
+    v->func  = opcode == 13 ? (instruction >> 6) & 3 : 0;
+    v->vd    = (uint8_t)(((instruction >> 8) & 0xF) * 4 + half);
+    v->vs    = opcode == 13 ? (uint8_t)(((instruction >> 2) & 0xF) * 4 + half) : 0;
+    v->lanes = sel == 0 ? 4 : sel == 3 ? 0 : 2;
+    v->addr  = opcode == 13 ? 0 : instruction & 0x3F;
+}
+
+// false for the reserved lane selection, which the caller formats itself
+bool simd_disassemble(uint16_t instruction, char *buf, size_t size) {
+    SimdOp v;
+    simd_decode(instruction, &v);
+    if (!v.lanes) return false;
+    const char *pair = v.lanes == 2 ? ".2" : "";
+    if (instruction >> 12 == 13) {
+        snprintf(buf, size, "%s%s R%d R%d", alu_names[v.func], pair, v.vd, v.vs);
+    } else {
+        snprintf(buf, size, "%s%s R%d %d", instruction >> 12 == 14 ? "VLDR" : "VSTR", pair, v.vd, v.addr);
+    }
+    return true;
+}
+
+static uint64_t lane_mask(uint8_t first, uint8_t lanes) {
+    return (((1ULL << lanes) - 1) << first) & ~1ULL;
+}
+
+// registers a vector instruction reads and writes, R0 excluded
+uint64_t simd_reads(uint16_t instruction) {
+    SimdOp v;
+    simd_decode(instruction, &v);
+    switch (instruction >> 12) {
+        case 13: return lane_mask(v.vd, v.lanes) | lane_mask(v.vs, v.lanes);
+        case 15: return lane_mask(v.vd, v.lanes);
+        default: return 0;
+    }
+}
+
+uint64_t simd_writes(uint16_t instruction) {
+    SimdOp v;
+    simd_decode(instruction, &v);
+    switch (instruction >> 12) {
+        case 13: return lane_mask(v.vd, v.func == SIMD_VDOT && v.lanes ? 2 : v.lanes);
+        case 14: return lane_mask(v.vd, v.lanes);
+        default: return 0;
+    }
+}
+
+// Applies an opcode 13 instruction to regs and returns the SREG it leaves,
+// sreg itself for the reserved lane selection.
+uint8_t simd_alu(uint16_t instruction, uint8_t *regs, uint8_t sreg) {
+    SimdOp v;
+    simd_decode(instruction, &v);
+    if (!v.lanes) return sreg;
+    uint8_t result[4];
+    int n = v.lanes;
+    sreg = 0;
+    if (v.func == SIMD_VDOT) {
+        uint32_t sum = 0;
+        for (int i = 0; i < v.lanes; i++) sum += (uint32_t)regs[v.vd + i] * regs[v.vs + i];
+        result[0] = (uint8_t)sum;
+        result[1] = (uint8_t)(sum >> 8);
+        n = 2;
+        if (!(sum & 0xFFFF)) sreg |= FLAG_Z;
+        if (sum & 0x8000) sreg |= FLAG_N;
+        if (sum > 0xFFFF) sreg |= FLAG_C;
+    } else {
+        sreg = FLAG_Z;
+        for (int i = 0; i < v.lanes; i++) {
+            uint8_t a = regs[v.vd + i], b = regs[v.vs + i];
+            switch (v.func) {
+                case SIMD_VADD:
+                    result[i] = (uint8_t)(a + b);
+                    if (a + b > 0xFF) sreg |= FLAG_C;
+                    break;
+                case SIMD_VSUB:
+                    result[i] = (uint8_t)(a - b);
+                    if (a < b) sreg |= FLAG_C;
+                    break;
+                default:
+                    result[i] = a ^ b;
+                    break;
+            }
+            if (result[i]) sreg &= (uint8_t)~FLAG_Z;
+            if (result[i] & 0x80) sreg |= FLAG_N;
+        }
+    }
+    // all lanes are read before any is written, vd and vs may be the same
+    for (int i = 0; i < n; i++) {
+        if (v.vd + i != 0) regs[v.vd + i] = result[i];
+    }
+    return sreg;
+}
+
+// EX for opcodes 13-15 with the extension on
+void simd_execute(Processor *p) {
+    uint16_t instruction = p->ID_EX.instr;
+    uint8_t opcode = instruction >> 12;
+    SimdOp v;
+    simd_decode(instruction, &v);
+    if (!v.lanes) return;
+
+    if (opcode == 13) {
+        p->SREG = simd_alu(instruction, p->Register, p->SREG);
+        p->run_hits |= p->decoded[p->ID_EX.pc].flags & PD_STOP_REG;
+        return;
+    }
+    if (opcode == 14) {
+        uint8_t sreg = FLAG_Z;
+        for (int i = 0; i < v.lanes; i++) {
+            uint8_t r = (uint8_t)(v.vd + i);
+            uint8_t value = mem_read_data(p, (uint16_t)(v.addr + i));
+            if (value) sreg &= (uint8_t)~FLAG_Z;
+            if (value & 0x80) sreg |= FLAG_N;
+            if (r == 0) continue;
+            if (!p->mem_latency) {
+                p->Register[r] = value;
+                continue;
+            }
+            // like LDR, the lanes arrive mem_latency cycles later
+            Event e = { p->cycle + p->mem_latency, EV_MEM_WRITEBACK, r, value, p->ID_EX.pc, p->ID_EX.thread };
+            if (!evq_push(&p->events, e)) {
+                snprintf(p->error_msg, sizeof(p->error_msg), "event queue overflow at cycle %llu",
+                         (unsigned long long)p->cycle);
+                p->error = DBH_ERR_EVENTS;
+            }
+            p->pending_regs |= 1ULL << r;
+        }
+        if (!p->mem_latency) p->run_hits |= p->decoded[p->ID_EX.pc].flags & PD_STOP_REG;
+        p->SREG = sreg;
+        p->perf.loads++;
+    } else {
+        for (int i = 0; i < v.lanes; i++) {
+            mem_write_data(p, (uint16_t)(v.addr + i), p->Register[v.vd + i]);
+        }
+        p->run_hits |= p->decoded[p->ID_EX.pc].flags & PD_STOP_WRITE;
+        p->perf.stores++;
+    }
+    if (p->mem_latency) {
+        p->mem_busy_until = p->cycle + p->mem_latency;
+        p->mem_op_pc = p->ID_EX.pc;
+    }
+}
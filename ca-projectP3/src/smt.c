@@ -0,0 +1,117 @@
+#include "processor.h"
+#include <stdio.h>
+#include <string.h>
+
+// Simultaneous multithreading. Up to SMT_MAX_THREADS hardware threads run
+// the program in instr_mem from their own start addresses and share data
+// memory, so they can communicate through it. Each cycle EX works for the
+// thread whose instruction is in ID/EX, decode for the next thread in turn
+// that has a ready instruction in its IF/ID slot, and fetch for one thread
+// picked by the fetch policy. A thread stalled on a load therefore no longer
+// stalls the core: another thread's instruction fills the slot.
+//
+// Interrupts are not supported together with SMT; a taken branch flushes only
+// its own thread's IF/ID slot.
+
+// Starts nthreads threads at start[0..nthreads-1]; thread 0 keeps the
+// Processor's registers. Must be called before the first cycle.
+int smt_enable(Processor *p, int nthreads, const uint16_t *start, int policy) {
+    if (nthreads < 2 || nthreads > SMT_MAX_THREADS || p->cycle != 0 || p->irq.on ||
+        (policy != SMT_ROUND_ROBIN && policy != SMT_ICOUNT)) {
+        snprintf(p->error_msg, sizeof(p->error_msg), "SMT needs 2 to %d threads, before the first cycle and without interrupts",
+                 SMT_MAX_THREADS);
+        return DBH_ERR_RANGE;
+    }
+    for (int t = 0; t < nthreads; t++) {
+        if (start[t] >= 1024) {
+            snprintf(p->error_msg, sizeof(p->error_msg), "thread %d starts outside instruction memory", t);
+            return DBH_ERR_RANGE;
+        }
+    }
+    SmtState *s = &p->smt;
+    memset(s, 0, sizeof(*s));
+    s->nthreads = (uint8_t)nthreads;
+    s->policy = (uint8_t)policy;
+    for (int t = 0; t < nthreads; t++) {
+        s->start[t] = start[t];
+        s->pc[t] = start[t];
+    }
+    p->PC = start[0];
+    return DBH_OK;
+}
+
+// Moves thread t's state into the Processor's fields and parks the current
+// thread's.
+void smt_switch(Processor *p, int thread) {
+    SmtState *s = &p->smt;
+    int c = s->cur;
+    if (thread == c) return;
+    memcpy(s->regs[c], p->Register, sizeof(p->Register));
+    s->sreg[c] = p->SREG;
+    s->pc[c] = p->PC;
+    s->fetched[c] = p->IF_ID;
+    s->pending[c] = p->pending_regs;
+
+    memcpy(p->Register, s->regs[thread], sizeof(p->Register));
+    p->SREG = s->sreg[thread];
+    p->PC = s->pc[thread];
+    p->IF_ID = s->fetched[thread];
+    p->pending_regs = s->pending[thread];
+    s->cur = (uint8_t)thread;
+}
+
+// true while a thread other than the current one still has instructions to
+// fetch or decode; ID/EX and loads in flight are checked by proc_running()
+bool smt_alive(const Processor *p) {
+    const SmtState *s = &p->smt;
+    for (int t = 0; t < s->nthreads; t++) {
+        if (t != s->cur && (s->pc[t] < 1024 || s->fetched[t].valid || s->pending[t])) return true;
+    }
+    return false;
+}
+
+void print_smt(const Processor *p) {
+    const SmtState *s = &p->smt;
+    if (!s->nthreads) return;
+    proc_printf(p, "Fetch policy: %s\n", s->policy == SMT_ICOUNT ? "icount" : "round-robin");
+    proc_printf(p, "%-7s %6s %12s %10s %10s %10s %7s %7s\n", "Thread", "Start", "Instructions", "Fetches",
+                "Waits", "Finished", "IPC", "Share");
+    uint64_t total = 0;
+    uint64_t end = 0;   // the cycle the last thread finished
+    bool running = false;
+    for (int t = 0; t < s->nthreads; t++) {
+        total += s->instret[t];
+        if (!s->done_cycle[t]) running = true;
+        if (s->done_cycle[t] > end) end = s->done_cycle[t];
+    }
+    if (running) end = p->cycle;
+    double min_ipc = 0.0, max_ipc = 0.0, sum = 0.0, sum_sq = 0.0;
+    for (int t = 0; t < s->nthreads; t++) {
+        uint64_t cycles = s->done_cycle[t] ? s->done_cycle[t] : p->cycle;
+        double ipc = cycles ? (double)s->instret[t] / cycles : 0.0;
+        char done[24] = "-";
+        if (s->done_cycle[t]) snprintf(done, sizeof(done), "%llu", (unsigned long long)s->done_cycle[t]);
+        proc_printf(p, "%-7d 0x%04X %12llu %10llu %10llu %10s %7.3f %6.1f%%\n", t, s->start[t],
+                    (unsigned long long)s->instret[t], (unsigned long long)s->fetches[t],
+                    (unsigned long long)s->waits[t], done, ipc, total ? 100.0 * s->instret[t] / total : 0.0);
+        if (t == 0 || ipc < min_ipc) min_ipc = ipc;
+        if (ipc > max_ipc) max_ipc = ipc;
+        sum += ipc;
+        sum_sq += ipc * ipc;
+    }
+    proc_printf(p, "Throughput: %.3f instructions/cycle over %llu cycles\n",
+                end ? (double)total / end : 0.0, (unsigned long long)end);
+    // Jain's index is 1 when every thread progresses at the same rate
+    proc_printf(p, "Fairness: min/max IPC %.3f, Jain's index %.3f\n", max_ipc > 0.0 ? min_ipc / max_ipc : 0.0,
+                sum_sq > 0.0 ? sum * sum / (s->nthreads * sum_sq) : 0.0);
+    // thread 0's state is the Final Registers section
+    for (int t = 1; t < s->nthreads; t++) {
+        const uint8_t *regs = t == s->cur ? p->Register : s->regs[t];
+        proc_printf(p, "Thread %d: PC 0x%04X, SREG 0x%02X", t, t == s->cur ? p->PC : s->pc[t],
+                    t == s->cur ? p->SREG : s->sreg[t]);
+        for (int r = 1; r < 64; r++) {
+            if (regs[r]) proc_printf(p, ", R%d=%d", r, regs[r]);
+        }
+        proc_printf(p, "\n");
+    }
+}
@@ -0,0 +1,377 @@
+#include "processor.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Reverse execution. While enabled, the machine state is snapshotted every
+// `interval` cycles; going back means restoring the nearest earlier snapshot
+// and re-executing forward, which is exact because the simulator is
+// deterministic. When the table fills up every other snapshot is dropped and
+// the interval doubles, so memory stays bounded and the replay needed for any
+// reverse operation stays a fixed fraction of the run (a few thousand cycles
+// per million simulated).
+//
+// Snapshots include instruction memory, so code edits are part of the history;
+// breakpoints and watchpoints are not. While the profile, register statistics
+// or energy model is on, each snapshot also keeps a copy of its accumulators,
+// so their reports after moving back describe the restored timeline; one that
+// is turned on after a snapshot was taken is not rewound past it. A host that changes the state by hand
+// calls tt_checkpoint() afterwards: it pins a snapshot of the edited state and
+// drops the now invalid future, so no replay ever runs across an edit.
+
+#define TT_MAX_SNAPS    256
+#define TT_MIN_INTERVAL 256
+
+// accumulators a snapshot holds a copy of
+enum {
+    ACC_PROF     = 0x01,
+    ACC_REGSTATS = 0x02,
+    ACC_ENERGY   = 0x04
+};
+
+typedef struct {
+    uint16_t     instr_mem[1024];
+    uint8_t      Register[64];
+    uint8_t      SREG;
+    uint16_t     PC;
+    uint8_t      data_mem[2048];
+    IF_ID_Reg    IF_ID;
+    ID_EX_Reg    ID_EX;
+    uint16_t     EX_instr;
+    uint16_t     EX_pc;
+    uint8_t      EX_thread;
+    bool         EX_valid;
+    uint64_t     cycle;
+    uint64_t     pending_regs;
+    uint64_t     mem_busy_until;
+    EventQueue   events;
+    PerfCounters perf;
+    uint32_t     counter_latch[CTR_MMIO_COUNT];
+    uint16_t     mem_op_pc;
+    IrqState     irq;
+    SmtState     smt;
+    WatchHit     watch_hit;
+    int          error;
+    bool         pinned;       // taken by tt_checkpoint(), survives thinning
+    uint8_t      acc_saved;    // ACC_* bits of the accumulators in acc
+    uint8_t     *acc;          // profile, regstats and energy copies; stays with the slot
+} Snapshot;
+
+struct TimeTravel {
+    Snapshot snaps[TT_MAX_SNAPS];   // ordered by cycle
+    int      count;
+    uint64_t interval;
+    uint64_t next;                  // cycle of the next snapshot
+};
+
+static void save_acc(const Processor *p, Snapshot *s) {
+    s->acc_saved = 0;
+    if (!p->prof && !p->regstats && !p->energy) return;
+    if (!s->acc) {
+        s->acc = malloc(profile_state_size() + regstats_state_size() + energy_state_size());
+        if (!s->acc) return;
+    }
+    uint8_t *b = s->acc;
+    if (p->prof) {
+        memcpy(b, p->prof, profile_state_size());
+        s->acc_saved |= ACC_PROF;
+    }
+    b += profile_state_size();
+    if (p->regstats) {
+        memcpy(b, p->regstats, regstats_state_size());
+        s->acc_saved |= ACC_REGSTATS;
+    }
+    b += regstats_state_size();
+    if (p->energy) {
+        memcpy(b, p->energy, energy_state_size());
+        s->acc_saved |= ACC_ENERGY;
+    }
+}
+
+static void restore_acc(Processor *p, const Snapshot *s) {
+    const uint8_t *b = s->acc;
+    if (p->prof && (s->acc_saved & ACC_PROF)) memcpy(p->prof, b, profile_state_size());
+    b += profile_state_size();
+    if (p->regstats && (s->acc_saved & ACC_REGSTATS)) memcpy(p->regstats, b, regstats_state_size());
+    b += regstats_state_size();
+    if (p->energy && (s->acc_saved & ACC_ENERGY)) memcpy(p->energy, b, energy_state_size());
+}
+
+static void save(const Processor *p, Snapshot *s) {
+    memcpy(s->instr_mem, p->instr_mem, sizeof(s->instr_mem));
+    memcpy(s->Register, p->Register, sizeof(s->Register));
+    memcpy(s->data_mem, p->data_mem, sizeof(s->data_mem));
+    memcpy(s->counter_latch, p->counter_latch, sizeof(s->counter_latch));
+    s->SREG           = p->SREG;
+    s->PC             = p->PC;
+    s->IF_ID          = p->IF_ID;
+    s->ID_EX          = p->ID_EX;
+    s->EX_instr       = p->EX_instr;
+    s->EX_pc          = p->EX_pc;
+    s->EX_thread      = p->EX_thread;
+    s->EX_valid       = p->EX_valid;
+    s->cycle          = p->cycle;
+    s->pending_regs   = p->pending_regs;
+    s->mem_busy_until = p->mem_busy_until;
+    s->events         = p->events;
+    s->perf           = p->perf;
+    s->mem_op_pc      = p->mem_op_pc;
+    s->irq            = p->irq;
+    s->smt            = p->smt;
+    s->watch_hit      = p->watch_hit;
+    s->error          = p->error;
+    s->pinned         = false;
+    save_acc(p, s);
+}
+
+static void restore(Processor *p, const Snapshot *s) {
+    for (int i = 0; i < 1024; i++) {
+        if (p->instr_mem[i] != s->instr_mem[i]) {
+            p->instr_mem[i] = s->instr_mem[i];
+            proc_predecode(p, (uint16_t)i);
+        }
+    }
+    memcpy(p->Register, s->Register, sizeof(s->Register));
+    memcpy(p->data_mem, s->data_mem, sizeof(s->data_mem));
+    memcpy(p->counter_latch, s->counter_latch, sizeof(s->counter_latch));
+    p->SREG           = s->SREG;
+    p->PC             = s->PC;
+    p->IF_ID          = s->IF_ID;
+    p->ID_EX          = s->ID_EX;
+    p->EX_instr       = s->EX_instr;
+    p->EX_pc          = s->EX_pc;
+    p->EX_thread      = s->EX_thread;
+    p->EX_valid       = s->EX_valid;
+    p->cycle          = s->cycle;
+    p->pending_regs   = s->pending_regs;
+    p->mem_busy_until = s->mem_busy_until;
+    p->events         = s->events;
+    p->perf           = s->perf;
+    p->mem_op_pc      = s->mem_op_pc;
+    p->irq            = s->irq;
+    p->smt            = s->smt;
+    p->watch_hit      = s->watch_hit;
+    p->error          = s->error;
+    p->run_hits       = 0;
+    restore_acc(p, s);
+}
+
+int tt_enable(Processor *p) {
+    if (!p->tt) {
+        p->tt = calloc(1, sizeof(struct TimeTravel));
+        if (!p->tt) return DBH_ERR_NOMEM;
+    }
+    tt_reset(p);
+    return DBH_OK;
+}
+
+void tt_free(Processor *p) {
+    if (p->tt) {
+        for (int i = 0; i < TT_MAX_SNAPS; i++) free(p->tt->snaps[i].acc);
+    }
+    free(p->tt);
+    p->tt = NULL;
+}
+
+// drops the history; the current state becomes the earliest reachable point
+void tt_reset(Processor *p) {
+    struct TimeTravel *tt = p->tt;
+    if (!tt) return;
+    tt->count = 1;
+    tt->interval = TT_MIN_INTERVAL;
+    tt->next = p->cycle + tt->interval;
+    save(p, &tt->snaps[0]);
+}
+
+// Moves snapshot from to slot to. The accumulator buffers trade places, so
+// every slot keeps owning exactly one and none is leaked or shared.
+static void move_snap(struct TimeTravel *tt, int to, int from) {
+    if (to == from) return;
+    uint8_t *spare = tt->snaps[to].acc;
+    tt->snaps[to] = tt->snaps[from];
+    tt->snaps[from].acc = spare;
+}
+
+// Makes room in a full table: keeps the first snapshot, every pinned one and
+// every other periodic one. If pinned snapshots alone fill the table, the
+// oldest half of the history is given up.
+static void thin(struct TimeTravel *tt) {
+    int n = 1;
+    bool keep = false;
+    for (int i = 1; i < tt->count; i++) {
+        keep = !keep;
+        if (keep || tt->snaps[i].pinned) {
+            move_snap(tt, n++, i);
+        }
+    }
+    if (n == TT_MAX_SNAPS) {
+        n = TT_MAX_SNAPS / 2;
+        for (int i = 0; i < n; i++) move_snap(tt, i, i + n);
+    }
+    tt->count = n;
+    tt->interval *= 2;
+}
+
+// Snapshots at or after the current cycle can only exist when the machine was
+// moved back in time and then ran on past a checkpoint without its edit; they
+// describe another timeline and are dropped.
+static void append(Processor *p, bool pinned) {
+    struct TimeTravel *tt = p->tt;
+    while (tt->count && tt->snaps[tt->count - 1].cycle >= p->cycle) {
+        tt->count--;
+    }
+    if (tt->count == TT_MAX_SNAPS) {
+        thin(tt);
+    }
+    save(p, &tt->snaps[tt->count]);
+    tt->snaps[tt->count++].pinned = pinned;
+    tt->next = p->cycle + tt->interval;
+}
+
+// called at the end of every cycle while reverse execution is enabled
+void tt_cycle(Processor *p) {
+    if (p->cycle >= p->tt->next) {
+        append(p, false);
+    }
+}
+
+// Records the current state after a manual edit (registers, memory, code or
+// pipeline). Snapshots from this cycle on described the unedited machine and
+// are dropped.
+void tt_checkpoint(Processor *p) {
+    if (p->tt) {
+        append(p, true);
+    }
+}
+
+// Re-executing must not print or snapshot again, so those hooks are detached
+// for the duration. The profile, register statistics and energy model stay:
+// restore() rewinds them with the machine and the replay brings them forward.
+typedef struct {
+    struct TimeTravel *tt;
+    OutputSink        output;
+} Hooks;
+
+static Hooks detach(Processor *p) {
+    Hooks h = { p->tt, p->output };
+    p->tt = NULL;
+    p->output = NULL;
+    return h;
+}
+
+// After moving in time, later snapshots stay valid up to the next checkpoint,
+// which is where the state was edited. tt_cycle() next looks at the history
+// when running forward reaches that cycle without the edit, or at the
+// regular spacing past the newest snapshot.
+static void attach(Processor *p, Hooks h) {
+    struct TimeTravel *tt = h.tt;
+    p->tt = tt;
+    p->output = h.output;
+    tt->next = tt->snaps[tt->count - 1].cycle + tt->interval;
+    for (int i = 0; i < tt->count; i++) {
+        if (tt->snaps[i].pinned && tt->snaps[i].cycle > p->cycle) {
+            tt->next = tt->snaps[i].cycle;
+            break;
+        }
+    }
+}
+
+// latest snapshot taken no later than cycle, or -1
+static int snapshot_before(const struct TimeTravel *tt, uint64_t cycle) {
+    int i = tt->count - 1;
+    while (i >= 0 && tt->snaps[i].cycle > cycle) i--;
+    return i;
+}
+
+// runs forward to the given cycle, ignoring breakpoints and watchpoints
+static void run_to_cycle(Processor *p, uint64_t cycle) {
+    StopCond c = { 0, 0, -1, -1, 0, -1, false };
+    while (p->cycle < cycle) {
+        c.max_cycles = cycle - p->cycle;
+        int r = proc_run(p, &c);
+        if (r == STOP_DONE || r == STOP_ERROR || r == STOP_CYCLES) break;
+    }
+}
+
+// Moves to the state at the end of the given cycle, restoring the nearest
+// snapshot when there is one between here and there (going back, or forward
+// across a checkpoint). Going back is limited to the recorded history.
+int tt_goto_cycle(Processor *p, uint64_t cycle) {
+    struct TimeTravel *tt = p->tt;
+    if (!tt) return DBH_ERR_RANGE;
+    int k = snapshot_before(tt, cycle);
+    if (cycle < p->cycle || (k >= 0 && tt->snaps[k].cycle > p->cycle)) {
+        if (k < 0) return DBH_ERR_RANGE;
+        Hooks h = detach(p);
+        restore(p, &tt->snaps[k]);
+        run_to_cycle(p, cycle);
+        attach(p, h);
+    } else {
+        run_to_cycle(p, cycle);
+    }
+    return DBH_OK;
+}
+
+// Undoes the most recently executed instruction: moves to the first cycle at
+// which one instruction fewer had executed, which is where a forward
+// single-instruction step would have stopped.
+int tt_step_back(Processor *p) {
+    struct TimeTravel *tt = p->tt;
+    if (!tt || p->perf.instret == 0) return DBH_ERR_RANGE;
+    uint64_t target = p->perf.instret - 1;
+    // a checkpoint is the earliest point of the edited timeline, so stop there
+    int k = snapshot_before(tt, p->cycle);
+    while (k > 0 && tt->snaps[k].perf.instret >= target &&
+           !(tt->snaps[k].pinned && tt->snaps[k].perf.instret == target)) k--;
+    if (k < 0 || tt->snaps[k].perf.instret > target) return DBH_ERR_RANGE;
+
+    Hooks h = detach(p);
+    restore(p, &tt->snaps[k]);
+    StopCond c = { 0, 0, -1, -1, 0, -1, false };
+    while (p->perf.instret < target) {
+        c.max_instructions = target - p->perf.instret;
+        int r = proc_run(p, &c);
+        if (r == STOP_DONE || r == STOP_ERROR) break;
+    }
+    attach(p, h);
+    return DBH_OK;
+}
+
+// Runs backwards to the last point before the current cycle at which
+// proc_run(p, cond) would have stopped: a breakpoint, a watchpoint or one of
+// cond's PC/register/store conditions (budgets are ignored). With
+// cond->reg_written set this answers "who last wrote R12". Returns that
+// STOP_* reason, or STOP_DONE after going back to the start of the history.
+int tt_reverse(Processor *p, const StopCond *cond) {
+    struct TimeTravel *tt = p->tt;
+    if (!tt) return STOP_DONE;
+    StopCond c = { 0, 0, -1, -1, 0, -1, false };
+    if (cond) c = *cond;
+    c.max_instructions = 0;
+
+    uint64_t now = p->cycle;
+    Hooks h = detach(p);
+    for (int k = snapshot_before(tt, now); k >= 0; k--) {
+        // segment k: from snapshot k up to the next snapshot (or now)
+        uint64_t end = k + 1 < tt->count && tt->snaps[k + 1].cycle < now ? tt->snaps[k + 1].cycle : now;
+        uint64_t found = 0;
+        int reason = STOP_DONE;
+        restore(p, &tt->snaps[k]);
+        while (p->cycle < end) {
+            c.max_cycles = end - p->cycle;
+            int r = proc_run(p, &c);
+            if (r == STOP_DONE || r == STOP_ERROR || r == STOP_CYCLES) break;
+            if (p->cycle >= now) break;
+            found = p->cycle;
+            reason = r;
+        }
+        if (reason != STOP_DONE) {
+            restore(p, &tt->snaps[k]);
+            run_to_cycle(p, found);
+            attach(p, h);
+            return reason;
+        }
+    }
+    restore(p, &tt->snaps[0]);
+    attach(p, h);
+    return STOP_DONE;
+}
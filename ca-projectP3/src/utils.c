@@ -0,0 +1,42 @@
+#include "processor.h"
+#include <stdio.h>
+
+static const char *opcode_names[16] = {
+    "ADD", "SUB", "MUL", "MOVI", "BEQZ", "ANDI", "EOR", "BR",
+    "SAL", "SAR", "LDR", "STR", "RETI", "VALU", "VLDR", "VSTR"
+};
+
+const char *opcode_name(uint8_t opcode) {
+    return opcode_names[opcode & 0x0F];
+}
+
+// MOVI, BEQZ, ANDI, SAL, SAR, LDR, STR, VLDR and VSTR: the low 6 bits are an
+// immediate rather than rt
+bool op_imm_format(uint8_t opcode) {
+    return (0xCF38 >> (opcode & 0x0F)) & 1;
+}
+
+// ADD, SUB, MUL, MOVI, ANDI, EOR, SAL, SAR and LDR write their rs register,
+// and each of them also replaces SREG. Vector instructions write lanes, see
+// simd_writes().
+bool op_writes_rs(uint8_t opcode) {
+    return (0x076F >> (opcode & 0x0F)) & 1;
+}
+
+// formats an instruction word back into the assembler syntax
+void disassemble(uint16_t instruction, char *buf, size_t size) {
+    uint8_t opcode = (instruction >> 12) & 0x0F;
+    uint8_t rs = (instruction >> 6) & 0x3F;
+    uint8_t low = instruction & 0x3F;
+
+    if (opcode >= 13 && simd_disassemble(instruction, buf, size)) {
+        return;
+    }
+    if (op_imm_format(opcode)) {
+        snprintf(buf, size, "%s R%d %d", opcode_names[opcode], rs, low);
+    } else if (opcode == 12) {
+        snprintf(buf, size, "%s", opcode_names[opcode]);
+    } else {
+        snprintf(buf, size, "%s R%d R%d", opcode_names[opcode], rs, low);
+    }
+}
@@ -0,0 +1,14 @@
+// bubble.c - bubble sort of 12 bytes in data[0..11], the data of bubble.txt
+// build: ./dbhcc -o bubble_cc.txt workloads/bubble.c
+int data[12] = {60, 34, 44, 18, 48, 1, 47, 61, 35, 58, 29, 0};
+int pass, i, t;
+
+for (pass = 11; pass > 0; pass--) {
+    for (i = 0; i < pass; i++) {
+        if (data[i] > data[i + 1]) {
+            t = data[i];
+            data[i] = data[i + 1];
+            data[i + 1] = t;
+        }
+    }
+}
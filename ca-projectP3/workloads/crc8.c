@@ -0,0 +1,13 @@
+// crc8.c - bitwise CRC-8 (polynomial 0x07, init 0) over data[0..15], as crc8.txt
+// result: data[16] = crc
+int data[17] = {116, 189, 192, 64, 98, 22, 43, 70, 126, 107, 205, 15, 235, 249, 232, 199};
+int crc = 0, i, bit;
+
+for (i = 0; i < 16; i++) {
+    crc ^= data[i];
+    for (bit = 0; bit < 8; bit++) {
+        // (crc >> 7) is 0 or -1: the polynomial goes in when the top bit falls out
+        crc = (crc << 1) ^ ((crc >> 7) & 7);
+    }
+}
+data[16] = crc;
@@ -0,0 +1,84 @@
+// spill.c - more live scalars than registers: 70 running sums updated in a
+// loop, so the allocator spills to the top of dbhcc's data range. Checked
+// with sim -m, where the counters are mapped at 0x30-0x3F.
+// build: ./dbhcc -o workloads/spill.txt workloads/spill.c
+int out[4];
+int v0 = 11, v1 = 48, v2 = 85, v3 = 122, v4 = 31, v5 = 68, v6 = 105, v7 = 14, v8 = 51, v9 = 88, v10 = 125, v11 = 34, v12 = 71, v13 = 108, v14 = 17, v15 = 54, v16 = 91, v17 = 0, v18 = 37, v19 = 74, v20 = 111, v21 = 20, v22 = 57, v23 = 94, v24 = 3, v25 = 40, v26 = 77, v27 = 114, v28 = 23, v29 = 60, v30 = 97, v31 = 6, v32 = 43, v33 = 80, v34 = 117, v35 = 26, v36 = 63, v37 = 100, v38 = 9, v39 = 46, v40 = 83, v41 = 120, v42 = 29, v43 = 66, v44 = 103, v45 = 12, v46 = 49, v47 = 86, v48 = 123, v49 = 32, v50 = 69, v51 = 106, v52 = 15, v53 = 52, v54 = 89, v55 = 126, v56 = 35, v57 = 72, v58 = 109, v59 = 18, v60 = 55, v61 = 92, v62 = 1, v63 = 38, v64 = 75, v65 = 112, v66 = 21, v67 = 58, v68 = 95, v69 = 4;
+int i;
+
+for (i = 0; i < 6; i++) {
+    v0 = v0 + v1 ^ i;
+    v1 = v1 - v8;
+    v2 = v2 ^ v15 + 1;
+    v3 = v3 + v4 ^ i;
+    v4 = v4 - v11;
+    v5 = v5 ^ v18 + 1;
+    v6 = v6 + v7 ^ i;
+    v7 = v7 - v14;
+    v8 = v8 ^ v21 + 1;
+    v9 = v9 + v10 ^ i;
+    v10 = v10 - v17;
+    v11 = v11 ^ v24 + 1;
+    v12 = v12 + v13 ^ i;
+    v13 = v13 - v20;
+    v14 = v14 ^ v27 + 1;
+    v15 = v15 + v16 ^ i;
+    v16 = v16 - v23;
+    v17 = v17 ^ v30 + 1;
+    v18 = v18 + v19 ^ i;
+    v19 = v19 - v26;
+    v20 = v20 ^ v33 + 1;
+    v21 = v21 + v22 ^ i;
+    v22 = v22 - v29;
+    v23 = v23 ^ v36 + 1;
+    v24 = v24 + v25 ^ i;
+    v25 = v25 - v32;
+    v26 = v26 ^ v39 + 1;
+    v27 = v27 + v28 ^ i;
+    v28 = v28 - v35;
+    v29 = v29 ^ v42 + 1;
+    v30 = v30 + v31 ^ i;
+    v31 = v31 - v38;
+    v32 = v32 ^ v45 + 1;
+    v33 = v33 + v34 ^ i;
+    v34 = v34 - v41;
+    v35 = v35 ^ v48 + 1;
+    v36 = v36 + v37 ^ i;
+    v37 = v37 - v44;
+    v38 = v38 ^ v51 + 1;
+    v39 = v39 + v40 ^ i;
+    v40 = v40 - v47;
+    v41 = v41 ^ v54 + 1;
+    v42 = v42 + v43 ^ i;
+    v43 = v43 - v50;
+    v44 = v44 ^ v57 + 1;
+    v45 = v45 + v46 ^ i;
+    v46 = v46 - v53;
+    v47 = v47 ^ v60 + 1;
+    v48 = v48 + v49 ^ i;
+    v49 = v49 - v56;
+    v50 = v50 ^ v63 + 1;
+    v51 = v51 + v52 ^ i;
+    v52 = v52 - v59;
+    v53 = v53 ^ v66 + 1;
+    v54 = v54 + v55 ^ i;
+    v55 = v55 - v62;
+    v56 = v56 ^ v69 + 1;
+    v57 = v57 + v58 ^ i;
+    v58 = v58 - v65;
+    v59 = v59 ^ v2 + 1;
+    v60 = v60 + v61 ^ i;
+    v61 = v61 - v68;
+    v62 = v62 ^ v5 + 1;
+    v63 = v63 + v64 ^ i;
+    v64 = v64 - v1;
+    v65 = v65 ^ v8 + 1;
+    v66 = v66 + v67 ^ i;
+    v67 = v67 - v4;
+    v68 = v68 ^ v11 + 1;
+    v69 = v69 + v0 ^ i;
+}
+out[0] = v0 ^ v4 ^ v8 ^ v12 ^ v16 ^ v20 ^ v24 ^ v28 ^ v32 ^ v36 ^ v40 ^ v44 ^ v48 ^ v52 ^ v56 ^ v60 ^ v64 ^ v68;
+out[1] = v1 ^ v5 ^ v9 ^ v13 ^ v17 ^ v21 ^ v25 ^ v29 ^ v33 ^ v37 ^ v41 ^ v45 ^ v49 ^ v53 ^ v57 ^ v61 ^ v65 ^ v69;
+out[2] = v2 ^ v6 ^ v10 ^ v14 ^ v18 ^ v22 ^ v26 ^ v30 ^ v34 ^ v38 ^ v42 ^ v46 ^ v50 ^ v54 ^ v58 ^ v62 ^ v66;
+out[3] = v3 ^ v7 ^ v11 ^ v15 ^ v19 ^ v23 ^ v27 ^ v31 ^ v35 ^ v39 ^ v43 ^ v47 ^ v51 ^ v55 ^ v59 ^ v63 ^ v67;